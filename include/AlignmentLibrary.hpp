@@ -213,6 +213,10 @@ for (auto& txp : transcripts_) {
       if (!done) {
 
         auto fld = flDist_.get();
+        // Freeze the distribution, so that the effective lengths and the
+        // conditional fragment length probabilities used from now on agree
+        // (this must happen before done is set)
+        fld->cacheCMF();
         // Convert the PMF to non-log scale
         std::vector<double> logPMF;
         size_t minVal;
@@ -0,0 +1,94 @@
+#ifndef __ASYNC_BUFFER_WRITER_HPP__
+#define __ASYNC_BUFFER_WRITER_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blockingconcurrentqueue.h"
+
+/**
+ * Appends buffers, filled by any number of threads, to a file from a
+ * dedicated writer thread, so that the threads producing per-read output
+ * (unmapped names, orphan links, binary mappings) neither format into nor
+ * wait on a shared, locked stream.
+ *
+ * Each producing thread fills a buffer of its own (e.g. over a chunk of
+ * reads) and hands it over with push(), getting back an empty, recycled
+ * buffer to fill next; or copies its output in with write().  The buffers
+ * are passed through lock-free queues.  At most maxQueued recycled buffers
+ * are in flight, so producers block rather than use more and more memory
+ * if the writer falls behind.  The buffers of different threads are
+ * written in no particular order, but each is written whole.
+ *
+ * If compress is set, each buffer is written as a gzip member of its own,
+ * so that the output is a valid (multi-member) gzip file.
+ */
+class AsyncBufferWriter {
+public:
+  // Create (truncate) the file at path and start the writer thread; check
+  // good() afterwards.
+  explicit AsyncBufferWriter(const std::string& path, bool compress = false,
+                             size_t maxQueued = 64);
+  // Flushes and closes the file (see close()).
+  ~AsyncBufferWriter();
+
+  AsyncBufferWriter(const AsyncBufferWriter&) = delete;
+  AsyncBufferWriter& operator=(const AsyncBufferWriter&) = delete;
+
+  // False if the file could not be created, or if compressing or writing
+  // to it has failed (e.g. because the disk is full).
+  bool good() const { return file_ != nullptr and !failed_; }
+  const std::string& path() const { return path_; }
+
+  /**
+   * Write buf right away, from the calling thread (e.g. a header).  Must
+   * not be called once anything has been push()ed or write()n.
+   */
+  void writeNow(const std::vector<char>& buf);
+
+  /**
+   * Queue the content of buf to be written; buf is left empty (holding a
+   * recycled buffer) and can be reused right away.
+   */
+  void push(std::vector<char>& buf);
+
+  // Queue a copy of the n bytes at data to be written.
+  void write(const char* data, size_t n);
+
+  // Write out everything that has been queued, stop the writer thread and
+  // close the file.  Returns true if everything was written successfully.
+  // Must not be called concurrently with push() or write().
+  bool close();
+
+  // The number of bytes handed to the writer, and the number written to
+  // the file (which differ if compressing); only final after close().
+  uint64_t numBytes() const { return numBytes_; }
+  uint64_t numWrittenBytes() const { return numWrittenBytes_; }
+
+private:
+  void writerLoop_();
+  bool writeBlock_(const std::vector<char>& buf);
+
+  std::string path_;
+  bool compress_;
+  std::FILE* file_{nullptr};
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> done_{false};
+  bool closedOk_{false};
+
+  // filled buffers, waiting to be written, and emptied ones to fill
+  moodycamel::BlockingConcurrentQueue<std::vector<char>> filled_;
+  moodycamel::BlockingConcurrentQueue<std::vector<char>> free_;
+  std::thread writer_;
+
+  // only touched by the writer thread (until it has been joined)
+  std::vector<unsigned char> out_;
+  uint64_t numBytes_{0};
+  uint64_t numWrittenBytes_{0};
+};
+
+#endif // __ASYNC_BUFFER_WRITER_HPP__
@@ -0,0 +1,98 @@
+#ifndef __BATCH_EXTENSION_SCORER_HPP__
+#define __BATCH_EXTENSION_SCORER_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "ksw2pp/KSW2Aligner.hpp"
+
+namespace salmon {
+namespace mapping {
+
+/**
+ * Computes the scores of many (short) score-only extension alignments at
+ * once, by aligning several (query, target) pairs in the lanes of a SIMD
+ * register (inter-sequence vectorization), rather than vectorizing within a
+ * single alignment as ksw2 does.
+ *
+ * The score of each alignment is exactly the one --validateMappings gets
+ * from KSW2Aligner (ksw_extz2_sse(), KSW_EZ_SCORE_ONLY, no z-drop): the
+ * larger of the best scores reaching the end of the query (mqe) and the end
+ * of the target (mte).  On CPUs without SSE4.1, and for very long
+ * sequences, the alignments are simply scored with KSW2Aligner.
+ *
+ * Usage: add() all of the alignments of a batch (e.g. of a chunk of reads),
+ * run(), and then look up each score() by the index add() returned.
+ */
+class BatchExtensionScorer {
+public:
+  // The ways of scoring a batch; KSW2 scores the alignments one at a time.
+  enum class Kernel : uint8_t { KSW2, SSE41, AVX2 };
+
+  BatchExtensionScorer(int8_t match, int8_t mismatch, int8_t gapo,
+                       int8_t gape, int bandwidth);
+
+  /**
+   * Queue the alignment of query (of length qlen) against target (of
+   * length tlen); both are copied.  Returns the index of the alignment
+   * in the current batch.
+   */
+  size_t add(const char* query, int32_t qlen, const char* target,
+             int32_t tlen);
+
+  // Score all of the queued alignments.
+  void run();
+
+  int32_t score(size_t i) const { return scores_[i]; }
+  size_t size() const { return jobs_.size(); }
+
+  // Start a new batch.
+  void clear();
+
+  /**
+   * Use the given kernel rather than the best one the CPU supports (e.g. to
+   * test each of them).  Returns false, leaving the kernel unchanged, if the
+   * CPU doesn't support it.
+   */
+  bool setKernel(Kernel k);
+  Kernel kernel() const;
+
+private:
+  struct Job {
+    uint32_t qOffset;
+    uint32_t tOffset;
+    int32_t qlen;
+    int32_t tlen;
+  };
+
+  void scoreWithKSW2_(size_t i);
+  void runBatches_();
+
+  int8_t match_;
+  int8_t mismatch_;
+  int8_t gapo_;
+  int8_t gape_;
+  int bandwidth_;
+  bool useSSE41_{false};
+  bool useAVX2_{false};
+
+  // the (2-bit encoded) sequences of the queued alignments
+  std::vector<uint8_t> seqs_;
+  std::vector<Job> jobs_;
+  std::vector<int32_t> scores_;
+  std::vector<uint32_t> order_;
+
+  // scratch space for the kernel
+  std::vector<uint8_t> qcodes_;
+  std::vector<uint8_t> tcodes_;
+  std::vector<uint8_t> diffs_;
+  std::vector<int32_t> H_;
+
+  // for the alignments the kernel doesn't take
+  ksw2pp::KSW2Aligner aligner_;
+  ksw_extz_t ez_;
+};
+}
+}
+
+#endif // __BATCH_EXTENSION_SCORER_HPP__
@@ -0,0 +1,332 @@
+#ifndef __BATCH_EXTENSION_SCORER_KERNEL_HPP__
+#define __BATCH_EXTENSION_SCORER_KERNEL_HPP__
+
+// Internal to BatchExtensionScorer; the kernel is instantiated once per
+// instruction set, each in a translation unit compiled for that instruction
+// set (see src/CMakeLists.txt).  Everything such a translation unit compiles
+// from here has internal linkage: an inline function or template with
+// external linkage (ours or the standard library's) would be emitted as a
+// weak symbol, and the linker could then pick its AVX2 copy for callers
+// that run on any CPU.
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#include "ksw2pp/KSW2Aligner.hpp"
+
+namespace salmon {
+namespace mapping {
+namespace batch_kernel {
+
+// The query codes are stored from position -QUERY_PAD on (see below).
+constexpr const int QUERY_PAD = 16;
+
+struct KernelArgs {
+  int numUsed; // lanes that hold an alignment
+  const int32_t* qlen;
+  const int32_t* tlen;
+  // [(j + QUERY_PAD) * lanes + l] : code of query base j of lane l, for
+  // j = -QUERY_PAD .. qmax - 1; 0 outside of the query (as in ksw2's
+  // zero-filled buffers)
+  const uint8_t* qcodes;
+  // [t * lanes + l] : code of target base t of lane l, for t < tspan; 0 past
+  // the end of the target
+  const uint8_t* tcodes;
+  // the longest target, rounded up to a multiple of 16
+  int tspan;
+  int8_t match;
+  int8_t mismatch;
+  int8_t gapo;
+  int8_t gape;
+  int w;
+  // scratch of tspan * lanes elements each
+  uint8_t* u;
+  uint8_t* v;
+  uint8_t* x;
+  uint8_t* y;
+  uint8_t* s;
+  int32_t* H;
+  // out : max(mqe, mte) for each used lane
+  int32_t* scores;
+};
+
+namespace {
+// (rather than std::min / std::max; see above)
+inline int32_t minOf(int32_t a, int32_t b) { return (b < a) ? b : a; }
+inline int32_t maxOf(int32_t a, int32_t b) { return (a < b) ? b : a; }
+
+/**
+ * ksw_extz2_sse() (the SSE4.1 version; KSW_EZ_SCORE_ONLY, no z-drop), with
+ * one alignment in each (8-bit) lane rather than 16 cells of one alignment.
+ *
+ * Each lane goes through exactly the steps ksw_extz2_sse() would take for its
+ * alignment: the same anti-diagonals, each widened to multiples of 16 cells
+ * (so cells just outside of the band are computed, from whatever score was
+ * last written at their position), the same 8-bit arithmetic and the same
+ * 32-bit running scores.  This is what makes the scores *identical* to the
+ * ones KSW2Aligner computes, not just the same up to the edges of the band.
+ * The lanes walk the union of their anti-diagonals, and the cells outside of
+ * a lane's own range are masked out.
+ */
+template <typename Ops> void extz2Batch(const KernelArgs& args) {
+  using V = typename Ops::V;
+  using W = typename Ops::W;
+  constexpr const int L = Ops::LANES;
+  constexpr const int WL = Ops::W_LANES;
+  constexpr const int NW = L / WL;
+
+  const int32_t q = args.gapo;
+  const int32_t e = args.gape;
+  const int32_t qe = q + e;
+  const int w = args.w;
+  uint8_t* u = args.u;
+  uint8_t* v = args.v;
+  uint8_t* x = args.x;
+  uint8_t* y = args.y;
+  uint8_t* s = args.s;
+  int32_t* H = args.H;
+
+  const size_t cells = static_cast<size_t>(args.tspan) * L;
+  std::memset(u, 0, cells);
+  std::memset(v, 0, cells);
+  std::memset(x, 0, cells);
+  std::memset(y, 0, cells);
+  std::memset(s, 0, cells);
+  for (size_t i = 0; i < cells; ++i) {
+    H[i] = KSW_NEG_INF;
+  }
+
+  const V zero = Ops::set1(0);
+  const V m1 = Ops::set1(4);
+  const V qe2 = Ops::set1(static_cast<int8_t>(qe * 2));
+  const V vq = Ops::set1(static_cast<int8_t>(q));
+  const V scMch = Ops::set1(args.match);
+  const V scMis = Ops::set1(args.mismatch);
+  // N scores -e, since the N entries of KSW2Aligner's matrix are 0
+  const V scN = Ops::set1(static_cast<int8_t>(-e));
+  const V maxSc = Ops::set1(static_cast<int8_t>(args.match + qe * 2));
+  const W qeW = Ops::set1W(qe);
+
+  bool active[L];
+  int32_t rEnd[L];
+  int32_t tEnd[L];   // the target, rounded up to a multiple of 16
+  int32_t lastSt[L]; // the (widened) anti-diagonal of the previous round
+  int32_t lastEn[L];
+  int32_t mqe[L];
+  int32_t mte[L];
+  // the ranges of the current anti-diagonal : the scores written, the cells
+  // computed and the running scores updated
+  int16_t sLo[L], sHi[L], cLo[L], cHi[L];
+  int32_t hLo[L], hHi[L];
+  uint8_t x1[L], v1[L];
+
+  int rMax{0};
+  for (int l = 0; l < L; ++l) {
+    active[l] = (l < args.numUsed);
+    rEnd[l] = active[l] ? args.qlen[l] + args.tlen[l] - 1 : 0;
+    tEnd[l] = active[l] ? (args.tlen[l] + 15) / 16 * 16 : 0;
+    lastSt[l] = lastEn[l] = -1;
+    mqe[l] = mte[l] = KSW_NEG_INF;
+    x1[l] = v1[l] = 0;
+    rMax = maxOf(rMax, rEnd[l]);
+  }
+
+  W prevH[NW];
+  for (int r = 0; r < rMax; ++r) {
+    int sMin{INT_MAX}, sMax{-1}, cMin{INT_MAX}, cMax{-1}, hMin{INT_MAX},
+        hMax{-1};
+    // When all of the lanes that are still going have the same ranges (the
+    // common case, as the batches are made of alignments of similar sizes),
+    // the masks can be skipped; the other lanes are never looked at again.
+    bool sSame{true}, cSame{true}, hSame{true};
+    for (int l = 0; l < L; ++l) {
+      int32_t st0{0}, en0{-1};
+      if (active[l] and r < rEnd[l]) {
+        const int32_t qlen = args.qlen[l];
+        const int32_t tlen = args.tlen[l];
+        st0 = 0, en0 = tlen - 1;
+        if (st0 < r - qlen + 1) st0 = r - qlen + 1;
+        if (en0 > r) en0 = r;
+        if (st0 < (r - w + 1) >> 1) st0 = (r - w + 1) >> 1;
+        if (en0 > (r + w) >> 1) en0 = (r + w) >> 1;
+      }
+      if (st0 > en0) {
+        // finished, or out of the band for good
+        active[l] = false;
+        sLo[l] = cLo[l] = SHRT_MAX;
+        sHi[l] = cHi[l] = -1;
+        hLo[l] = INT_MAX;
+        hHi[l] = -1;
+        continue;
+      }
+      int32_t st = st0 / 16 * 16;
+      int32_t en = (en0 + 16) / 16 * 16 - 1;
+      if (st > 0) {
+        if (st - 1 >= lastSt[l] and st - 1 <= lastEn[l]) {
+          x1[l] = x[(st - 1) * L + l];
+          v1[l] = v[(st - 1) * L + l];
+        } else {
+          x1[l] = v1[l] = 0;
+        }
+      } else {
+        x1[l] = 0;
+        v1[l] = r ? q : 0;
+      }
+      if (en >= r) {
+        y[r * L + l] = 0;
+        u[r * L + l] = r ? q : 0;
+      }
+      // the scores are set 16 at a time from st0 on; the ones past the end
+      // of the (rounded) target land outside of the matrix
+      int32_t sEnd = minOf(st0 + (en0 - st0) / 16 * 16 + 15, tEnd[l] - 1);
+      sLo[l] = st0;
+      sHi[l] = sEnd;
+      cLo[l] = st;
+      cHi[l] = en;
+      hLo[l] = st0;
+      hHi[l] = en0;
+      lastSt[l] = st;
+      lastEn[l] = en;
+      if (hMax >= 0) {
+        sSame = sSame and sMin == st0 and sMax == sEnd;
+        cSame = cSame and cMin == st and cMax == en;
+        hSame = hSame and hMin == st0 and hMax == en0;
+      }
+      sMin = minOf(sMin, st0);
+      sMax = maxOf(sMax, sEnd);
+      cMin = minOf(cMin, st);
+      cMax = maxOf(cMax, en);
+      hMin = minOf(hMin, st0);
+      hMax = maxOf(hMax, en0);
+    }
+    if (hMax < 0) {
+      break;
+    }
+
+    // the scores of the cells
+    for (int t = sMin; t <= sMax; ++t) {
+      V sq = Ops::load(args.tcodes + t * L);
+      V qq = Ops::load(args.qcodes + (r - t + QUERY_PAD) * L);
+      V isN = Ops::or_(Ops::cmpeq(sq, m1), Ops::cmpeq(qq, m1));
+      V sc = Ops::blend(scMis, scMch, Ops::cmpeq(sq, qq));
+      sc = Ops::blend(sc, scN, isN);
+      if (!sSame) {
+        sc = Ops::blend(Ops::load(s + t * L), sc, Ops::rangeMask(sLo, sHi, t));
+      }
+      Ops::store(s + t * L, sc);
+    }
+
+    // the DP, in the difference form of ksw_extz2_sse()
+    const V x1v = Ops::load(x1);
+    const V v1v = Ops::load(v1);
+    V prevX = zero;
+    V prevV = zero;
+    for (int t = cMin; t <= cMax; ++t) {
+      const V xo = Ops::load(x + t * L);
+      const V vo = Ops::load(v + t * L);
+      const V uo = Ops::load(u + t * L);
+      const V yo = Ops::load(y + t * L);
+      V z = Ops::add(Ops::load(s + t * L), qe2);
+      V xt1, vt1;
+      if (cSame) {
+        xt1 = (t == cMin) ? x1v : prevX;
+        vt1 = (t == cMin) ? v1v : prevV;
+      } else {
+        const V first = Ops::eqMask(cLo, t);
+        xt1 = Ops::blend(prevX, x1v, first);
+        vt1 = Ops::blend(prevV, v1v, first);
+      }
+      prevX = xo;
+      prevV = vo;
+      V a = Ops::add(xt1, vt1);
+      V b = Ops::add(yo, uo);
+      z = Ops::maxi(z, a);
+      z = Ops::maxu(z, b);
+      z = Ops::minu(z, maxSc);
+      V un = Ops::sub(z, vt1);
+      V vn = Ops::sub(z, uo);
+      z = Ops::sub(z, vq);
+      V xn = Ops::maxi(Ops::sub(a, z), zero);
+      V yn = Ops::maxi(Ops::sub(b, z), zero);
+      if (!cSame) {
+        const V in = Ops::rangeMask(cLo, cHi, t);
+        un = Ops::blend(uo, un, in);
+        vn = Ops::blend(vo, vn, in);
+        xn = Ops::blend(xo, xn, in);
+        yn = Ops::blend(yo, yn, in);
+      }
+      Ops::store(u + t * L, un);
+      Ops::store(v + t * L, vn);
+      Ops::store(x + t * L, xn);
+      Ops::store(y + t * L, yn);
+    }
+
+    // the running (32-bit) scores of the anti-diagonal
+    if (r == 0) {
+      for (int l = 0; l < L; ++l) {
+        if (hHi[l] >= 0) {
+          H[l] = static_cast<int32_t>(v[l]) - qe - qe;
+        }
+      }
+    } else {
+      for (int g = 0; g < NW; ++g) {
+        prevH[g] = (hMin > 0) ? Ops::loadW(H + (hMin - 1) * L + g * WL)
+                              : Ops::set1W(KSW_NEG_INF);
+      }
+      for (int t = hMin; t <= hMax; ++t) {
+        const W tv = Ops::set1W(t);
+        for (int g = 0; g < NW; ++g) {
+          int32_t* hp = H + t * L + g * WL;
+          const W ho = Ops::loadW(hp);
+          const W inner =
+              Ops::subW(Ops::addW(ho, Ops::widen(v + t * L + g * WL)), qeW);
+          // the last cell of the anti-diagonal extends the one before it
+          const W last =
+              (t > 0) ? Ops::subW(Ops::addW(prevH[g],
+                                            Ops::widen(u + t * L + g * WL)),
+                                  qeW)
+                      : inner;
+          if (hSame) {
+            Ops::storeW(hp, (t == hMax) ? last : inner);
+          } else {
+            const W lo = Ops::loadW(hLo + g * WL);
+            const W hi = Ops::loadW(hHi + g * WL);
+            const W isInner =
+                Ops::andnotW(Ops::cmpgtW(lo, tv), Ops::cmpgtW(hi, tv));
+            const W isLast = Ops::cmpeqW(hi, tv);
+            Ops::storeW(hp, Ops::blendW(Ops::blendW(ho, last, isLast), inner,
+                                        isInner));
+          }
+          prevH[g] = ho;
+        }
+      }
+    }
+
+    for (int l = 0; l < L; ++l) {
+      if (hHi[l] < 0) {
+        continue;
+      }
+      if (hHi[l] == args.tlen[l] - 1 and H[hHi[l] * L + l] > mte[l]) {
+        mte[l] = H[hHi[l] * L + l];
+      }
+      if (r - hLo[l] == args.qlen[l] - 1 and H[hLo[l] * L + l] > mqe[l]) {
+        mqe[l] = H[hLo[l] * L + l];
+      }
+    }
+  }
+
+  for (int l = 0; l < args.numUsed; ++l) {
+    args.scores[l] = maxOf(mqe[l], mte[l]);
+  }
+}
+
+} // namespace
+
+void extz2BatchSSE41(const KernelArgs& args);
+void extz2BatchAVX2(const KernelArgs& args);
+}
+}
+}
+
+#endif // __BATCH_EXTENSION_SCORER_KERNEL_HPP__
@@ -0,0 +1,125 @@
+#ifndef __BINARY_MAPPING_WRITER_HPP__
+#define __BINARY_MAPPING_WRITER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AsyncBufferWriter.hpp"
+
+/**
+ * Writes the quasi-mappings of the reads (--writeBinaryMappings) in a
+ * compact, binary form; a much cheaper alternative to the SAM output of
+ * --writeMappings.  scripts/ConvertBinaryMappingsToSAM.py converts the
+ * result to SAM.
+ *
+ * Each mapping thread appends the mapped fragments of a chunk of reads to
+ * its own buffer (addFragment()) and hands the buffer to push(); an
+ * AsyncBufferWriter compresses each buffer into its own gzip member and
+ * appends it to the file.  The file is therefore a valid (multi-member)
+ * gzip file whose decompressed content is
+ *
+ *   "SALMONBM" | uint32_t version | uint32_t numTargets |
+ *   for each target: uint32_t nameLen, name, uint32_t length |
+ *   for each mapped fragment:
+ *     uint32_t nameLen, name, uint32_t numHits, Hit*
+ *
+ * where each Hit is packed, field by field, as
+ *
+ *   uint32_t tid | int32_t pos | int32_t matePos | int32_t fragLen |
+ *   uint32_t readLen | uint32_t mateLen | uint8_t flags |
+ *   uint8_t mateStatus | float score
+ *
+ * flags holds FWD and MATE_FWD, and mateStatus is that of RapMap
+ * (0 = single-end, 1 = left end only, 2 = right end only, 3 = both ends).
+ * All values are little-endian.  The fragments of a chunk are written
+ * together, but the chunks of different threads are interleaved.
+ */
+class BinaryMappingWriter {
+public:
+  static constexpr const char magic[] = "SALMONBM";
+  static constexpr const uint32_t version = 1;
+  enum HitFlags : uint8_t { FWD = 0x1, MATE_FWD = 0x2 };
+
+  // Create (truncate) the file at path; check good() afterwards.
+  explicit BinaryMappingWriter(const std::string& path) : out_(path, true) {}
+
+  // False if the file could not be created, or if compressing or writing
+  // to it has failed (e.g. because the disk is full).
+  bool good() const { return out_.good(); }
+  const std::string& path() const { return out_.path(); }
+
+  bool started() const { return started_; }
+
+  /**
+   * Write the header (the names and lengths of the transcripts).  Must be
+   * called, once, before the first push().
+   */
+  template <typename TranscriptT>
+  void start(const std::vector<TranscriptT>& transcripts) {
+    std::vector<char> buf;
+    buf.insert(buf.end(), magic, magic + sizeof(magic) - 1);
+    put_(buf, version);
+    put_(buf, static_cast<uint32_t>(transcripts.size()));
+    for (auto& t : transcripts) {
+      putString_(buf, t.RefName);
+      put_(buf, static_cast<uint32_t>(t.RefLength));
+    }
+    out_.writeNow(buf);
+    started_ = true;
+  }
+
+  /**
+   * Append the fragment named name, and its (non-empty) hits, to buf.
+   */
+  template <typename AlnT>
+  static void addFragment(std::vector<char>& buf, const std::string& name,
+                          const std::vector<AlnT>& hits) {
+    putString_(buf, name);
+    put_(buf, static_cast<uint32_t>(hits.size()));
+    for (auto& h : hits) {
+      put_(buf, static_cast<uint32_t>(h.tid));
+      put_(buf, static_cast<int32_t>(h.pos));
+      put_(buf, static_cast<int32_t>(h.matePos));
+      put_(buf, static_cast<int32_t>(h.fragLen));
+      put_(buf, static_cast<uint32_t>(h.readLen));
+      put_(buf, static_cast<uint32_t>(h.mateLen));
+      uint8_t flags = (h.fwd ? FWD : 0) | (h.mateIsFwd ? MATE_FWD : 0);
+      put_(buf, flags);
+      put_(buf, static_cast<uint8_t>(h.mateStatus));
+      put_(buf, static_cast<float>(h.score()));
+    }
+  }
+
+  /**
+   * Queue the content of buf (which should hold whole fragments) to be
+   * written; buf is left empty (holding a recycled buffer) and can be
+   * reused right away.  Blocks while too many buffers are already queued.
+   */
+  void push(std::vector<char>& buf) { out_.push(buf); }
+
+  // Write out everything that has been pushed and close the file.  Returns
+  // true if everything was written successfully.
+  bool close() { return out_.close(); }
+
+  uint64_t numBytes() const { return out_.numBytes(); }
+  uint64_t numCompressedBytes() const { return out_.numWrittenBytes(); }
+
+private:
+  template <typename T> static inline void put_(std::vector<char>& buf, T v) {
+    size_t n = buf.size();
+    buf.resize(n + sizeof(T));
+    std::memcpy(&buf[n], &v, sizeof(T));
+  }
+
+  static inline void putString_(std::vector<char>& buf, const std::string& s) {
+    put_(buf, static_cast<uint32_t>(s.size()));
+    buf.insert(buf.end(), s.begin(), s.end());
+  }
+
+  AsyncBufferWriter out_;
+  bool started_{false};
+};
+
+#endif // __BINARY_MAPPING_WRITER_HPP__
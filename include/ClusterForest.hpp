@@ -1,161 +1,232 @@
 #ifndef __CLUSTER_FOREST_HPP__
 #define __CLUSTER_FOREST_HPP__
 
-#include <boost/pending/disjoint_sets.hpp>
-
-#include "SalmonSpinLock.hpp"
+#include "SalmonMath.hpp"
+#include "SalmonUtils.hpp"
 #include "Transcript.hpp"
 #include "TranscriptCluster.hpp"
+#include "tbb/atomic.h"
 
-#include <mutex>
-#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <tuple>
+#include <utility>
 #include <vector>
 
-/** A forest of transcript clusters */
+/**
+ * A forest of transcript clusters.
+ *
+ * The clusters are kept in a concurrent, lock-free union-find: each
+ * transcript has an atomic parent link, a merge links one root under the
+ * other with a compare-and-swap (retrying if either has been linked in the
+ * meantime), and finds halve the paths they walk (again with a
+ * compare-and-swap, which may harmlessly fail).  The root of a set is always
+ * its smallest transcript id, so links can never form a cycle.
+ *
+ * The counts and masses are kept per transcript, and summed over the
+ * members of each cluster by getClusters(); so an update never has to find
+ * the (current) root of its cluster.  The mapping threads should go through
+ * a LocalClusterUpdates, which hands a whole mini-batch of updates to the
+ * forest at once.
+ */
 class ClusterForest {
 public:
   ClusterForest(size_t numTranscripts, std::vector<Transcript>& refs)
-      : rank_(std::vector<size_t>(numTranscripts, 0)),
-        parent_(std::vector<size_t>(numTranscripts, 0)),
-        disjointSets_(&rank_[0], &parent_[0]),
-        clusters_(std::vector<TranscriptCluster>(numTranscripts)) {
+      : parent_(numTranscripts), counts_(numTranscripts),
+        logMasses_(numTranscripts) {
     // Initially make a unique set for each transcript
     for (size_t tnum = 0; tnum < numTranscripts; ++tnum) {
-      disjointSets_.make_set(tnum);
-      clusters_[tnum].members_.push_front(tnum);
-      clusters_[tnum].addMass(refs[tnum].mass());
+      parent_[tnum].store(static_cast<uint32_t>(tnum),
+                          std::memory_order_relaxed);
+      counts_[tnum] = 0.0;
+      logMasses_[tnum] = refs[tnum].mass();
     }
   }
 
+  /**
+   * Merge the clusters of all of the transcripts in [start, finish).
+   */
   template <typename FragT>
   void mergeClusters(typename std::vector<FragT>::iterator start,
                      typename std::vector<FragT>::iterator finish) {
-// Use a lock_guard to ensure this is a locked (and exception-safe) operation
-#if defined __APPLE__
-    spin_lock::scoped_lock sl(clusterMutex_);
-#else
-    std::lock_guard<std::mutex> lock(clusterMutex_);
-#endif
-    size_t firstCluster, otherCluster;
     auto firstTranscriptID = start->transcriptID();
     ++start;
-
     for (auto it = start; it != finish; ++it) {
-      firstCluster = disjointSets_.find_set(firstTranscriptID);
-      otherCluster = disjointSets_.find_set(it->transcriptID());
-      if (otherCluster != firstCluster) {
-        disjointSets_.link(firstCluster, otherCluster);
-        auto parentClust = disjointSets_.find_set(it->transcriptID());
-        auto childClust =
-            (parentClust == firstCluster) ? otherCluster : firstCluster;
-        if (parentClust == firstCluster or parentClust == otherCluster) {
-          clusters_[parentClust].merge(clusters_[childClust]);
-          clusters_[childClust].deactivate();
-        } else {
-          std::cerr << "DANGER\n";
-        }
-      }
+      merge(firstTranscriptID, it->transcriptID());
     }
   }
 
   template <typename FragT>
   void mergeClusters(typename std::vector<FragT*>::iterator start,
                      typename std::vector<FragT*>::iterator finish) {
-// Use a lock_guard to ensure this is a locked (and exception-safe) operation
-#if defined __APPLE__
-    spin_lock::scoped_lock sl(clusterMutex_);
-#else
-    std::lock_guard<std::mutex> lock(clusterMutex_);
-#endif
-
     auto firstTranscriptID = (*start)->transcriptID();
-    decltype(firstTranscriptID) firstCluster, otherCluster;
     ++start;
-
     for (auto it = start; it != finish; ++it) {
-      firstCluster = disjointSets_.find_set(firstTranscriptID);
-      otherCluster = disjointSets_.find_set((*it)->transcriptID());
-      if (otherCluster != firstCluster) {
-        disjointSets_.link(firstCluster, otherCluster);
-        auto parentClust = disjointSets_.find_set((*it)->transcriptID());
-        auto childClust =
-            (parentClust == firstCluster) ? otherCluster : firstCluster;
-        if (parentClust == firstCluster or parentClust == otherCluster) {
-          clusters_[parentClust].merge(clusters_[childClust]);
-          clusters_[childClust].deactivate();
-        } else {
-          std::cerr << "DANGER\n";
-        }
+      merge(firstTranscriptID, (*it)->transcriptID());
+    }
+  }
+
+  // Merge the clusters of transcripts a and b.
+  void merge(uint32_t a, uint32_t b) {
+    while (true) {
+      a = find(a);
+      b = find(b);
+      if (a == b) {
+        return;
+      }
+      // link the larger root under the smaller one; if it is no longer a
+      // root, someone else got there first, so start over
+      if (a < b) {
+        std::swap(a, b);
+      }
+      uint32_t expected = a;
+      if (parent_[a].compare_exchange_strong(expected, b,
+                                             std::memory_order_acq_rel)) {
+        return;
       }
     }
   }
 
-  /*
-  void mergeClusters(AlignmentBatch<ReadPair>::iterator start,
-  AlignmentBatch<ReadPair>::iterator finish) {
-      // Use a lock_guard to ensure this is a locked (and exception-safe)
-  operation std::lock_guard<std::mutex> lock(clusterMutex_); size_t
-  firstCluster, otherCluster; auto firstTranscriptID = start->read1->core.tid;
-      ++start;
-
-      for (auto it = start; it != finish; ++it) {
-          firstCluster = disjointSets_.find_set(firstTranscriptID);
-          otherCluster = disjointSets_.find_set(it->read1->core.tid);
-          if (otherCluster != firstCluster)  {
-              disjointSets_.link(firstCluster, otherCluster);
-              auto parentClust = disjointSets_.find_set(it->read1->core.tid);
-              auto childClust = (parentClust == firstCluster)  ? otherCluster :
-  firstCluster; if (parentClust == firstCluster or parentClust == otherCluster)
-  { clusters_[parentClust].merge(clusters_[childClust]);
-                  clusters_[childClust].deactivate();
-              } else { std::cerr << "DANGER\n"; }
-          }
+  // The current root of the cluster of transcript t.
+  uint32_t find(uint32_t t) {
+    uint32_t p = parent_[t].load(std::memory_order_acquire);
+    while (p != t) {
+      uint32_t gp = parent_[p].load(std::memory_order_acquire);
+      if (gp != p) {
+        // path halving
+        parent_[t].compare_exchange_weak(p, gp, std::memory_order_acq_rel);
       }
+      t = gp;
+      p = parent_[t].load(std::memory_order_acquire);
+    }
+    return t;
   }
-*/
+
   void updateCluster(size_t memberTranscript, size_t newCount,
                      double logNewMass, bool updateCount) {
-// Use a lock_guard to ensure this is a locked (and exception-safe) operation
-#if defined __APPLE__
-    spin_lock::scoped_lock sl(clusterMutex_);
-#else
-    std::lock_guard<std::mutex> lock(clusterMutex_);
-#endif
-    auto clusterID = disjointSets_.find_set(memberTranscript);
-    auto& cluster = clusters_[clusterID];
     if (updateCount) {
-      cluster.incrementCount(newCount);
+      salmon::utils::incLoop(counts_[memberTranscript],
+                             static_cast<double>(newCount));
     }
-    cluster.addMass(logNewMass);
+    salmon::utils::incLoopLog(logMasses_[memberTranscript], logNewMass);
   }
 
+  /**
+   * Gather up the clusters.  This must not be called concurrently with
+   * merges or updates; the returned pointers are valid until the next call.
+   */
   std::vector<TranscriptCluster*> getClusters() {
+    size_t numTranscripts = parent_.size();
+    clusters_ = std::vector<TranscriptCluster>(numTranscripts);
     std::vector<TranscriptCluster*> clusters;
-    std::unordered_set<size_t> observedReps;
-    for (size_t i = 0; i < clusters_.size(); ++i) {
-      auto rep = disjointSets_.find_set(i);
-      if (observedReps.find(rep) == observedReps.end()) {
-        if (!clusters_[rep].isActive()) {
-          std::cerr << "returning a non-active cluster!\n";
-          std::exit(1);
-        }
-        clusters.push_back(&clusters_[rep]);
-        observedReps.insert(rep);
+    for (size_t i = 0; i < numTranscripts; ++i) {
+      auto rep = find(static_cast<uint32_t>(i));
+      auto& cluster = clusters_[rep];
+      // (a root is its cluster's smallest member, so it comes first)
+      if (rep == i) {
+        clusters.push_back(&cluster);
       }
+      cluster.members_.push_front(i);
+      cluster.count_ += counts_[i];
+      cluster.addMass(logMasses_[i]);
     }
     return clusters;
   }
 
 private:
-  std::vector<size_t> rank_;
-  std::vector<size_t> parent_;
-  boost::disjoint_sets<size_t*, size_t*> disjointSets_;
+  std::vector<std::atomic<uint32_t>> parent_;
+  std::vector<tbb::atomic<double>> counts_;
+  std::vector<tbb::atomic<double>> logMasses_;
   std::vector<TranscriptCluster> clusters_;
-#if defined __APPLE__
-  spin_lock clusterMutex_;
-#else
-  std::mutex clusterMutex_;
-#endif
+};
+
+/**
+ * Collects the cluster merges and updates that a single thread makes over
+ * a mini-batch, and hands them to the ClusterForest when flush()ed (or
+ * destroyed).  The updates are summed per transcript first, so that each
+ * transcript's count and mass are updated once per mini-batch, and
+ * repeated merges (of the same pair of transcripts) are applied only once.
+ */
+class LocalClusterUpdates {
+public:
+  explicit LocalClusterUpdates(ClusterForest& forest) : forest_(forest) {}
+  ~LocalClusterUpdates() { flush(); }
+
+  LocalClusterUpdates(const LocalClusterUpdates&) = delete;
+  LocalClusterUpdates& operator=(const LocalClusterUpdates&) = delete;
+
+  template <typename FragT>
+  void mergeClusters(typename std::vector<FragT>::iterator start,
+                     typename std::vector<FragT>::iterator finish) {
+    auto firstTranscriptID = start->transcriptID();
+    ++start;
+    for (auto it = start; it != finish; ++it) {
+      addMerge_(firstTranscriptID, it->transcriptID());
+    }
+  }
+
+  template <typename FragT>
+  void mergeClusters(typename std::vector<FragT*>::iterator start,
+                     typename std::vector<FragT*>::iterator finish) {
+    auto firstTranscriptID = (*start)->transcriptID();
+    ++start;
+    for (auto it = start; it != finish; ++it) {
+      addMerge_(firstTranscriptID, (*it)->transcriptID());
+    }
+  }
+
+  inline void updateCluster(size_t memberTranscript, size_t newCount,
+                            double logNewMass, bool updateCount) {
+    updates_.emplace_back(static_cast<uint32_t>(memberTranscript),
+                          updateCount ? newCount : 0, logNewMass);
+  }
+
+  // Apply the merges and updates collected so far to the forest.
+  void flush() {
+    if (!merges_.empty()) {
+      std::sort(merges_.begin(), merges_.end());
+      merges_.erase(std::unique(merges_.begin(), merges_.end()),
+                    merges_.end());
+      for (auto& m : merges_) {
+        forest_.merge(m.first, m.second);
+      }
+      merges_.clear();
+    }
+
+    if (!updates_.empty()) {
+      std::sort(updates_.begin(), updates_.end(),
+                [](const Update& a, const Update& b) -> bool {
+                  return std::get<0>(a) < std::get<0>(b);
+                });
+      auto it = updates_.begin();
+      while (it != updates_.end()) {
+        auto transcriptID = std::get<0>(*it);
+        size_t count = std::get<1>(*it);
+        double logMass = std::get<2>(*it);
+        for (++it; it != updates_.end() and std::get<0>(*it) == transcriptID;
+             ++it) {
+          count += std::get<1>(*it);
+          logMass = salmon::math::logAdd(logMass, std::get<2>(*it));
+        }
+        forest_.updateCluster(transcriptID, count, logMass, count > 0);
+      }
+      updates_.clear();
+    }
+  }
+
+private:
+  using Update = std::tuple<uint32_t, size_t, double>;
+
+  inline void addMerge_(uint32_t a, uint32_t b) {
+    if (a != b) {
+      merges_.emplace_back(std::min(a, b), std::max(a, b));
+    }
+  }
+
+  ClusterForest& forest_;
+  std::vector<std::pair<uint32_t, uint32_t>> merges_;
+  std::vector<Update> updates_;
 };
 
 #endif // __CLUSTER_FOREST_HPP__
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "tbb/atomic.h"
+#include "EquivalenceClassCSR.hpp"
 #include "Transcript.hpp"
 
 template <typename VecT>
@@ -12,6 +13,13 @@ void EMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
                std::vector<Transcript>& transcripts, const VecT& alphaIn,
                VecT& alphaOut);
 
+// As above, but over the (valid) classes of eqClasses, with the given counts.
+template <typename VecT>
+void EMUpdate_(const EquivalenceClassCSR& eqClasses,
+               const std::vector<uint64_t>& counts,
+               std::vector<Transcript>& transcripts, const VecT& alphaIn,
+               VecT& alphaOut);
+
 template <typename VecT>
 double truncateCountVector(VecT& alphas, double cutoff);
 
@@ -1,6 +1,7 @@
 #ifndef EQUIVALENCE_CLASS_BUILDER_HPP
 #define EQUIVALENCE_CLASS_BUILDER_HPP
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -10,6 +11,7 @@
 // Logger includes
 #include "spdlog/spdlog.h"
 
+#include "EquivalenceClassCSR.hpp"
 #include "SalmonUtils.hpp"
 #include "TranscriptGroup.hpp"
 #include "concurrentqueue.h"
@@ -165,24 +167,39 @@ public:
     return true;
   }
 
+  /**
+   * Lay the classes collected so far out flat (see eqClasses()) for the
+   * offline inference; the hash table they were collected in is emptied.
+   */
   bool finish() {
     active_ = false;
     size_t totalCount{0};
-    auto lt = countMap_.lock_table();
-    for (auto& kv : lt) {
-      kv.second.normalizeAux();
-      totalCount += kv.second.count;
-      countVec_.push_back(kv);
+    {
+      auto lt = countMap_.lock_table();
+      for (auto& kv : lt) {
+        kv.second.normalizeAux();
+        totalCount += kv.second.count;
+      }
+      eqClasses_.build(lt);
     }
+    // (and shrink the table, too)
+    countMap_.clear();
+    countMap_.reserve(0);
 
     logger_->info("Computed {} rich equivalence classes "
                   "for further processing",
-                  countVec_.size());
+                  eqClasses_.size());
     logger_->info("Counted {} total reads in the equivalence classes ",
                   totalCount);
     return true;
   }
 
+  // Forget all of the equivalence classes (and counts) seen so far.
+  void clear() {
+    countMap_.clear();
+    eqClasses_.clear();
+  }
+
   //////////////////////////////////////////////////////////////////
   //function for alevin barcode level count indexing
   inline void addBarcodeGroup(TranscriptGroup&& g,
@@ -227,25 +244,131 @@ public:
         x.weights[i] += weights[i];
       }
     };
-    TGValueType v(weights, 1);
-    countMap_.upsert(g, upfn, v);
+    // (the value is only constructed, in place, if g is new)
+    countMap_.upsert(g, upfn, weights, 1);
+  }
+
+  // Add count fragments with the class g, whose weights sum to weights.
+  inline void addGroup(const TranscriptGroup& g, std::vector<double>& weights,
+                       uint64_t count) {
+
+    auto upfn = [&weights, count](TGValueType& x) -> void {
+      x.count += count;
+      for (size_t i = 0; i < x.weights.size(); ++i) {
+        x.weights[i] += weights[i];
+      }
+    };
+    countMap_.upsert(g, upfn, weights, count);
   }
 
   cuckoohash_map<TranscriptGroup, TGValueType, TranscriptGroupHasher>& eqMap(){
     return countMap_;
   }
 
-  std::vector<std::pair<const TranscriptGroup, TGValueType>>& eqVec() {
-    return countVec_;
-  }
+  // The classes, as laid out by finish()
+  EquivalenceClassCSR& eqClasses() { return eqClasses_; }
 
 private:
   std::atomic<bool> active_;
   cuckoohash_map<TranscriptGroup, TGValueType, TranscriptGroupHasher> countMap_;
-  std::vector<std::pair<const TranscriptGroup, TGValueType>> countVec_;
+  EquivalenceClassCSR eqClasses_;
   std::shared_ptr<spdlog::logger> logger_;
 };
 
+/**
+ * Collects the equivalence classes of the fragments a (mapping) thread
+ * processes in a local table, and adds each distinct class to the shared
+ * EquivalenceClassBuilder once per flush(), with the summed count and
+ * weights of its fragments, rather than once per fragment.  This keeps the
+ * threads from contending for the buckets of the shared map (and from
+ * allocating a new class for every fragment).  A flush keeps the classes in
+ * the table, with their counts zeroed, so that a thread that keeps its
+ * builder sees the classes recur without allocating them again; the table
+ * is only emptied when a new class arrives while it holds maxClasses of
+ * them.  It is flushed on destruction, too.
+ */
+template <typename TGValueType = TGValue>
+class LocalEquivalenceClassBuilder {
+public:
+  LocalEquivalenceClassBuilder(EquivalenceClassBuilder<TGValueType>& builder,
+                               size_t maxClasses = 4096)
+      : builder_(builder), maxClasses_(maxClasses) {
+    counts_.reserve(maxClasses_);
+    probe_.setValid(true);
+  }
+
+  ~LocalEquivalenceClassBuilder() { flush(); }
+
+  inline void addGroup(TranscriptGroup&& g, std::vector<double>& weights) {
+    auto it = counts_.find(g);
+    if (it == counts_.end()) {
+      insert_(std::move(g), weights);
+    } else {
+      add_(it->second, weights);
+    }
+  }
+
+  /**
+   * Add a fragment of the class of the transcripts txps; unlike the above,
+   * this only allocates (copies txps) if the local table hasn't seen the
+   * class yet.
+   */
+  inline void addGroup(const std::vector<uint32_t>& txps,
+                       std::vector<double>& weights) {
+    probe_.txps.assign(txps.begin(), txps.end());
+    probe_.updateHash();
+    auto it = counts_.find(probe_);
+    if (it == counts_.end()) {
+      insert_(TranscriptGroup(probe_), weights);
+    } else {
+      add_(it->second, weights);
+    }
+  }
+
+  // Add the classes collected since the last flush to the shared builder.
+  void flush() {
+    for (auto& kv : counts_) {
+      auto& x = kv.second;
+      if (x.count > 0) {
+        builder_.addGroup(kv.first, x.weights, x.count);
+        x.count = 0;
+        std::fill(x.weights.begin(), x.weights.end(), 0.0);
+      }
+    }
+  }
+
+private:
+  struct LocalCount {
+    uint64_t count{0};
+    std::vector<double> weights;
+  };
+
+  inline void insert_(TranscriptGroup&& g, std::vector<double>& weights) {
+    if (counts_.size() >= maxClasses_) {
+      flush();
+      counts_.clear();
+    }
+    LocalCount c;
+    c.count = 1;
+    c.weights = weights;
+    counts_.emplace(std::move(g), std::move(c));
+  }
+
+  inline void add_(LocalCount& x, std::vector<double>& weights) {
+    x.count++;
+    for (size_t i = 0; i < x.weights.size(); ++i) {
+      x.weights[i] += weights[i];
+    }
+  }
+
+  EquivalenceClassBuilder<TGValueType>& builder_;
+  size_t maxClasses_;
+  std::unordered_map<TranscriptGroup, LocalCount, TranscriptGroupHasher>
+      counts_;
+  // the key used to look up classes given by their transcripts
+  TranscriptGroup probe_;
+};
+
 // explicit instantiations
 template class EquivalenceClassBuilder<TGValue>;
 template class EquivalenceClassBuilder<SCTGValue>;
@@ -0,0 +1,137 @@
+#ifndef EQUIVALENCE_CLASS_CSR_HPP
+#define EQUIVALENCE_CLASS_CSR_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+/**
+ * The equivalence classes, once they have all been collected, laid out flat
+ * (in compressed sparse row form) for the offline inference.  The entries
+ * (transcript, auxiliary weight and combined weight) of class i are
+ * [offset(i), offset(i + 1)) of contiguous arrays, and the counts and valid
+ * flags of the classes are arrays of their own; so a pass of the EM (or the
+ * Gibbs sampler) streams through memory rather than chasing three heap
+ * vectors per class.
+ *
+ * The classes are ordered by their size, and then by their transcripts, so
+ * that the (many) single-transcript classes come first, and the order (e.g.
+ * of the classes written out by --dumpEq) doesn't depend on that of the
+ * hash table they were collected in.
+ */
+class EquivalenceClassCSR {
+public:
+  /**
+   * (Re)build from the classes in classes, a range of
+   * (TranscriptGroup, TGValue) pairs whose auxiliary weights have already
+   * been normalized.  The combined weights are left at zero, for the
+   * inference to fill in.
+   */
+  template <typename RangeT> void build(RangeT& classes) {
+    using ValueT = typename std::remove_reference<decltype(
+        *std::begin(classes))>::type;
+    std::vector<ValueT*> order;
+    size_t numEntries{0};
+    for (auto& kv : classes) {
+      order.push_back(&kv);
+      numEntries += kv.first.txps.size();
+    }
+    std::sort(order.begin(), order.end(),
+              [](const ValueT* a, const ValueT* b) -> bool {
+                auto& ta = a->first.txps;
+                auto& tb = b->first.txps;
+                return (ta.size() != tb.size()) ? (ta.size() < tb.size())
+                                                : (ta < tb);
+              });
+
+    clear();
+    offsets_.reserve(order.size() + 1);
+    counts_.reserve(order.size());
+    txps_.reserve(numEntries);
+    weights_.reserve(numEntries);
+    offsets_.push_back(0);
+    for (auto kvp : order) {
+      auto& txps = kvp->first.txps;
+      auto& weights = kvp->second.weights;
+      txps_.insert(txps_.end(), txps.begin(), txps.end());
+      weights_.insert(weights_.end(), weights.begin(), weights.end());
+      offsets_.push_back(txps_.size());
+      counts_.push_back(kvp->second.count);
+    }
+    combinedWeights_.assign(txps_.size(), 0.0);
+    valid_.assign(counts_.size(), 1);
+  }
+
+  /**
+   * (Re)build from the classes [first, last) of other, a range of class
+   * indices kept in their order, with each transcript t renumbered to
+   * localIDs[t].  Everything (the weights, combined weights, counts and
+   * valid flags) is copied over.
+   */
+  template <typename IterT>
+  void buildSubset(const EquivalenceClassCSR& other, IterT first, IterT last,
+                   const std::vector<uint32_t>& localIDs) {
+    clear();
+    offsets_.push_back(0);
+    for (auto it = first; it != last; ++it) {
+      size_t eqID = *it;
+      size_t begin = other.offsets_[eqID];
+      size_t end = other.offsets_[eqID + 1];
+      for (size_t e = begin; e < end; ++e) {
+        txps_.push_back(localIDs[other.txps_[e]]);
+      }
+      weights_.insert(weights_.end(), other.weights_.begin() + begin,
+                      other.weights_.begin() + end);
+      combinedWeights_.insert(combinedWeights_.end(),
+                              other.combinedWeights_.begin() + begin,
+                              other.combinedWeights_.begin() + end);
+      offsets_.push_back(txps_.size());
+      counts_.push_back(other.counts_[eqID]);
+      valid_.push_back(other.valid_[eqID]);
+    }
+  }
+
+  void clear() {
+    offsets_.clear();
+    txps_.clear();
+    weights_.clear();
+    combinedWeights_.clear();
+    counts_.clear();
+    valid_.clear();
+  }
+
+  // The number of classes
+  size_t size() const { return counts_.size(); }
+  // The total number of entries (transcripts) over all of the classes
+  size_t numEntries() const { return txps_.size(); }
+
+  uint64_t offset(size_t i) const { return offsets_[i]; }
+  size_t classSize(size_t i) const { return offsets_[i + 1] - offsets_[i]; }
+  uint64_t count(size_t i) const { return counts_[i]; }
+  const std::vector<uint64_t>& counts() const { return counts_; }
+
+  const uint32_t* txps(size_t i) const { return &txps_[offsets_[i]]; }
+  const double* weights(size_t i) const { return &weights_[offsets_[i]]; }
+  double* weights(size_t i) { return &weights_[offsets_[i]]; }
+  const double* combinedWeights(size_t i) const {
+    return &combinedWeights_[offsets_[i]];
+  }
+  double* combinedWeights(size_t i) { return &combinedWeights_[offsets_[i]]; }
+
+  // Degenerate classes are marked invalid, and skipped by the inference.
+  bool valid(size_t i) const { return valid_[i] != 0; }
+  void setValid(size_t i, bool v) { valid_[i] = v ? 1 : 0; }
+
+private:
+  std::vector<uint64_t> offsets_;
+  std::vector<uint32_t> txps_;
+  std::vector<double> weights_;
+  std::vector<double> combinedWeights_;
+  std::vector<uint64_t> counts_;
+  // (not a vector<bool>, so that different classes can be set concurrently)
+  std::vector<uint8_t> valid_;
+};
+
+#endif // EQUIVALENCE_CLASS_CSR_HPP
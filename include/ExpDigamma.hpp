@@ -0,0 +1,26 @@
+#ifndef __EXP_DIGAMMA_HPP__
+#define __EXP_DIGAMMA_HPP__
+
+#include <cstddef>
+
+namespace salmon {
+namespace math {
+
+/**
+ * out[i] = exp(digamma(x[i]) - logNorm) for each of the n values of x above
+ * minArg, and 0 for the rest; i.e. the expected thetas of the VBEM.  out
+ * may be x.
+ *
+ * The values are computed several at a time in SIMD registers (with AVX2,
+ * on CPUs that support it), to within a relative error of about 1e-13 of
+ * std::exp(boost::math::digamma(x[i]) - logNorm); a little more when
+ * digamma(x[i]) - logNorm is large, as the error of exp() grows with its
+ * argument.
+ */
+void expDigamma(const double* x, size_t n, double logNorm, double minArg,
+                double* out);
+
+} // namespace math
+} // namespace salmon
+
+#endif // __EXP_DIGAMMA_HPP__
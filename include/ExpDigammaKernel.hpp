@@ -0,0 +1,146 @@
+#ifndef __EXP_DIGAMMA_KERNEL_HPP__
+#define __EXP_DIGAMMA_KERNEL_HPP__
+
+// Internal to ExpDigamma; the kernel is instantiated once per instruction
+// set, each in a translation unit compiled for that instruction set (see
+// src/CMakeLists.txt).  Everything here has internal linkage, so that the
+// linker can't pick the copy compiled for AVX2 (of ScalarOps, say, which
+// both instantiate) for the callers that run on any CPU.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace salmon {
+namespace math {
+namespace digamma_kernel {
+namespace {
+
+// One lane, for the CPUs without a vector kernel and for the tails of the
+// vector ones.
+struct ScalarOps {
+  using V = double;
+  using M = bool;
+  static constexpr const size_t LANES = 1;
+
+  static inline V set1(double x) { return x; }
+  static inline V load(const double* p) { return *p; }
+  static inline void store(double* p, V x) { *p = x; }
+  static inline V add(V a, V b) { return a + b; }
+  static inline V sub(V a, V b) { return a - b; }
+  static inline V mul(V a, V b) { return a * b; }
+  static inline V div(V a, V b) { return a / b; }
+  static inline V min(V a, V b) { return (b < a) ? b : a; }
+  static inline V max(V a, V b) { return (a < b) ? b : a; }
+  static inline M lt(V a, V b) { return a < b; }
+  static inline M gt(V a, V b) { return a > b; }
+  // mask ? a : b
+  static inline V select(M mask, V a, V b) { return mask ? a : b; }
+  // 2^n, where the low bits of kd hold the integer n in [-1022, 1023] (see
+  // exp() below)
+  static inline V pow2(V kd) {
+    uint64_t bits;
+    std::memcpy(&bits, &kd, sizeof(bits));
+    bits = (bits + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+  }
+};
+
+/**
+ * exp(x), as salmon::math::approx::exp() computes it, but with arguments
+ * above 709 clamped rather than overflowing to infinity.
+ */
+template <typename Ops> inline typename Ops::V exp(typename Ops::V x) {
+  using V = typename Ops::V;
+  // exp(x) = 2^n * exp(r), with n = round(x / log(2)) and |r| <= log(2) / 2
+  const V log2e = Ops::set1(1.4426950408889634074);
+  const V ln2hi = Ops::set1(6.93147180369123816490e-01);
+  const V ln2lo = Ops::set1(1.90821492927058770002e-10);
+  // (adding this rounds to an integer, which ends up in the low bits)
+  const V shifter = Ops::set1(6755399441055744.0); // 1.5 * 2^52
+  const V lo = Ops::set1(-708.0);
+  V xc = Ops::min(Ops::max(x, lo), Ops::set1(709.0));
+  V kd = Ops::add(Ops::mul(xc, log2e), shifter);
+  V n = Ops::sub(kd, shifter);
+  V r = Ops::sub(Ops::sub(xc, Ops::mul(n, ln2hi)), Ops::mul(n, ln2lo));
+  // Taylor series to degree 11; the error is < r^12 / 12! < 1e-14
+  V p = Ops::set1(1.0 / 39916800.0);
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 3628800.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 362880.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 40320.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 5040.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 720.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 120.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 24.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 6.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(0.5));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0));
+  p = Ops::add(Ops::mul(p, r), Ops::set1(1.0));
+  return Ops::select(Ops::lt(x, lo), Ops::set1(0.0),
+                     Ops::mul(p, Ops::pow2(kd)));
+}
+
+/**
+ * exp(digamma(x) + negLogNorm), for x > 0.
+ */
+template <typename Ops>
+inline typename Ops::V expDigamma(typename Ops::V x,
+                                  typename Ops::V negLogNorm) {
+  using V = typename Ops::V;
+  using M = typename Ops::M;
+  const V zero = Ops::set1(0.0);
+  const V one = Ops::set1(1.0);
+  const V eight = Ops::set1(8.0);
+  // Shift x up into [8, 9), with digamma(x) = digamma(x + 1) - 1 / x, and
+  // use the asymptotic series there,
+  //   digamma(y) = log(y) - 1 / (2y) - sum_k B_2k / (2k y^2k),
+  // which is good to < 1 / (12 y^14) < 2e-14 after 6 terms.  As
+  // exp(log(y) + r) = y exp(r), no log is needed.
+  V y = x;
+  V r = negLogNorm;
+  for (int i = 0; i < 8; ++i) {
+    M shift = Ops::lt(y, eight);
+    r = Ops::sub(r, Ops::select(shift, Ops::div(one, y), zero));
+    y = Ops::add(y, Ops::select(shift, one, zero));
+  }
+  V z = Ops::div(one, y);
+  V z2 = Ops::mul(z, z);
+  V p = Ops::set1(-691.0 / 32760.0);
+  p = Ops::add(Ops::mul(p, z2), Ops::set1(1.0 / 132.0));
+  p = Ops::add(Ops::mul(p, z2), Ops::set1(-1.0 / 240.0));
+  p = Ops::add(Ops::mul(p, z2), Ops::set1(1.0 / 252.0));
+  p = Ops::add(Ops::mul(p, z2), Ops::set1(-1.0 / 120.0));
+  p = Ops::add(Ops::mul(p, z2), Ops::set1(1.0 / 12.0));
+  r = Ops::sub(r, Ops::add(Ops::mul(Ops::set1(0.5), z), Ops::mul(p, z2)));
+  return Ops::mul(y, exp<Ops>(r));
+}
+
+// salmon::math::expDigamma(), Ops::LANES values at a time
+template <typename Ops>
+void expDigammaBatch(const double* x, size_t n, double logNorm,
+                     double minArg, double* out) {
+  size_t i = 0;
+  {
+    const typename Ops::V negLogNorm = Ops::set1(-logNorm);
+    const typename Ops::V minV = Ops::set1(minArg);
+    const typename Ops::V zero = Ops::set1(0.0);
+    for (; i + Ops::LANES <= n; i += Ops::LANES) {
+      auto xv = Ops::load(x + i);
+      auto e = expDigamma<Ops>(xv, negLogNorm);
+      Ops::store(out + i, Ops::select(Ops::gt(xv, minV), e, zero));
+    }
+  }
+  for (; i < n; ++i) {
+    double e = expDigamma<ScalarOps>(x[i], -logNorm);
+    out[i] = (x[i] > minArg) ? e : 0.0;
+  }
+}
+
+} // namespace
+} // namespace digamma_kernel
+} // namespace math
+} // namespace salmon
+
+#endif // __EXP_DIGAMMA_KERNEL_HPP__
@@ -7,13 +7,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <thread>
 #include <vector>
 
-extern "C" {
-#include "kseq.h"
-}
-
+#include "ParallelGzipReader.hpp"
 #include "concurrentqueue.h"
 
 #ifndef __FASTX_PARSER_PRECXX14_MAKE_UNIQUE__
@@ -82,6 +80,44 @@ struct ReadQualPair {
   ReadQual second;
 };
 
+/**
+ * Decides which fragments are passed on when only part of the input is
+ * wanted.  Either a fraction of the fragments, chosen by a seeded hash of
+ * their names (so that both mates, and every run with the same seed, make
+ * the same choice), or the first n fragments of the input are kept.  The
+ * latter is not a random sample (the start of a file can differ from the
+ * rest, e.g. by flow cell tile); the input can't be counted up front, as it
+ * may be a pipe, so a count can't be turned into a fraction.
+ */
+class ReadSubsampler {
+public:
+  // keep fraction (in (0, 1)) of the fragments
+  void setFraction(double fraction, uint64_t seed) {
+    fraction_ = fraction;
+    seed_ = seed;
+    maxCount_ = 0;
+  }
+  // keep the first n fragments
+  void setCount(uint64_t n) {
+    fraction_ = 1.0;
+    maxCount_ = n;
+  }
+  bool active() const { return fraction_ < 1.0 or maxCount_ > 0; }
+  bool byCount() const { return maxCount_ > 0; }
+  // Should the fragment (one of whose reads is) named name be kept?
+  bool keep(const std::string& name);
+  // true once a count has been reached, so that nothing more will be kept
+  bool exhausted() const {
+    return maxCount_ > 0 and numKept_.load() >= maxCount_;
+  }
+
+private:
+  double fraction_{1.0};
+  uint64_t seed_{0};
+  uint64_t maxCount_{0};
+  std::atomic<uint64_t> numKept_{0};
+};
+
 template <typename T> class ReadChunk {
 public:
   ReadChunk(size_t want) : group_(want), want_(want), have_(want) {}
@@ -127,6 +163,9 @@ private:
 
 template <typename T> class FastxParser {
 public:
+  // For the paired-end read types (ReadPair, ReadQualPair), each of the files
+  // holds the mates of its fragments one after the other; either interleaved
+  // FASTA/Q or (if the file name ends in .bam) unaligned BAM.
   FastxParser(std::vector<std::string> files, uint32_t numConsumers,
               uint32_t numParsers = 1, uint32_t chunkSize = 1000);
 
@@ -139,23 +178,67 @@ public:
   ReadGroup<T> getReadGroup();
   bool refill(ReadGroup<T>& rg);
   void finishedWithGroup(ReadGroup<T>& s);
+  // The number of threads used to inflate each gzipped input file (see
+  // ParallelGzipReader); must be set before start() is called.
+  void setNumDecompressionThreads(uint32_t n) { numInflaters_ = n; }
+  // The number of (2MB) buffers that are read ahead of the decompressor
+  // for each input file (0 reads the file on the decompressing thread);
+  // must be set before start() is called.
+  void setReadAheadDepth(uint32_t n) { readAheadDepth_ = n; }
+  // A chunk is handed to the consumers once it holds chunkSize reads, or
+  // once its reads add up to this many bases (whichever comes first), so
+  // that long-read libraries don't produce huge units of work.
+  void setChunkByteBudget(size_t numBases) { chunkBases_ = numBases; }
+  // Allow up to n parsing threads.  Parsing threads beyond the initial
+  // numParsers are started only if the consumers are found to be waiting on
+  // the parser, and only while some file (file pair) has yet to be picked
+  // up: a file is always read from start to end by a single parsing thread,
+  // so a single file or file pair never gets more than one, whatever n is.
+  // Must be called before start().
+  void setMaxParsers(uint32_t n);
+  // Only pass on a deterministic subset of the fragments (see
+  // ReadSubsampler): a value in (0, 1) is the fraction of the fragments to
+  // keep and a value >= 1 the number of fragments to keep, while 0 keeps
+  // all of them.  When a count is requested, the input is read by a single
+  // parsing thread so that the same fragments are chosen on every run.
+  // Must be called before start().
+  void setSubsample(double value, uint64_t seed);
+
+  // By default, chunks are capped at this many bases
+  static constexpr const size_t DEFAULT_CHUNK_BASES = 1 << 22;
 
 private:
   moodycamel::ProducerToken getProducerToken_();
   moodycamel::ConsumerToken getConsumerToken_();
+  void startParser_(uint32_t i);
+  void noteDelivery_(bool waited);
 
   std::vector<std::string> inputStreams_;
   std::vector<std::string> inputStreams2_;
   uint32_t numParsers_;
+  uint32_t maxParsers_;
+  uint32_t numConsumers_;
+  uint32_t numInflaters_{1};
+  uint32_t readAheadDepth_{ParallelGzipReader::DEFAULT_READ_AHEAD};
+  size_t chunkBases_{DEFAULT_CHUNK_BASES};
+  ReadSubsampler subsampler_;
   std::atomic<uint32_t> numParsing_;
 
+  // used to decide when another parsing thread should be started; once the
+  // parser is running, parserStartMutex_ guards parsingThreads_ and isActive_
+  std::mutex parserStartMutex_;
+  std::atomic<uint32_t> numStarted_{0};
+  std::atomic<uint64_t> numDelivered_{0};
+  std::atomic<uint64_t> numStarved_{0};
+
   // NOTE: Would like to use std::future<int> here instead, but that
   // solution doesn't seem to work.  It's unclear exactly why
   // see (https://twitter.com/nomad421/status/917748383321817088)
   std::vector<std::unique_ptr<std::thread>> parsingThreads_;
 
   // holds the results of the parsing threads, which is simply equal to
-  // the return value of kseq_read() for the last call to that function.
+  // the return value of FastxRecordReader::read() for the last call to that
+  // function.
   // A value < -1 signifies some sort of error.
   std::vector<int> threadResults_;
 
@@ -0,0 +1,187 @@
+#ifndef __FASTX_RECORD_READER__
+#define __FASTX_RECORD_READER__
+
+#include <cctype>
+#include <cstring>
+#include <string>
+
+#include "ParallelGzipReader.hpp"
+
+namespace fastx_parser {
+
+/**
+ * Parses FASTA / FASTQ records straight out of the decompressed buffers of a
+ * ParallelGzipReader into the caller's strings.  The strings passed in are
+ * those of the (recycled) read chunks, so once a chunk has been through the
+ * parser a few times, reading a record performs no allocation and copies
+ * each byte of it exactly once.
+ *
+ * The parsing rules (and return values) are those of kseq_read(), which this
+ * replaces:
+ *   >=0  length of the sequence (normal)
+ *   -1   end-of-file
+ *   -2   truncated quality string
+ *   -3   error reading stream
+ */
+class FastxRecordReader {
+public:
+  explicit FastxRecordReader(ParallelGzipReader& in) : in_(in) {}
+
+  // If qual is null, the quality string is checked but not stored.
+  int read(std::string& name, std::string& seq, std::string* qual) {
+    int c{0};
+    if (lastChar_ == 0) {
+      // jump to the next header line
+      while ((c = getc_()) >= 0 and c != '>' and c != '@') {
+      }
+      if (c < 0) {
+        return c;
+      }
+      lastChar_ = c;
+    } // else: the first header char was read by the previous call
+
+    int delim{0};
+    int r = getName_(name, delim);
+    if (r < 0) {
+      return r;
+    }
+    if (delim != '\n') {
+      // skip the FASTA/Q comment
+      appendLine_(nullptr);
+    }
+
+    seq.clear();
+    while ((c = getc_()) >= 0 and c != '>' and c != '+' and c != '@') {
+      if (c == '\n') {
+        continue; // skip empty lines
+      }
+      seq.push_back(static_cast<char>(c));
+      appendLine_(&seq);
+    }
+    if (c == -3) {
+      return -3;
+    }
+    if (c == '>' or c == '@') {
+      lastChar_ = c; // the first header char has been read
+    }
+    if (c != '+') {
+      return static_cast<int>(seq.size()); // FASTA
+    }
+
+    // skip the rest of the '+' line
+    r = appendLine_(nullptr);
+    if (r == -3) {
+      return -3;
+    }
+    if (r == -1 or status_ == -1) {
+      return -2; // no quality string
+    }
+
+    std::string& q = (qual == nullptr) ? qualScratch_ : *qual;
+    q.clear();
+    do {
+      r = appendLine_(&q);
+    } while (r >= 0 and q.size() < seq.size());
+    if (r == -3) {
+      return -3;
+    }
+    lastChar_ = 0; // we have not come to the next header line
+    if (q.size() != seq.size()) {
+      return -2; // quality string is of a different length
+    }
+    return static_cast<int>(seq.size());
+  }
+
+private:
+  bool fill_() {
+    if (status_ != 0) {
+      return false;
+    }
+    const unsigned char* buf{nullptr};
+    int n = in_.next(buf);
+    if (n <= 0) {
+      status_ = (n == 0) ? -1 : -3;
+      return false;
+    }
+    p_ = buf;
+    end_ = buf + n;
+    return true;
+  }
+
+  inline int getc_() {
+    if (p_ == end_ and !fill_()) {
+      return status_;
+    }
+    return *p_++;
+  }
+
+  // Read up to the next whitespace character (which is consumed and
+  // returned in delim).
+  int getName_(std::string& name, int& delim) {
+    name.clear();
+    bool gotAny{false};
+    delim = 0;
+    while (p_ != end_ or fill_()) {
+      gotAny = true;
+      const unsigned char* q = p_;
+      while (q != end_ and !std::isspace(*q)) {
+        ++q;
+      }
+      name.append(reinterpret_cast<const char*>(p_), q - p_);
+      if (q != end_) {
+        delim = *q;
+        p_ = q + 1;
+        return static_cast<int>(name.size());
+      }
+      p_ = end_;
+    }
+    if (status_ == -3) {
+      return -3;
+    }
+    return gotAny ? static_cast<int>(name.size()) : -1;
+  }
+
+  // Append the rest of the current line (without the newline, or a trailing
+  // '\r') to dest, or just skip over it if dest is null.  Returns the number
+  // of bytes appended, or -1 (-3) if there was nothing left to read (an error).
+  int appendLine_(std::string* dest) {
+    bool gotAny{false};
+    size_t len{0};
+    while (p_ != end_ or fill_()) {
+      gotAny = true;
+      const unsigned char* nl = static_cast<const unsigned char*>(
+          std::memchr(p_, '\n', end_ - p_));
+      const unsigned char* stop = (nl == nullptr) ? end_ : nl;
+      if (dest != nullptr) {
+        dest->append(reinterpret_cast<const char*>(p_), stop - p_);
+      }
+      len += stop - p_;
+      p_ = stop;
+      if (nl != nullptr) {
+        ++p_;
+        break;
+      }
+    }
+    if (status_ == -3) {
+      return -3;
+    }
+    if (!gotAny) {
+      return -1;
+    }
+    if (dest != nullptr and len > 0 and dest->back() == '\r') {
+      dest->pop_back();
+      --len;
+    }
+    return static_cast<int>(len);
+  }
+
+  ParallelGzipReader& in_;
+  const unsigned char* p_{nullptr};
+  const unsigned char* end_{nullptr};
+  // 0 while there is input left, -1 at the end of the stream, -3 on error
+  int status_{0};
+  int lastChar_{0};
+  std::string qualScratch_;
+};
+}
+#endif // __FASTX_RECORD_READER__
@@ -12,11 +12,12 @@
 
 #include "tbb/atomic.h"
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
-#include "SpinLock.hpp" // RapMap's with try_lock
+#include "SalmonMath.hpp"
 
 /**
  * The LengthDistribution class keeps track of the observed length distribution.
@@ -25,7 +26,52 @@
  * added for each observation. All mass values and probabilities are stored and
  * returned in log space (except in to_string).
  */
+class LocalFragmentLengthDistribution;
+
 class FragmentLengthDistribution {
+public:
+  /**
+   * An immutable copy of the (normalized, logged) pmf and cmf of the
+   * distribution, taken by cacheCMF().  A table is never modified or freed
+   * (before the distribution is) once it has been published, so the mapping
+   * threads can read it without taking any lock.
+   */
+  class Table {
+  public:
+    // 1 for the first table of a distribution, 2 for the next, ...
+    uint64_t version() const { return version_; }
+
+    double pmf(size_t len) const {
+      return (len < pmf_.size()) ? pmf_[len] : pmf_.back();
+    }
+    double cmf(size_t len) const {
+      return (len < cmf_.size()) ? cmf_[len] : cmf_.back();
+    }
+
+    /**
+     * The (logged) probability of a fragment of length len given that it
+     * comes from a transcript of length refLen; LOG_EPSILON if the fragment
+     * doesn't fit in the transcript, or the transcript is too short to
+     * produce any fragment.
+     */
+    double conditionalPMF(size_t len, size_t refLen) const {
+      double refLengthCM = cmf(refLen);
+      if (len < refLen and !salmon::math::isLog0(refLengthCM)) {
+        return pmf(len) - refLengthCM;
+      }
+      return salmon::math::LOG_EPSILON;
+    }
+
+  private:
+    friend class FragmentLengthDistribution;
+    uint64_t version_{0};
+    // the number of observations the table was built from
+    uint64_t numUpdates_{0};
+    std::vector<double> pmf_;
+    std::vector<double> cmf_;
+  };
+
+private:
   /**
    * A private vector that stores the (logged) kernel values.
    **/
@@ -36,13 +82,19 @@ class FragmentLengthDistribution {
   std::vector<tbb::atomic<double>> hist_;
 
   /**
-   * A private vector that stores the observed (logged) mass for each length.
+   * The current table (nullptr until cacheCMF() is first called), and every
+   * table built so far.
    */
-  std::vector<double> cachedCMF_;
-  std::vector<double> cachedPMF_;
-  volatile bool haveCachedCMF_;
-  // std::mutex fldMut_;
-  SpinLock sl_;
+  std::atomic<const Table*> table_{nullptr};
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::mutex tableMut_;
+  // The number of observations added so far
+  std::atomic<uint64_t> numUpdates_{0};
+  /**
+   * Serializes the updates of hist_, sum_ and totMass_ (and the snapshots
+   * taken by cacheCMF()); readers of the histogram don't take it.
+   */
+  std::mutex histMut_;
 
   /**
    * A private double that stores the total observed (logged) mass.
@@ -103,6 +155,11 @@ public:
    * @param mass a double for the mass (logged) to add.
    */
   void addVal(size_t len, double mass);
+  /**
+   * Add the observations collected by a LocalFragmentLengthDistribution to
+   * the distribution, at once.
+   */
+  void merge(const LocalFragmentLengthDistribution& local);
   /**
    * An accessor for the (logged) probability of a given length.
    * @param len an integer for the length to return the probability of.
@@ -118,13 +175,37 @@ public:
   double cmf(size_t len) const;
 
   /**
-   * A member function that caches the cumulative mass function into
-   * a vector.  This should be called (once), when the fld will no
-   * longer be updated.  It will make future calls to cmf(len)
-   * much faster.
+   * A member function that caches the probability and cumulative mass
+   * functions in a Table.  This should be called when the fld will no
+   * longer be (much) updated; it will make future calls to pmf(len) and
+   * cmf(len) much faster, and they will answer from the table from then on.
+   * If the distribution has been updated since the current table was built,
+   * a new table replaces it.  Other threads may read the current table while
+   * this builds the next one; once this returns, table() is not nullptr.
    */
   void cacheCMF();
 
+  /**
+   * The current table, or nullptr if cacheCMF() hasn't been called yet.
+   */
+  const Table* table() const { return table_.load(std::memory_order_acquire); }
+
+  /**
+   * The (logged) probability of a fragment of length len given that it
+   * comes from a transcript of length refLen (see Table::conditionalPMF);
+   * this is cheap once cacheCMF() has been called.
+   */
+  double conditionalPMF(size_t len, size_t refLen) const {
+    if (const Table* t = table()) {
+      return t->conditionalPMF(len, refLen);
+    }
+    double refLengthCM = cmf(refLen);
+    if (len < refLen and !salmon::math::isLog0(refLengthCM)) {
+      return pmf(len) - refLengthCM;
+    }
+    return salmon::math::LOG_EPSILON;
+  }
+
   /**
    * A member function that returns a vector containing the (logged) cumulative
    * mass function *for the bins*.
@@ -162,6 +243,53 @@ public:
    *        is of (ie. "Fragment" or "Target") to be included in the header.
    */
   // void append_output(std::ofstream& outfile, std::string length_type) const;
+
+private:
+  friend class LocalFragmentLengthDistribution;
+};
+
+/**
+ * Collects the fragment length observations of a single thread (e.g. over
+ * a mini-batch), and adds them to the shared FragmentLengthDistribution
+ * all at once, when flush()ed (or destroyed).  The shared histogram is then
+ * updated once per bin per flush, rather than once per bin for every
+ * observation by every thread; the bins around the mode of the
+ * distribution were the ones all threads fought over.
+ *
+ * Observations aren't visible to pmf() / cmf() (or cacheCMF()) until they
+ * have been flushed.
+ */
+class LocalFragmentLengthDistribution {
+public:
+  explicit LocalFragmentLengthDistribution(FragmentLengthDistribution& fld);
+  ~LocalFragmentLengthDistribution() { flush(); }
+
+  LocalFragmentLengthDistribution(const LocalFragmentLengthDistribution&) =
+      delete;
+  LocalFragmentLengthDistribution&
+  operator=(const LocalFragmentLengthDistribution&) = delete;
+
+  /**
+   * Record an observation of length len with (logged) mass mass; see
+   * FragmentLengthDistribution::addVal.
+   */
+  void addVal(size_t len, double mass);
+
+  // Add the observations recorded so far to the shared distribution.
+  void flush();
+
+private:
+  friend class FragmentLengthDistribution;
+
+  FragmentLengthDistribution& fld_;
+  // the (logged) mass added to each bin, and the range of bins touched
+  std::vector<double> hist_;
+  size_t lo_;
+  size_t hi_{0};
+  double sum_;
+  double totMass_;
+  size_t min_;
+  uint64_t numUpdates_{0};
 };
 
 #endif
@@ -0,0 +1,118 @@
+#ifndef __GZIP_CHUNK_DECODER__
+#define __GZIP_CHUNK_DECODER__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fastx_parser {
+
+/**
+ * Inflates a run of the deflate blocks of a (possibly multi-member) gzip
+ * stream, starting at any block boundary, without knowing what was
+ * decompressed before it.  This is what lets ParallelGzipReader inflate a
+ * regular gzip file with several threads: the compressed file is cut into
+ * chunks, each thread looks for the first block that starts in its chunk
+ * (see find()), and decodes from there up to the first block that starts
+ * past the end of the chunk.
+ *
+ * A back-reference in a block may point up to 32KiB back, into the data of
+ * the preceding chunk, which isn't known yet.  So rather than bytes, the
+ * decoder produces 16-bit symbols: a value < 256 is a byte, and a value
+ * MARKER_BASE + i stands for byte i of the WINDOW_SIZE bytes preceding the
+ * start of the decoding (the last of them being byte WINDOW_SIZE - 1).  Once
+ * those are known, resolve() turns the symbols into bytes.
+ *
+ * Positions are in bits from the start of the file; the input passed in is a
+ * run of the bytes of the file, starting at byte offset base.
+ */
+class GzipChunkDecoder {
+public:
+  enum class Status : uint8_t {
+    // reached the first block starting at or after the stop position
+    STOPPED,
+    // reached the end of the last gzip member (anything after it is ignored)
+    STREAM_END,
+    // decoded at least maxOut symbols; stopped at the next block boundary
+    OUTPUT_FULL,
+    // the input ended in the middle of a block (or of a member header)
+    NEED_INPUT,
+    // not a valid deflate stream (or a truncated one)
+    INVALID
+  };
+
+  // The end of a gzip member, as recorded in its trailer
+  struct MemberEnd {
+    // the member's data ends before this many symbols of the output
+    size_t outPos;
+    uint32_t crc;
+    uint32_t isize;
+  };
+
+  struct Result {
+    Status status{Status::INVALID};
+    uint64_t startBit{0};
+    // Where decoding stopped: the start of a block or, if endAtHeader, of a
+    // gzip member header.  For NEED_INPUT, this is the last such position
+    // reached, and the output only goes up to it.
+    uint64_t endBit{0};
+    bool endAtHeader{false};
+    // only the first outLen symbols are valid
+    std::vector<uint16_t> out;
+    size_t outLen{0};
+    std::vector<MemberEnd> members;
+  };
+
+  static constexpr const uint16_t MARKER_BASE = 256;
+  static constexpr const size_t WINDOW_SIZE = 32768;
+
+  /**
+   * Decode in (the len bytes of the file from byte offset base on; atEnd if
+   * they run to the end of the file) from startBit, which is the start of a
+   * block or, if atHeader, of a gzip member header.  Decoding stops at the
+   * first block starting at or after stopBit.
+   */
+  Status decode(const unsigned char* in, size_t len, uint64_t base,
+                bool atEnd, uint64_t startBit, bool atHeader, uint64_t stopBit,
+                size_t maxOut, Result& res);
+
+  /**
+   * Look for the first position in [fromBit, toBit) at which a (non-final,
+   * dynamic Huffman) block appears to start, and decode from it as decode()
+   * does.  A candidate is only accepted if its blocks decode up to stopBit
+   * (or to the end of the stream); as any bit pattern could look like a
+   * block, a result that was found this way must still be checked against
+   * the end of the preceding chunk.  Returns false if nothing was found.
+   */
+  bool find(const unsigned char* in, size_t len, uint64_t base, bool atEnd,
+            uint64_t fromBit, uint64_t toBit, uint64_t stopBit, size_t maxOut,
+            Result& res);
+
+  /**
+   * Turn the first n symbols of res.out into bytes, given the window of
+   * (up to WINDOW_SIZE) bytes that precede them; window[windowLen - 1] is
+   * the last of them.  Returns false if a symbol refers to a byte before the
+   * start of the window.
+   */
+  static bool resolve(const uint16_t* syms, size_t n,
+                      const unsigned char* window, size_t windowLen,
+                      unsigned char* out);
+
+private:
+  struct BitReader;
+
+  Status decodeBlock_(BitReader& br, bool& final, size_t& outLen,
+                      Result& res);
+  bool readDynamicTables_(BitReader& br);
+  bool looksLikeBlock_(const unsigned char* in, size_t len,
+                       uint64_t bit) const;
+
+  // Huffman decoding tables (see buildTable() in the .cpp)
+  std::vector<uint32_t> litTable_;
+  std::vector<uint32_t> distTable_;
+  std::vector<uint32_t> fixedLitTable_;
+  std::vector<uint32_t> fixedDistTable_;
+  std::vector<uint32_t> clTable_;
+};
+}
+#endif // __GZIP_CHUNK_DECODER__
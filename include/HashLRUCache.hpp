@@ -0,0 +1,146 @@
+#ifndef __HASH_LRU_CACHE_HPP__
+#define __HASH_LRU_CACHE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace salmon {
+namespace mapping {
+
+/**
+ * A bounded cache of values keyed by a pair of (64-bit) hashes.  Once the
+ * cache holds `capacity` values, inserting a new one evicts (and reuses the
+ * storage of) the least recently used value.
+ *
+ * The mapping threads each keep their own caches (so no locking is done).
+ */
+template <typename ValueT> class HashLRUCache {
+public:
+  using Key = std::pair<uint64_t, uint64_t>;
+  struct KeyHasher {
+    size_t operator()(const Key& k) const {
+      // both halves are already hashes
+      return static_cast<size_t>(k.first ^ (k.second * 0x9E3779B97F4A7C15ULL));
+    }
+  };
+
+  // A capacity of 0 disables the cache.
+  explicit HashLRUCache(uint32_t capacity) : capacity_(capacity) {
+    entries_.reserve(capacity_);
+    index_.reserve(capacity_);
+  }
+
+  /**
+   * Return the value cached for k (and mark it as the most recently used
+   * one), or nullptr if there is none.  The pointer is valid until the next
+   * call to insert().
+   */
+  ValueT* find(const Key& k) {
+    auto it = index_.find(k);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    uint32_t e = it->second;
+    unlink_(e);
+    pushFront_(e);
+    return &(entries_[e].value);
+  }
+
+  /**
+   * Return the slot for the value of k, to be filled in by the caller (it
+   * may still hold the value it was last used for), or nullptr if the cache
+   * is disabled.
+   */
+  ValueT* insert(const Key& k) {
+    if (capacity_ == 0) {
+      return nullptr;
+    }
+    auto it = index_.find(k);
+    if (it != index_.end()) {
+      uint32_t e = it->second;
+      unlink_(e);
+      pushFront_(e);
+      return &(entries_[e].value);
+    }
+
+    uint32_t e;
+    if (entries_.size() < capacity_) {
+      e = static_cast<uint32_t>(entries_.size());
+      entries_.emplace_back();
+    } else {
+      // reuse the least recently used entry
+      e = tail_;
+      unlink_(e);
+      index_.erase(entries_[e].key);
+    }
+    entries_[e].key = k;
+    pushFront_(e);
+    index_.emplace(k, e);
+    return &(entries_[e].value);
+  }
+
+  size_t size() const { return index_.size(); }
+  uint32_t capacity() const { return capacity_; }
+
+private:
+  static constexpr const uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+  // the entries form a doubly-linked list, from most to least recently used
+  struct Entry {
+    Key key;
+    ValueT value;
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  void unlink_(uint32_t e) {
+    Entry& x = entries_[e];
+    if (x.prev != NIL) {
+      entries_[x.prev].next = x.next;
+    } else {
+      head_ = x.next;
+    }
+    if (x.next != NIL) {
+      entries_[x.next].prev = x.prev;
+    } else {
+      tail_ = x.prev;
+    }
+  }
+
+  void pushFront_(uint32_t e) {
+    Entry& x = entries_[e];
+    x.prev = NIL;
+    x.next = head_;
+    if (head_ != NIL) {
+      entries_[head_].prev = e;
+    }
+    head_ = e;
+    if (tail_ == NIL) {
+      tail_ = e;
+    }
+  }
+
+  uint32_t capacity_;
+  std::vector<Entry> entries_;
+  std::unordered_map<Key, uint32_t, KeyHasher> index_;
+  uint32_t head_{NIL};
+  uint32_t tail_{NIL};
+};
+
+/**
+ * The alignment scores computed by --validateMappings, keyed by the hash of
+ * the read sequence that was aligned and the hash of the reference window it
+ * was aligned against.  Each mapping thread keeps one for the whole run, so
+ * that reads that align to the same window as an earlier read (duplicates,
+ * reads from highly expressed transcripts, windows shared by isoforms) reuse
+ * its score rather than being aligned again.
+ */
+using AlignmentScoreCache = HashLRUCache<int32_t>;
+}
+}
+
+#endif // __HASH_LRU_CACHE_HPP__
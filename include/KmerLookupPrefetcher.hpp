@@ -0,0 +1,121 @@
+#ifndef __KMER_LOOKUP_PREFETCHER_HPP__
+#define __KMER_LOOKUP_PREFETCHER_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FastxParser.hpp"
+#include "RapMapUtils.hpp"
+
+/**
+ * Hides (some of) the memory latency of mapping a chunk of reads.
+ *
+ * SACollector maps one read at a time, and each of its lookups (hash bucket
+ * -> suffix array interval -> reference text) is a chain of dependent cache
+ * misses.  The lookups of *different* reads are independent, however, so,
+ * while a read is being mapped, this looks up the k-mers that SACollector
+ * will start from (the first, middle and last k-mer of each end) for the
+ * read `distance` positions further on in the chunk, and prefetches the
+ * suffix array entries they point to.  Half-way there, the reference text
+ * at those suffixes is prefetched as well.  By the time SACollector gets to
+ * the read, its first lookups hit in the cache.
+ *
+ * Note that the hash lookups made here are ordinary (blocking) finds, and
+ * that SACollector repeats them when it maps the read.  Both k-mer tables
+ * of the index (the sparse and the perfect hash), and SACollector, come
+ * from RapMap: the tables don't expose where a key's bucket lives, so it
+ * can't be prefetched ahead of the find, and SACollector has no way to take
+ * lookups resolved elsewhere.  What this buys is that SACollector's own
+ * lookups (and the suffix array and text accesses behind them) find their
+ * cache lines loaded, and that the lookahead's misses, which don't depend
+ * on the read being mapped, overlap with its work.  Whether that outweighs
+ * doing the finds twice hasn't been measured, so the lookahead is off by
+ * default (--mappingPrefetchDistance 0).
+ */
+template <typename RapMapIndexT> class KmerLookupPrefetcher {
+  using IndexT = typename RapMapIndexT::IndexType;
+
+public:
+  // A distance of 0 disables prefetching.
+  KmerLookupPrefetcher(RapMapIndexT* idx, uint32_t distance)
+      : idx_(idx), k_(rapmap::utils::my_mer::k()), dist_(distance),
+        textDist_(distance / 2), slots_(distance + 1) {
+    for (auto& s : slots_) {
+      s.reserve(2 * NUM_PROBES);
+    }
+  }
+
+  /**
+   * Call before mapping fragment i of the chunk rg (which holds n
+   * fragments), for i = 0, 1, ..., n - 1 in turn.
+   */
+  template <typename GroupT> void step(GroupT& rg, size_t i, size_t n) {
+    if (dist_ == 0) {
+      return;
+    }
+    // At the start of a chunk, fill the pipeline.
+    size_t lookupEnd = std::min(i + dist_ + 1, n);
+    for (size_t j = (i == 0) ? 0 : i + dist_; j < lookupEnd; ++j) {
+      auto& slot = slots_[j % slots_.size()];
+      slot.clear();
+      lookup_(rg[j], slot);
+    }
+    size_t textEnd = std::min(i + textDist_ + 1, n);
+    for (size_t j = (i == 0) ? 0 : i + textDist_; j < textEnd; ++j) {
+      for (auto saPos : slots_[j % slots_.size()]) {
+        __builtin_prefetch(idx_->seq.data() + idx_->SA[saPos]);
+      }
+    }
+  }
+
+private:
+  static constexpr const size_t NUM_PROBES = 3;
+
+  void lookup_(fastx_parser::ReadSeq& r, std::vector<IndexT>& slot) {
+    lookupSeq_(r.seq, slot);
+  }
+  void lookup_(fastx_parser::ReadPair& r, std::vector<IndexT>& slot) {
+    lookupSeq_(r.first.seq, slot);
+    lookupSeq_(r.second.seq, slot);
+  }
+
+  void lookupSeq_(const std::string& seq, std::vector<IndexT>& slot) {
+    if (seq.size() < k_) {
+      return;
+    }
+    size_t last = seq.size() - k_;
+    probe_(seq, 0, slot);
+    probe_(seq, last / 2, slot);
+    probe_(seq, last, slot);
+  }
+
+  void probe_(const std::string& seq, size_t pos, std::vector<IndexT>& slot) {
+    rapmap::utils::my_mer mer;
+    if (!mer.from_chars(seq.c_str() + pos)) {
+      return; // the k-mer contains a non-ACGT base
+    }
+    auto& khash = idx_->khash;
+    auto it = khash.find(mer.get_bits(0, 2 * k_));
+    if (it == khash.end()) {
+      auto rcMer = mer.get_reverse_complement();
+      it = khash.find(rcMer.get_bits(0, 2 * k_));
+      if (it == khash.end()) {
+        return;
+      }
+    }
+    IndexT saPos = it->second.begin();
+    __builtin_prefetch(idx_->SA.data() + saPos);
+    slot.push_back(saPos);
+  }
+
+  RapMapIndexT* idx_;
+  size_t k_;
+  size_t dist_;
+  size_t textDist_;
+  // the SA positions found for each of the fragments in the pipeline
+  std::vector<std::vector<IndexT>> slots_;
+};
+
+#endif // __KMER_LOOKUP_PREFETCHER_HPP__
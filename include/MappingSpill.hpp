@@ -0,0 +1,202 @@
+#ifndef __MAPPING_SPILL_HPP__
+#define __MAPPING_SPILL_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AlignmentGroup.hpp"
+#include "LibraryFormat.hpp"
+
+/**
+ * A temporary, on-disk record of the (filtered and scored) mappings of every
+ * fragment seen during the first pass over a read library.  If that pass did
+ * not observe enough fragments, the additional online rounds replay the
+ * spill instead of re-reading and re-mapping the reads, so that they can be
+ * performed even when the reads come from a pipe or process substitution.
+ *
+ * The spill is a sequence of mini-batches, each of which is written (under a
+ * lock) by the mapping thread that produced it and later handed, as a whole,
+ * to one of the replaying threads.  Only the fields of a mapping that
+ * processMiniBatch() looks at are recorded.  Each mini-batch is laid out as
+ *
+ *   BatchHeader | for each mapped fragment: uint32_t numAlignments, Record*
+ *
+ * where the Records are packed field by field (see putAlignment_).
+ */
+class MappingSpill {
+public:
+  // Create (truncate) the spill file at path; check good() afterwards.
+  explicit MappingSpill(const std::string& path);
+  // Closes *and removes* the spill file.
+  ~MappingSpill();
+
+  MappingSpill(const MappingSpill&) = delete;
+  MappingSpill& operator=(const MappingSpill&) = delete;
+
+  // False if the spill file could not be created, or if writing to or
+  // reading from it has failed (e.g. because the disk is full).
+  bool good() const { return file_ != nullptr and !failed_; }
+  const std::string& path() const { return path_; }
+
+  uint64_t numFragments() const { return numFragments_; }
+  uint64_t numBytes() const { return numBytes_; }
+
+  /**
+   * Append the mini-batch of alignment groups in [begin, end), which
+   * accounts for numFragments observed fragments (mapped or not), to the
+   * spill.  buf is scratch space owned by the calling thread.
+   */
+  template <typename GroupIt>
+  void writeBatch(GroupIt begin, GroupIt end, uint32_t numFragments,
+                  std::vector<char>& buf) {
+    buf.clear();
+    uint32_t numGroups{0};
+    for (auto it = begin; it != end; ++it) {
+      auto& alns = it->alignments();
+      if (alns.empty()) {
+        continue;
+      }
+      put_(buf, static_cast<uint32_t>(alns.size()));
+      for (auto& aln : alns) {
+        putAlignment_(buf, aln);
+      }
+      ++numGroups;
+    }
+    BatchHeader h;
+    h.numGroups = numGroups;
+    h.numFragments = numFragments;
+    h.numBytes = buf.size();
+    writeRaw_(h, buf);
+  }
+
+  /**
+   * Go (back) to the start of the spill; subsequent calls to readBatch()
+   * will return the mini-batches written so far.  Must not be called
+   * concurrently with writeBatch() or readBatch().
+   */
+  bool rewind();
+
+  /**
+   * Read the next mini-batch into the first numGroups elements of groups
+   * (growing it if needed) and set numFragments to the number of fragments
+   * it accounts for.  Returns false once the spill has been exhausted (or
+   * on an error; see good()).  buf is scratch space owned by the calling
+   * thread.
+   */
+  template <typename AlnT>
+  bool readBatch(std::vector<AlignmentGroup<AlnT>>& groups, size_t& numGroups,
+                 uint32_t& numFragments, std::vector<char>& buf) {
+    BatchHeader h;
+    if (!readRaw_(h, buf)) {
+      return false;
+    }
+    if (groups.size() < h.numGroups) {
+      groups.resize(h.numGroups);
+    }
+    const char* p = buf.data();
+    const char* end = p + buf.size();
+    for (uint32_t i = 0; i < h.numGroups; ++i) {
+      auto& g = groups[i];
+      g.clearAlignments();
+      uint32_t numAlns{0};
+      if (!get_(p, end, numAlns)) {
+        failed_ = true;
+        return false;
+      }
+      auto& alns = g.alignments();
+      for (uint32_t j = 0; j < numAlns; ++j) {
+        if (!getAlignment_(p, end, alns)) {
+          failed_ = true;
+          return false;
+        }
+      }
+    }
+    numGroups = h.numGroups;
+    numFragments = h.numFragments;
+    return true;
+  }
+
+private:
+  struct BatchHeader {
+    uint32_t numGroups{0};
+    uint32_t numFragments{0};
+    uint64_t numBytes{0};
+  };
+
+  enum AlnFlags : uint8_t { FWD = 0x1, MATE_FWD = 0x2, PAIRED = 0x4 };
+
+  template <typename T> static inline void put_(std::vector<char>& buf, T v) {
+    size_t n = buf.size();
+    buf.resize(n + sizeof(T));
+    std::memcpy(&buf[n], &v, sizeof(T));
+  }
+
+  template <typename T>
+  static inline bool get_(const char*& p, const char* end, T& v) {
+    if (static_cast<size_t>(end - p) < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+
+  template <typename AlnT>
+  static void putAlignment_(std::vector<char>& buf, AlnT& aln) {
+    put_(buf, static_cast<uint32_t>(aln.transcriptID()));
+    put_(buf, static_cast<int32_t>(aln.pos));
+    put_(buf, static_cast<int32_t>(aln.matePos));
+    put_(buf, static_cast<uint32_t>(aln.fragLen));
+    put_(buf, static_cast<uint32_t>(aln.readLen));
+    put_(buf, static_cast<uint32_t>(aln.mateLen));
+    put_(buf, static_cast<double>(aln.score()));
+    uint8_t flags = (aln.fwd ? FWD : 0) | (aln.mateIsFwd ? MATE_FWD : 0) |
+                    (aln.isPaired ? PAIRED : 0);
+    put_(buf, flags);
+    put_(buf, static_cast<uint8_t>(aln.mateStatus));
+    put_(buf, aln.libFormat().formatID());
+  }
+
+  template <typename AlnT>
+  static bool getAlignment_(const char*& p, const char* end,
+                            std::vector<AlnT>& alns) {
+    uint32_t tid, fragLen, readLen, mateLen;
+    int32_t pos, matePos;
+    double score;
+    uint8_t flags, mateStatus, formatID;
+    if (!(get_(p, end, tid) and get_(p, end, pos) and
+          get_(p, end, matePos) and get_(p, end, fragLen) and
+          get_(p, end, readLen) and get_(p, end, mateLen) and
+          get_(p, end, score) and get_(p, end, flags) and
+          get_(p, end, mateStatus) and get_(p, end, formatID))) {
+      return false;
+    }
+    alns.emplace_back(tid, pos, (flags & FWD) != 0, readLen, fragLen,
+                      (flags & PAIRED) != 0);
+    auto& aln = alns.back();
+    aln.matePos = matePos;
+    aln.mateIsFwd = (flags & MATE_FWD) != 0;
+    aln.mateLen = mateLen;
+    aln.mateStatus = static_cast<decltype(aln.mateStatus)>(mateStatus);
+    aln.format = LibraryFormat::formatFromID(formatID);
+    aln.score(score);
+    return true;
+  }
+
+  void writeRaw_(const BatchHeader& h, const std::vector<char>& buf);
+  bool readRaw_(BatchHeader& h, std::vector<char>& buf);
+
+  std::string path_;
+  std::FILE* file_{nullptr};
+  std::mutex mut_;
+  std::atomic<bool> failed_{false};
+  uint64_t numFragments_{0};
+  uint64_t numBytes_{0};
+};
+
+#endif // __MAPPING_SPILL_HPP__
@@ -0,0 +1,213 @@
+#ifndef __PARALLEL_GZIP_READER__
+#define __PARALLEL_GZIP_READER__
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GzipChunkDecoder.hpp"
+
+namespace fastx_parser {
+
+/**
+ * A sequential, read-only stream over a (possibly) gzip-compressed file that
+ * serves as the input of the FASTA/Q record reader.  The file is read, and
+ * inflated, by background threads so that the parsing thread only ever sees
+ * already-decompressed buffers.
+ *
+ * If the input is block-gzipped (BGZF, as written by bgzip / htslib), the
+ * independent blocks are inflated concurrently by a pool of worker threads and
+ * handed back in file order.  A regular gzip stream has no such independent
+ * blocks, so (with more than one inflater) the compressed file is cut into
+ * chunks, and each worker inflates a chunk from the first deflate block it
+ * can find in it, without knowing the 32KiB of data that precede it (see
+ * GzipChunkDecoder).  The chunks are then checked, in file order, to start
+ * where the preceding one ended, and the back-references into the preceding
+ * data are filled in; a chunk that doesn't line up is inflated again from the
+ * right place.  With a single inflater, a regular gzip stream is inflated by
+ * one background thread, which still takes decompression off of the parsing
+ * thread.  Uncompressed input is passed through as-is.
+ *
+ * Unless readAheadDepth is 0, the file itself is read by a separate I/O
+ * thread, which keeps up to readAheadDepth large, page-aligned buffers filled
+ * ahead of the decompressor, so that slow (e.g. network) storage and
+ * decompression overlap instead of taking turns on the same thread.
+ */
+class ParallelGzipReader {
+public:
+  explicit ParallelGzipReader(uint32_t numInflaters = 1,
+                              uint32_t readAheadDepth = DEFAULT_READ_AHEAD);
+  ~ParallelGzipReader();
+
+  ParallelGzipReader(const ParallelGzipReader&) = delete;
+  ParallelGzipReader& operator=(const ParallelGzipReader&) = delete;
+
+  // Open the file at path and start the background threads.
+  // Returns false if the file could not be opened.
+  bool open(const std::string& path);
+
+  // Points buf at the next run of decompressed bytes and returns its length.
+  // The bytes stay valid until the following call to next() or close().
+  // Returns 0 once the end of the stream has been reached, and -1 on an error.
+  int next(const unsigned char*& buf);
+
+  // Stop the background threads and close the underlying file.
+  void close();
+
+  bool isBGZF() const { return mode_ == Mode::BGZF; }
+
+  // By default, the I/O thread keeps this many buffers filled ahead
+  static constexpr const uint32_t DEFAULT_READ_AHEAD = 4;
+
+private:
+  enum class Mode : uint8_t { PLAIN, GZIP, BGZF };
+
+  // A unit of work passed from the reader thread to the consumer (and, for
+  // BGZF input, through one of the inflater threads in between).
+  struct Block {
+    // compressed BGZF blocks (unused for PLAIN and GZIP input)
+    std::vector<unsigned char> in;
+    // decompressed bytes; only the first outLen are valid
+    std::vector<unsigned char> out;
+    size_t outLen{0};
+    bool ready{false};
+    bool failed{false};
+  };
+
+  void readerPlain_();
+  void readerGzip_();
+  void readerBGZF_();
+  void inflater_();
+
+  // A chunk of a regular gzip file, inflated by one of the inflater threads.
+  struct GzipChunk {
+    // the offset, in the file, of the first byte of in
+    uint64_t offset{0};
+    // the chunk's bytes, followed by (up to) CHUNK_OVERLAP bytes of the next
+    // one, so that the block that straddles the end can usually be decoded
+    std::vector<unsigned char> in;
+    size_t ownLen{0};
+    // nothing follows in (in the file)
+    bool last{false};
+    // the input couldn't be read
+    bool failed{false};
+    // the first chunk starts with the gzip header
+    bool atHeader{false};
+    bool decoded{false};
+    // result holds the chunk inflated from its first block
+    bool found{false};
+    GzipChunkDecoder::Result result;
+  };
+
+  void readerGzipChunks_();
+  bool publishChunk_(std::unique_ptr<GzipChunk>&& chunk);
+  void chunkInflater_();
+  void sequenceChunks_(GzipChunkDecoder& decoder);
+  bool sequenceChunk_(GzipChunk& chunk, GzipChunkDecoder& decoder);
+  bool deliver_(const GzipChunkDecoder::Result& res);
+
+  // A buffer of raw input filled by the I/O thread.
+  struct IOBuffer {
+    struct FreeDeleter {
+      void operator()(unsigned char* p) const { std::free(p); }
+    };
+    std::unique_ptr<unsigned char, FreeDeleter> data{nullptr};
+    size_t len{0};
+    // the last buffer of the file
+    bool eof{false};
+    // the I/O thread hit an error while filling this buffer
+    bool failed{false};
+  };
+
+  void ioReader_();
+  ssize_t readFd_(unsigned char* dest, size_t len);
+  ssize_t readInput_(unsigned char* dest, size_t len);
+  bool fillRaw_(size_t need);
+  size_t rawAvail_() const { return rawEnd_ - rawBeg_; }
+
+  std::unique_ptr<Block> acquireBlock_();
+  void submitBlock_(std::unique_ptr<Block>&& blk, bool needsInflate);
+  void submitError_();
+  void finishReading_();
+
+  uint32_t numInflaters_;
+  uint32_t readAheadDepth_;
+  size_t maxInFlight_;
+  Mode mode_{Mode::PLAIN};
+  int fd_{-1};
+
+  // Raw (not yet decompressed) input; only touched by the reader thread once
+  // it has been started.
+  std::vector<unsigned char> raw_;
+  size_t rawBeg_{0};
+  size_t rawEnd_{0};
+  bool rawEOF_{false};
+
+  // The block most recently handed to the consumer.
+  std::unique_ptr<Block> cur_{nullptr};
+  bool failed_{false};
+
+  // Shared between the reader, the inflaters and the consumer.
+  std::mutex mut_;
+  std::condition_variable readyCV_;
+  std::condition_variable spaceCV_;
+  std::condition_variable workCV_;
+  // blocks in file order
+  std::deque<std::unique_ptr<Block>> inFlight_;
+  // BGZF blocks still waiting to be inflated
+  std::deque<Block*> toInflate_;
+  std::vector<std::unique_ptr<Block>> freeBlocks_;
+  bool readerDone_{false};
+  bool stop_{false};
+
+  // The chunks of a regular gzip file (also guarded by mut_), in file order.
+  // One inflater thread at a time (the one that finds sequencing_ unset)
+  // checks and delivers the chunks at the front once they are inflated.
+  std::condition_variable chunkSpaceCV_;
+  std::condition_variable moreInputCV_;
+  std::deque<std::unique_ptr<GzipChunk>> chunks_;
+  std::deque<GzipChunk*> toDecode_;
+  std::vector<std::unique_ptr<GzipChunk>> freeChunks_;
+  size_t maxChunks_;
+  bool inputDone_{false};
+  bool streamDone_{false};
+  bool sequencing_{false};
+  // the sequencer needs more of the input than the chunks in flight hold
+  bool needInput_{false};
+
+  // Only touched by the sequencing thread: where the next chunk has to
+  // start, the last 32KiB of the output, and the CRC and size of the
+  // current gzip member so far.
+  uint64_t nextBit_{0};
+  bool nextAtHeader_{true};
+  std::vector<unsigned char> window_;
+  std::vector<unsigned char> windowTail_;
+  uint32_t crc_{0};
+  uint32_t isize_{0};
+  GzipChunkDecoder::Result seqResult_;
+  std::vector<unsigned char> seqInput_;
+
+  // The read-ahead buffers, in file order.
+  // ioCur_ is the one being consumed (by the reader thread).
+  std::mutex ioMut_;
+  std::condition_variable ioFilledCV_;
+  std::condition_variable ioFreeCV_;
+  std::deque<std::unique_ptr<IOBuffer>> ioFilled_;
+  std::vector<std::unique_ptr<IOBuffer>> ioFree_;
+  std::unique_ptr<IOBuffer> ioCur_{nullptr};
+  size_t ioPos_{0};
+  bool ioStop_{false};
+
+  std::thread ioThread_;
+  std::thread readerThread_;
+  std::vector<std::thread> inflaterThreads_;
+};
+}
+#endif // __PARALLEL_GZIP_READER__
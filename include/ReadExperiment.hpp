@@ -186,6 +186,10 @@ public:
     if (sl_.try_lock()) {
       if (!done) {
         auto fld = fragLengthDist_.get();
+        // Freeze the distribution, so that the effective lengths and the
+        // conditional fragment length probabilities used from now on agree
+        // (this must happen before done is set)
+        fld->cacheCMF();
         // Convert the PMF to non-log scale
         std::vector<double> logPMF;
         size_t minVal;
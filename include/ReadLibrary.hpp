@@ -2,6 +2,7 @@
 #define READ_LIBRARY_HPP
 
 #include <exception>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -10,6 +11,8 @@
 #include "LibraryFormat.hpp"
 #include "LibraryTypeDetector.hpp"
 
+class MappingSpill;
+
 /**
  * This class represents the basic information about a library of reads, like
  * its paired-end status, the reads that should appear on the forward and
@@ -32,6 +35,7 @@ public:
       : fmt_(rl.fmt_), unmatedFilenames_(rl.unmatedFilenames_),
         mateOneFilenames_(rl.mateOneFilenames_),
         mateTwoFilenames_(rl.mateTwoFilenames_),
+        interleavedFilenames_(rl.interleavedFilenames_),
         libTypeCounts_(std::vector<std::atomic<uint64_t>>(
             LibraryFormat::maxLibTypeID() + 1)) {
     size_t mc = LibraryFormat::maxLibTypeID() + 1;
@@ -42,6 +46,7 @@ public:
     if (rl.detector_) {
       detector_.reset(new LibraryTypeDetector(*(rl.detector_.get())));
     }
+    spill_ = rl.spill_;
   }
 
   /**
@@ -51,6 +56,7 @@ public:
       : fmt_(rl.fmt_), unmatedFilenames_(std::move(rl.unmatedFilenames_)),
         mateOneFilenames_(std::move(rl.mateOneFilenames_)),
         mateTwoFilenames_(std::move(rl.mateTwoFilenames_)),
+        interleavedFilenames_(std::move(rl.interleavedFilenames_)),
         libTypeCounts_(std::vector<std::atomic<uint64_t>>(
             LibraryFormat::maxLibTypeID() + 1)) {
     size_t mc = LibraryFormat::maxLibTypeID() + 1;
@@ -61,6 +67,7 @@ public:
     if (rl.detector_) {
       detector_ = std::move(rl.detector_);
     }
+    spill_ = std::move(rl.spill_);
   }
 
   /**
@@ -79,6 +86,14 @@ public:
     mateTwoFilenames_ = mateTwoFilenames;
   }
 
+  /**
+   * Add files containing paired-end reads in which the two mates of each
+   * fragment follow one another (interleaved FASTA/Q or unaligned BAM).
+   */
+  void addInterleaved(const std::vector<std::string>& interleavedFilenames) {
+    interleavedFilenames_ = interleavedFilenames;
+  }
+
   /**
    * Add files containing unmated reads.
    */
@@ -124,12 +139,16 @@ public:
   }
 
   bool checkFileExtensions_(std::vector<std::string>& filenames,
-                            std::stringstream& errorStream) {
+                            std::stringstream& errorStream,
+                            bool allowBAM = false) {
     namespace bfs = boost::filesystem;
 
     std::set<std::string> acceptableExensions = {
         ".FASTA", ".FASTQ", ".FA", ".FQ", ".fasta",
         ".fastq", ".fa",    ".fq", ".GZ", ".gz"};
+    if (allowBAM) {
+      acceptableExensions.insert({".BAM", ".bam"});
+    }
 
     bool extensionsOK{true};
     for (auto& fn : filenames) {
@@ -162,6 +181,11 @@ public:
 
   bool isRegularFile() {
     if (isPairedEnd()) {
+      for (auto& il : interleavedFilenames_) {
+        if (!boost::filesystem::is_regular_file(il)) {
+          return false;
+        }
+      }
       for (auto& m1 : mateOneFilenames_) {
         if (!boost::filesystem::is_regular_file(m1)) {
           return false;
@@ -184,7 +208,15 @@ public:
 
   std::string readFilesAsString() {
     std::stringstream sstr;
-    if (isPairedEnd()) {
+    if (isPairedEnd() and isInterleaved()) {
+      size_t n = interleavedFilenames_.size();
+      for (size_t i = 0; i < n; ++i) {
+        sstr << "( " << interleavedFilenames_[i] << " )";
+        if (i != n - 1) {
+          sstr << ", ";
+        }
+      }
+    } else if (isPairedEnd()) {
       size_t n1 = mateOneFilenames_.size();
       size_t n2 = mateTwoFilenames_.size();
       if (n1 == 0 or n2 == 0 or n1 != n2) {
@@ -218,9 +250,9 @@ public:
 
   /**
    * Checks if this read library is valid --- if it's paired-end, it should have
-   * mate1/2 reads and the same number of files for each; if it's unpaired it
-   * should have only unpaired files. NOTE: This function throws an exception if
-   * this is not a valid read library!
+   * mate1/2 reads and the same number of files for each (or only interleaved
+   * files); if it's unpaired it should have only unpaired files. NOTE: This
+   * function throws an exception if this is not a valid read library!
    */
   void checkValid() {
 
@@ -233,9 +265,14 @@ public:
     if (isPairedEnd()) {
       size_t n1 = mateOneFilenames_.size();
       size_t n2 = mateTwoFilenames_.size();
-      if (n1 == 0 or n2 == 0 or n1 != n2) {
-        errorStream << "You must provide #1 and #2 mated read files with a "
-                       "paired-end library type\n";
+      if (isInterleaved() and (n1 > 0 or n2 > 0)) {
+        errorStream << "You can't provide both interleaved and #1 / #2 mated "
+                       "read files for the same paired-end library\n";
+        readsOK = false;
+      } else if (!isInterleaved() and (n1 == 0 or n2 == 0 or n1 != n2)) {
+        errorStream << "You must provide #1 and #2 mated read files (or "
+                       "interleaved read files) with a paired-end library "
+                       "type\n";
         readsOK = false;
       }
     } else {
@@ -259,6 +296,8 @@ public:
               checkFileExtensions_(mateTwoFilenames_, errorStream);
     readsOK = readsOK && allExist_(unmatedFilenames_, errorStream) &&
               checkFileExtensions_(unmatedFilenames_, errorStream);
+    readsOK = readsOK && allExist_(interleavedFilenames_, errorStream) &&
+              checkFileExtensions_(interleavedFilenames_, errorStream, true);
 
     if (!readsOK) {
       throw std::invalid_argument(errorStream.str());
@@ -275,6 +314,20 @@ public:
    */
   const std::vector<std::string>& mates2() const { return mateTwoFilenames_; }
 
+  /**
+   * Return the vector of files containing the interleaved paired-end reads for
+   * this library.
+   */
+  const std::vector<std::string>& interleaved() const {
+    return interleavedFilenames_;
+  }
+
+  /**
+   * Return true if the mates of this (paired-end) library are interleaved in
+   * one set of files rather than split across the #1 and #2 files.
+   */
+  bool isInterleaved() const { return !interleavedFilenames_.empty(); }
+
   /**
    * Return the vector of files containing the unmated reads for the library.
    */
@@ -307,14 +360,29 @@ public:
 
   std::vector<std::atomic<uint64_t>>& libTypeCounts() { return libTypeCounts_; }
 
+  /**
+   * Set the spill to which the mappings of this library's reads are written
+   * during the first pass (and from which they are replayed in any later
+   * passes).
+   */
+  void setMappingSpill(std::shared_ptr<MappingSpill> spill) { spill_ = spill; }
+
+  /**
+   * Return the mapping spill of this library, or nullptr if the mappings are
+   * not being spilled.
+   */
+  MappingSpill* mappingSpill() { return spill_.get(); }
+
 private:
   LibraryFormat fmt_;
   std::vector<std::string> unmatedFilenames_;
   std::vector<std::string> mateOneFilenames_;
   std::vector<std::string> mateTwoFilenames_;
+  std::vector<std::string> interleavedFilenames_;
   std::vector<std::atomic<uint64_t>> libTypeCounts_;
   std::atomic<uint64_t> numCompat_;
   std::unique_ptr<LibraryTypeDetector> detector_{nullptr};
+  std::shared_ptr<MappingSpill> spill_{nullptr};
 };
 
 #endif // READ_LIBRARY_HPP
@@ -13,8 +13,15 @@ namespace defaults {
   constexpr const double incompatPrior{0.0};
   constexpr const char quasiMappingDefaultFile[] = "";
   constexpr const char quasiMappingImplicitFile[] = "-";
+  constexpr const char binaryMappingFile[] = "";
   constexpr const bool metaMode{false};
   constexpr const bool disableMappingCache{true};
+  constexpr const char mappingSpillDir[] = "";
+  constexpr const uint32_t numDecompressionThreads{2};
+  constexpr const uint32_t readAheadDepth{4};
+  constexpr const double subsample{0.0};
+  constexpr const uint32_t subsampleSeed{0};
+  constexpr const uint32_t readMemoSize{0};
 
   // advanced
   constexpr const bool validateMappings{false};
@@ -48,6 +55,7 @@ namespace defaults {
   constexpr const uint32_t numBurninFrags{5000000};
   constexpr const uint32_t numPreBurninFrags{1000000};
   constexpr const bool useVBOpt{false};
+  constexpr const bool useSquarem{false};
   constexpr const uint32_t rangeFactorizationBins{0};
   constexpr const uint32_t numGibbsSamples{0};
   constexpr const bool noGammaDraw{false};
@@ -60,6 +68,8 @@ namespace defaults {
   constexpr const bool writeOrphanLinks{false};
   constexpr const bool writeUnmappedNames{false};
   constexpr const double quasiCoverage{0.0};
+  constexpr const uint32_t mappingPrefetchDistance{0};
+  constexpr const uint32_t alnScoreCacheSize{65536};
 
    // FMD-specific options
   constexpr const int fmdMinSeedLength{19};
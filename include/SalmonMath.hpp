@@ -33,6 +33,10 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
 
 namespace salmon {
 
@@ -80,6 +84,144 @@ inline double logSub(double x, double y) {
   return diff;
 }
 
+/**
+ * Approximations of exp and log, made only of arithmetic, bit manipulation
+ * and selects (no calls, and no branches other than ?: between two computed
+ * values), so that the compiler can vectorize the loops that call them
+ * (which it can't do with calls to std::exp / std::log).  Both are
+ * accurate to within a few units in the last place (a relative error below
+ * 1e-14) over the whole range of doubles; exp underflows to 0 below -708
+ * and overflows to infinity above 709.
+ */
+namespace approx {
+inline double exp(double x) {
+  // exp(x) = 2^n * exp(r), with n = round(x / log(2)) and |r| <= log(2) / 2
+  constexpr double log2e = 1.4426950408889634074;
+  constexpr double ln2hi = 6.93147180369123816490e-01;
+  constexpr double ln2lo = 1.90821492927058770002e-10;
+  // (adding this rounds to an integer, which ends up in the low bits)
+  constexpr double shifter = 6755399441055744.0; // 1.5 * 2^52
+  // (clamp first, and fix up the out of range values at the end, so that
+  // there are no branches)
+  double xc = (x < -708.0) ? -708.0 : ((x > 709.0) ? 709.0 : x);
+  double kd = xc * log2e + shifter;
+  double n = kd - shifter;
+  double r = (xc - n * ln2hi) - n * ln2lo;
+  // Taylor series to degree 11; the error is < r^12 / 12! < 1e-14
+  double p = 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = p * r + 1.0;
+  p = p * r + 1.0;
+  // scale by 2^n
+  uint64_t bits;
+  std::memcpy(&bits, &kd, sizeof(bits));
+  bits = (bits + 1023) << 52;
+  double scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  double e = p * scale;
+  e = (x < -708.0) ? 0.0 : e;
+  return (x > 709.0) ? std::numeric_limits<double>::infinity() : e;
+}
+
+inline double log(double x) {
+  // (as for exp, the special cases are selected at the end rather than
+  // branched on; subnormals are first scaled into the normal range by 2^54)
+  bool subnormal = x < std::numeric_limits<double>::min();
+  double xs = subnormal ? x * 18014398509481984.0 : x;
+  // x = m * 2^e, with m in [sqrt(1/2), sqrt(2))
+  uint64_t bits;
+  std::memcpy(&bits, &xs, sizeof(bits));
+  // (the exponent field is turned into a double the way exp() does the
+  // reverse, as there's no vector int64 -> double conversion before AVX-512)
+  uint64_t ebits = ((bits >> 52) & 0x7ff) | 0x4330000000000000ULL; // 2^52
+  double e;
+  std::memcpy(&e, &ebits, sizeof(e));
+  e -= 4503599627370496.0 + (subnormal ? 1023.0 + 54.0 : 1023.0);
+  bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+  double m;
+  std::memcpy(&m, &bits, sizeof(m));
+  bool high = m > 1.41421356237309504880;
+  m = high ? m * 0.5 : m;
+  e = high ? e + 1.0 : e;
+  // log(m) = 2 atanh(s), with s = (m - 1) / (m + 1) and |s| < 0.172
+  double s = (m - 1.0) / (m + 1.0);
+  double s2 = s * s;
+  double p = 1.0 / 21.0;
+  p = p * s2 + 1.0 / 19.0;
+  p = p * s2 + 1.0 / 17.0;
+  p = p * s2 + 1.0 / 15.0;
+  p = p * s2 + 1.0 / 13.0;
+  p = p * s2 + 1.0 / 11.0;
+  p = p * s2 + 1.0 / 9.0;
+  p = p * s2 + 1.0 / 7.0;
+  p = p * s2 + 1.0 / 5.0;
+  p = p * s2 + 1.0 / 3.0;
+  p = p * s2 + 1.0;
+  double l = 2.0 * s * p + e * 0.69314718055994530942;
+  // log(0) = -inf, log(inf) = inf, and log(x) = NaN for x < 0 (or NaN)
+  l = (x == 0.0) ? -std::numeric_limits<double>::infinity() : l;
+  l = (x == std::numeric_limits<double>::infinity()) ? x : l;
+  return (x >= 0.0) ? l : std::numeric_limits<double>::quiet_NaN();
+}
+} // namespace approx
+
+/**
+ * The exp and log used by the per-fragment likelihood computations.  These
+ * are the (vectorizable) approximations above if salmon was configured
+ * with -DFAST_LOG_MATH=TRUE, and std::exp / std::log otherwise.
+ */
+#ifdef SALMON_FAST_LOG_MATH
+inline double fastExp(double x) { return approx::exp(x); }
+inline double fastLog(double x) { return approx::log(x); }
+#else
+inline double fastExp(double x) { return std::exp(x); }
+inline double fastLog(double x) { return std::log(x); }
+#endif
+
+/**
+ * The log of the sum of the exponentials of the n (logged) values in v,
+ * i.e. the logAdd of all of them; values that are (+/-) LOG_0 are
+ * skipped, and the result is LOG_0 if every value is.  Unlike a chain of
+ * logAdd()s, this takes a single exp per value and a single log.
+ */
+inline double logSumExp(const double* v, size_t n) {
+  double maxV = -std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < n; ++i) {
+    if (std::abs(v[i]) != LOG_0 and v[i] > maxV) {
+      maxV = v[i];
+    }
+  }
+  if (maxV == -std::numeric_limits<double>::infinity()) {
+    return LOG_0;
+  }
+  double sum{0.0};
+  for (size_t i = 0; i < n; ++i) {
+    sum += (std::abs(v[i]) != LOG_0) ? fastExp(v[i] - maxV) : 0.0;
+  }
+  return maxV + fastLog(sum);
+}
+
+/**
+ * Replace each of the n (logged) values in v by exp(v[i] - logNorm), and
+ * return their sum.
+ */
+inline double expNormalize(double* v, size_t n, double logNorm) {
+  double sum{0.0};
+  for (size_t i = 0; i < n; ++i) {
+    v[i] = fastExp(v[i] - logNorm);
+    sum += v[i];
+  }
+  return sum;
+}
+
 } // namespace math
 
 } // namespace salmon
@@ -10,6 +10,9 @@
 #include <memory> // for shared_ptr
 #include <ostream>
 
+class AsyncBufferWriter;
+class BinaryMappingWriter;
+
 enum class SalmonQuantMode { MAP = 1, ALIGN = 2 };
 
 /**
@@ -71,6 +74,15 @@ struct SalmonOpts {
   double quasiCoverage; // [Experimental]: Default of 0.  The coverage by MMPs
                         // required for a read to be considered mapped.
 
+  uint32_t mappingPrefetchDistance; // [Developer]: How many reads ahead of the
+                                    // one being quasi-mapped the k-mer lookups
+                                    // are started (0, the default, disables
+                                    // this).
+
+  uint32_t alnScoreCacheSize; // [Developer]: The number of --validateMappings
+                              // alignment scores each mapping thread caches
+                              // (0 disables the cache).
+
   bool splitSpanningSeeds; // Attempt to split seeds that span multiple
                            // transcripts.
 
@@ -160,6 +172,10 @@ struct SalmonOpts {
   bool disableMappingCache; // Don't write mapping results to temporary mapping
                             // cache file
 
+  std::string mappingSpillDir; // If non-empty, spill the first-pass mappings
+                               // to a temporary file in this directory and
+                               // replay them in any additional rounds
+
   bool meta; // Set other options to be optimized for metagenomic data
 
   boost::filesystem::path outputDirectory; // Quant output directory
@@ -174,6 +190,8 @@ struct SalmonOpts {
 
   bool useVBOpt; // Use Variational Bayesian EM instead of "regular" EM in the
                  // batch passes
+  bool useSquarem{false}; // Accelerate the (VB)EM of the batch passes with
+                          // SQUAREM
 
   bool useRangeFactorization{false}; // enable range factorization
   uint32_t rangeFactorizationBins{
@@ -188,14 +206,15 @@ struct SalmonOpts {
   std::ofstream qmFile;
   std::unique_ptr<std::ostream> qmStream{nullptr};
   std::shared_ptr<spdlog::logger> qmLog{nullptr};
+  // For writing binary quasi-mappings
+  std::string bmFileName;
+  std::shared_ptr<BinaryMappingWriter> bmWriter{nullptr};
 
-  std::unique_ptr<std::ofstream> unmappedFile{nullptr};
   bool writeUnmappedNames; // write the names of unmapped reads
-  std::shared_ptr<spdlog::logger> unmappedLog{nullptr};
+  std::shared_ptr<AsyncBufferWriter> unmappedWriter{nullptr};
 
-  std::unique_ptr<std::ofstream> orphanLinkFile{nullptr};
   bool writeOrphanLinks; // write the names of unmapped reads
-  std::shared_ptr<spdlog::logger> orphanLinkLog{nullptr};
+  std::shared_ptr<AsyncBufferWriter> orphanLinkWriter{nullptr};
 
   bool sampleOutput;    // Sample alignments according to posterior estimates of
                         // transcript abundance.
@@ -222,6 +241,12 @@ struct SalmonOpts {
   std::atomic<int32_t> numBiasSamples{
       1000000}; // The number of fragment mappings to consider when building
                 // the sequence-specific "foreground" distribution.
+  std::atomic<uint64_t> numAlnScoreCacheHits{0};   // The number of alignment scores
+  std::atomic<uint64_t> numAlnScoreCacheMisses{0}; // found in (and missing from) the
+                                                   // per-thread score caches.
+  std::atomic<uint64_t> numReadMemoHits{0};   // The number of reads (pairs) whose
+  std::atomic<uint64_t> numReadMemoMisses{0}; // mappings were (and were not) found
+                                              // in the per-thread read memos.
 
   // Related to the prior of the VBEM algorithm
   double vbPrior{1e-3};
@@ -240,6 +265,11 @@ struct SalmonOpts {
   uint32_t numThreads;
   uint32_t numQuantThreads;
   uint32_t numParseThreads;
+  uint32_t numDecompressionThreads; // threads used to inflate each gzipped input file
+  uint32_t readAheadDepth; // buffers read ahead of the decompressor, per input file
+  double subsample; // if > 0, the fraction (< 1) or number (>= 1) of fragments to quantify
+  uint32_t subsampleSeed; // seed of the hash that picks the subsampled fragments
+  uint32_t readMemoSize; // reads (pairs) whose mappings each mapping thread memoizes
 
   // Related to alignment verification
   bool validateMappings;
@@ -255,6 +285,7 @@ struct SalmonOpts {
   std::vector<std::string> unmatedReadFiles;
   std::vector<std::string> mate1ReadFiles;
   std::vector<std::string> mate2ReadFiles;
+  std::vector<std::string> interleavedReadFiles;
 };
 
 #endif // SALMON_OPTS_HPP
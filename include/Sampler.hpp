@@ -196,26 +196,12 @@ void sampleMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             if (flen > 0.0 and aln->isPaired() and useFragLengthDist and
                 considerCondProb) {
               size_t fl = flen;
-              double lenProb = fragLengthDist.pmf(fl);
               if (burnedIn) {
                 /* condition fragment length prob on txp length */
-                double refLengthCM =
-                    fragLengthDist.cmf(static_cast<size_t>(refLength));
-                bool computeMass =
-                    fl < refLength and !salmon::math::isLog0(refLengthCM);
-                logFragProb = (computeMass) ? (lenProb - refLengthCM)
-                                            : salmon::math::LOG_EPSILON;
-                if (computeMass and refLengthCM < lenProb) {
-                  // Threading is hard!  It's possible that an update to the PMF
-                  // snuck in between when we asked to cache the CMF and when
-                  // the "burnedIn" variable was last seen as false.
-                  log->info("reference length = {}, CMF[refLen] = {}, fragLen "
-                            "= {}, PMF[fragLen] = {}",
-                            refLength, std::exp(refLengthCM), aln->fragLen(),
-                            std::exp(lenProb));
-                }
+                logFragProb = fragLengthDist.conditionalPMF(
+                    fl, static_cast<size_t>(refLength));
               } else if (useAuxParams) {
-                logFragProb = lenProb;
+                logFragProb = fragLengthDist.pmf(fl);
               }
             }
 
@@ -10,10 +10,13 @@
 #include "tbb/atomic.h"
 #include "stx/string_view.hpp"
 #include "IOUtils.hpp"
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <limits>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "rapmap/bit_array.h"
 #include "rapmap/rank9b.h"
@@ -714,4 +717,57 @@ private:
   std::vector<int32_t> polyAPos_;
 };
 
+/**
+ * Collects the (logged) mass that a single thread assigns to transcripts
+ * over a mini-batch, and adds it to the transcripts when flush()ed, once per
+ * distinct transcript.  Without it, every assignment of every thread did a
+ * compare-and-swap loop on the mass of its transcript, and all threads
+ * fought over the few transcripts (mitochondrial, ribosomal, ...) that
+ * dominate some libraries.
+ *
+ * The masses added over a mini-batch all share its forgetting mass, so
+ * deferring them to the end of the mini-batch just means that
+ * Transcript::mass() reads the masses as of the last (flushed) mini-batch
+ * during the next one.
+ */
+class LocalTranscriptMasses {
+public:
+  explicit LocalTranscriptMasses(std::vector<Transcript>& transcripts)
+      : transcripts_(transcripts) {}
+  ~LocalTranscriptMasses() { flush(); }
+
+  LocalTranscriptMasses(const LocalTranscriptMasses&) = delete;
+  LocalTranscriptMasses& operator=(const LocalTranscriptMasses&) = delete;
+
+  inline void addMass(uint32_t transcriptID, double mass) {
+    masses_.emplace_back(transcriptID, mass);
+  }
+
+  // Add the masses collected so far to the transcripts.
+  void flush() {
+    if (masses_.empty()) {
+      return;
+    }
+    std::sort(masses_.begin(), masses_.end(),
+              [](const std::pair<uint32_t, double>& a,
+                 const std::pair<uint32_t, double>& b) -> bool {
+                return a.first < b.first;
+              });
+    auto it = masses_.begin();
+    while (it != masses_.end()) {
+      auto transcriptID = it->first;
+      double mass = it->second;
+      for (++it; it != masses_.end() and it->first == transcriptID; ++it) {
+        mass = salmon::math::logAdd(mass, it->second);
+      }
+      transcripts_[transcriptID].addMass(mass);
+    }
+    masses_.clear();
+  }
+
+private:
+  std::vector<Transcript>& transcripts_;
+  std::vector<std::pair<uint32_t, double>> masses_;
+};
+
 #endif // TRANSCRIPT
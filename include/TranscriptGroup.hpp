@@ -25,6 +25,9 @@ public:
 
   void setValid(bool v) const;
 
+  // Recompute the hash after changing txps.
+  void updateHash();
+
   std::vector<uint32_t> txps;
   size_t hash;
   double totalMass;
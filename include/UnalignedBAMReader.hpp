@@ -0,0 +1,127 @@
+#ifndef __UNALIGNED_BAM_READER__
+#define __UNALIGNED_BAM_READER__
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "StadenUtils.hpp"
+
+namespace fastx_parser {
+
+/**
+ * Reads the sequences (and qualities) of the records of an unaligned BAM
+ * file, in file order, straight into the caller's strings.  The file is read
+ * with the same io_lib (scram) reader that BAMQueue uses for alignment input.
+ *
+ * Secondary and supplementary records are skipped (in case the file is
+ * aligned after all), and the sequence of a record marked as reverse
+ * complemented is restored to the orientation in which it was sequenced.
+ *
+ * The return values are those of FastxRecordReader::read():
+ *   >=0  length of the sequence (normal)
+ *   -1   end-of-file
+ *   -3   error reading stream
+ */
+class UnalignedBAMReader {
+public:
+  explicit UnalignedBAMReader(uint32_t numThreads = 1)
+      : numThreads_(numThreads), rec_(staden::utils::bam_init()) {}
+
+  ~UnalignedBAMReader() {
+    close();
+    staden::utils::bam_destroy(rec_);
+  }
+
+  UnalignedBAMReader(const UnalignedBAMReader&) = delete;
+  UnalignedBAMReader& operator=(const UnalignedBAMReader&) = delete;
+
+  // Returns false if the file could not be opened.
+  bool open(const std::string& path) {
+    close();
+    fp_ = scram_open(path.c_str(), "rb");
+    if (fp_ == nullptr) {
+      return false;
+    }
+    if (numThreads_ > 1) {
+      scram_set_option(fp_, CRAM_OPT_NTHREADS, numThreads_);
+    }
+    return true;
+  }
+
+  void close() {
+    if (fp_ != nullptr) {
+      scram_close(fp_);
+      fp_ = nullptr;
+    }
+  }
+
+  // If qual is null, the quality string is not stored.  If the record
+  // carries no qualities, *qual is left empty.
+  int read(std::string& name, std::string& seq, std::string* qual) {
+    do {
+      if (scram_get_seq(fp_, &rec_) < 0) {
+        return scram_eof(fp_) ? -1 : -3;
+      }
+    } while (bam_flag(rec_) & SKIP_FLAGS);
+
+    name.assign(bam_name(rec_));
+
+    static const char nt16[] = "=ACMGRSVTWYHKDBN";
+    int32_t len = bam_seq_len(rec_);
+    const uint8_t* packed = reinterpret_cast<const uint8_t*>(bam_seq(rec_));
+    seq.resize(len);
+    for (int32_t i = 0; i < len; ++i) {
+      seq[i] = nt16[(packed[i >> 1] >> ((~i & 1) << 2)) & 0xf];
+    }
+
+    bool isRC = (bam_flag(rec_) & BAM_FREVERSE);
+    if (isRC) {
+      std::reverse(seq.begin(), seq.end());
+      for (auto& c : seq) {
+        c = complement_(c);
+      }
+    }
+
+    if (qual != nullptr) {
+      const uint8_t* q = reinterpret_cast<const uint8_t*>(bam_qual(rec_));
+      qual->clear();
+      // 0xff marks a record without qualities
+      if (len > 0 and q[0] != 0xff) {
+        qual->resize(len);
+        for (int32_t i = 0; i < len; ++i) {
+          (*qual)[i] = static_cast<char>(q[i] + 33);
+        }
+        if (isRC) {
+          std::reverse(qual->begin(), qual->end());
+        }
+      }
+    }
+    return len;
+  }
+
+private:
+  // secondary (0x100) and supplementary (0x800) records
+  static constexpr const uint32_t SKIP_FLAGS = 0x100 | 0x800;
+
+  static inline char complement_(char c) {
+    switch (c) {
+    case 'A':
+      return 'T';
+    case 'C':
+      return 'G';
+    case 'G':
+      return 'C';
+    case 'T':
+      return 'A';
+    default:
+      return 'N';
+    }
+  }
+
+  uint32_t numThreads_;
+  scram_fd* fp_{nullptr};
+  bam_seq_t* rec_;
+};
+}
+#endif // __UNALIGNED_BAM_READER__
@@ -0,0 +1,115 @@
+import gzip
+import struct
+import argparse
+import logging
+import sys
+
+# The layout written by BinaryMappingWriter (see include/BinaryMappingWriter.hpp)
+MAGIC = b'SALMONBM'
+VERSION = 1
+u32 = struct.Struct('<I')
+hitStruct = struct.Struct('<IiiiIIBBf')
+
+FWD = 0x1
+MATE_FWD = 0x2
+
+SINGLE_END = 0
+PAIRED_END_LEFT = 1
+PAIRED_END_RIGHT = 2
+PAIRED_END_PAIRED = 3
+
+def readExactly(fh, n):
+    b = fh.read(n)
+    if len(b) != n:
+        raise EOFError()
+    return b
+
+def readU32(fh):
+    return u32.unpack(readExactly(fh, u32.size))[0]
+
+def readString(fh):
+    return readExactly(fh, readU32(fh)).decode()
+
+def baseName(name):
+    # Trim anything after the first space, and the mate suffix
+    name = name.split()[0] if name else name
+    if name.endswith('/1') or name.endswith('/2'):
+        name = name[:-2]
+    return name
+
+def samRecords(name, hits, txpNames):
+    numHits = len(hits)
+    for i, h in enumerate(hits):
+        tid, pos, matePos, fragLen, readLen, mateLen, flags, mateStatus, score = h
+        fwd = (flags & FWD) != 0
+        mateFwd = (flags & MATE_FWD) != 0
+        ref = txpNames[tid]
+        secondary = 256 if i > 0 else 0
+        tags = 'NH:i:{}\tZS:f:{:g}'.format(numHits, score)
+        if mateStatus == SINGLE_END:
+            flag = secondary | (0 if fwd else 16)
+            yield [name, flag, ref, max(pos, 0) + 1, 255, '{}M'.format(readLen),
+                   '*', 0, 0, '*', '*', tags]
+        elif mateStatus == PAIRED_END_PAIRED:
+            tlen = abs(fragLen)
+            leftFirst = pos <= matePos
+            flag1 = 1 | 2 | 64 | secondary | (0 if fwd else 16) | (0 if mateFwd else 32)
+            flag2 = 1 | 2 | 128 | secondary | (0 if mateFwd else 16) | (0 if fwd else 32)
+            yield [name, flag1, ref, max(pos, 0) + 1, 255, '{}M'.format(readLen),
+                   '=', max(matePos, 0) + 1, tlen if leftFirst else -tlen, '*', '*', tags]
+            yield [name, flag2, ref, max(matePos, 0) + 1, 255, '{}M'.format(mateLen),
+                   '=', max(pos, 0) + 1, -tlen if leftFirst else tlen, '*', '*', tags]
+        else:
+            # An orphan; only one end of the fragment mapped
+            mate = 64 if mateStatus == PAIRED_END_LEFT else 128
+            flag = 1 | 8 | mate | secondary | (0 if fwd else 16)
+            yield [name, flag, ref, max(pos, 0) + 1, 255, '{}M'.format(readLen),
+                   '=', max(pos, 0) + 1, 0, '*', '*', tags]
+
+def main(args):
+    logging.basicConfig(level=logging.INFO)
+    numFrags = 0
+    numRecords = 0
+    with gzip.open(args.mappings, 'rb') as mf:
+        if readExactly(mf, len(MAGIC)) != MAGIC:
+            logging.error("{} is not a salmon binary mapping file".format(args.mappings))
+            sys.exit(1)
+        version = readU32(mf)
+        if version != VERSION:
+            logging.error("Unsupported binary mapping format version {}".format(version))
+            sys.exit(1)
+        numTargets = readU32(mf)
+        txpNames = []
+        txpLens = []
+        for _ in range(numTargets):
+            txpNames.append(readString(mf))
+            txpLens.append(readU32(mf))
+
+        ofile = sys.stdout if args.output == '-' else open(args.output, 'w')
+        ofile.write('@HD\tVN:1.0\tSO:unknown\n')
+        for n, l in zip(txpNames, txpLens):
+            ofile.write('@SQ\tSN:{}\tLN:{}\n'.format(n, l))
+        ofile.write('@PG\tID:salmon\tPN:salmon\n')
+
+        while True:
+            try:
+                name = baseName(readString(mf))
+            except EOFError:
+                break
+            numHits = readU32(mf)
+            hits = [hitStruct.unpack(readExactly(mf, hitStruct.size)) for _ in range(numHits)]
+            for rec in samRecords(name, hits, txpNames):
+                ofile.write('\t'.join(map(str, rec)) + '\n')
+                numRecords += 1
+            numFrags += 1
+        if ofile is not sys.stdout:
+            ofile.close()
+
+    logging.info("wrote {} SAM records for {} mapped fragments".format(numRecords, numFrags))
+
+if __name__ == "__main__":
+   parser = argparse.ArgumentParser(description="Convert the binary mappings written by salmon (--writeBinaryMappings) to SAM")
+   parser.add_argument('mappings', type=str, help="path to the binary mapping file")
+   parser.add_argument('output', type=str, nargs='?', default='-', help="path to the SAM file to write (default: stdout)")
+   args = parser.parse_args()
+   main(args)
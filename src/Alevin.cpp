@@ -894,6 +894,15 @@ salmon-based processing of single-cell RNA-seq data.
       exit(1);
     }
 
+    // The barcodes are read from the #1 mates and the biological reads
+    // from the #2 mates, each from their own files.
+    if (vm.count("interleaved")) {
+      fmt::print(stderr, "ERROR: alevin does not support --interleaved (FASTA/Q or "
+                 "unaligned BAM) input; please pass the barcode reads with -1 and "
+                 "the biological reads with -2.\n");
+      exit(1);
+    }
+
     std::stringstream commentStream;
     commentStream << "### salmon (single-cell-based) v" << salmon::version << "\n";
     commentStream << "### [ program ] => salmon \n";
@@ -381,6 +381,10 @@ namespace alevin {
       sopt.numThreads = aopt.numThreads;
       sopt.quiet = aopt.quiet;
       sopt.quantMode = SalmonQuantMode::MAP;
+      if (sopt.bmFileName != "") {
+        aopt.jointLog->warn("alevin does not support --writeBinaryMappings; ignoring it");
+        sopt.bmFileName = "";
+      }
       bool optionsOK =
         salmon::utils::processQuantOptions(sopt, vm, vm["numBiasSamples"].as<int32_t>());
       if (!optionsOK) {
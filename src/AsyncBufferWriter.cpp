@@ -0,0 +1,127 @@
+#include "AsyncBufferWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+AsyncBufferWriter::AsyncBufferWriter(const std::string& path, bool compress,
+                                     size_t maxQueued)
+    : path_(path), compress_(compress) {
+  file_ = std::fopen(path_.c_str(), "wb");
+  if (file_ == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < std::max(maxQueued, size_t(1)); ++i) {
+    free_.enqueue(std::vector<char>());
+  }
+  writer_ = std::thread(&AsyncBufferWriter::writerLoop_, this);
+}
+
+AsyncBufferWriter::~AsyncBufferWriter() { close(); }
+
+void AsyncBufferWriter::writeNow(const std::vector<char>& buf) {
+  if (good() and !writeBlock_(buf)) {
+    failed_ = true;
+  }
+}
+
+void AsyncBufferWriter::push(std::vector<char>& buf) {
+  if (buf.empty()) {
+    return;
+  }
+  if (!writer_.joinable() or done_) {
+    // nothing will write this out
+    buf.clear();
+    return;
+  }
+  filled_.enqueue(std::move(buf));
+  free_.wait_dequeue(buf);
+}
+
+void AsyncBufferWriter::write(const char* data, size_t n) {
+  if (n == 0 or !writer_.joinable() or done_) {
+    return;
+  }
+  std::vector<char> buf;
+  free_.wait_dequeue(buf);
+  buf.assign(data, data + n);
+  filled_.enqueue(std::move(buf));
+}
+
+void AsyncBufferWriter::writerLoop_() {
+  std::vector<char> buf;
+  while (true) {
+    filled_.wait_dequeue(buf);
+    if (buf.empty()) {
+      // Woken up by close(), once nothing more will be queued; write out
+      // whatever is left.
+      while (filled_.try_dequeue(buf)) {
+        if (!buf.empty() and !failed_ and !writeBlock_(buf)) {
+          failed_ = true;
+        }
+      }
+      return;
+    }
+    // Once we've failed, keep draining the queue so that producers never
+    // block.
+    if (!failed_ and !writeBlock_(buf)) {
+      failed_ = true;
+    }
+    buf.clear();
+    free_.enqueue(std::move(buf));
+  }
+}
+
+bool AsyncBufferWriter::writeBlock_(const std::vector<char>& buf) {
+  if (!compress_) {
+    if (std::fwrite(buf.data(), 1, buf.size(), file_) != buf.size()) {
+      return false;
+    }
+    numBytes_ += buf.size();
+    numWrittenBytes_ += buf.size();
+    return true;
+  }
+
+  // Each block is a gzip member of its own
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  out_.resize(deflateBound(&zs, buf.size()));
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(buf.data()));
+  zs.avail_in = static_cast<uInt>(buf.size());
+  zs.next_out = out_.data();
+  zs.avail_out = static_cast<uInt>(out_.size());
+  int ret = deflate(&zs, Z_FINISH);
+  size_t n = out_.size() - zs.avail_out;
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END) {
+    return false;
+  }
+  if (std::fwrite(out_.data(), 1, n, file_) != n) {
+    return false;
+  }
+  numBytes_ += buf.size();
+  numWrittenBytes_ += n;
+  return true;
+}
+
+bool AsyncBufferWriter::close() {
+  if (writer_.joinable()) {
+    done_ = true;
+    filled_.enqueue(std::vector<char>());
+    writer_.join();
+  }
+  if (file_ != nullptr) {
+    if (std::fclose(file_) != 0) {
+      failed_ = true;
+    }
+    file_ = nullptr;
+    // (good() is now false, so remember whether we succeeded)
+    closedOk_ = !failed_;
+  }
+  return closedOk_;
+}
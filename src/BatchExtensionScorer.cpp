@@ -0,0 +1,231 @@
+#include "BatchExtensionScorer.hpp"
+#include "BatchExtensionScorerKernel.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace salmon {
+namespace mapping {
+
+namespace {
+// The same encoding as the one KSW2Aligner uses (A, C, G, T -> 0 .. 3,
+// anything else -> 4).
+inline uint8_t encodeBase(char c) {
+  switch (c) {
+  case 'A':
+  case 'a':
+    return 0;
+  case 'C':
+  case 'c':
+    return 1;
+  case 'G':
+  case 'g':
+    return 2;
+  case 'T':
+  case 't':
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+// The kernel keeps positions in 16-bit lanes.
+constexpr const int32_t MAX_KERNEL_LEN = 16384;
+constexpr const int MAX_LANES = 32;
+}
+
+BatchExtensionScorer::BatchExtensionScorer(int8_t match, int8_t mismatch,
+                                           int8_t gapo, int8_t gape,
+                                           int bandwidth)
+    : match_(match < 0 ? -match : match),
+      mismatch_(mismatch > 0 ? -mismatch : mismatch), gapo_(gapo),
+      gape_(gape), bandwidth_(bandwidth), aligner_(match, mismatch) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  useSSE41_ = __builtin_cpu_supports("sse4.1");
+  useAVX2_ = __builtin_cpu_supports("avx2");
+#endif
+  ksw2pp::KSW2Config config;
+  config.dropoff = -1;
+  config.gapo = gapo;
+  config.gape = gape;
+  config.bandwidth = bandwidth;
+  config.flag = KSW_EZ_SCORE_ONLY;
+  aligner_.config() = config;
+  std::memset(&ez_, 0, sizeof(ksw_extz_t));
+}
+
+size_t BatchExtensionScorer::add(const char* query, int32_t qlen,
+                                 const char* target, int32_t tlen) {
+  Job j;
+  j.qOffset = static_cast<uint32_t>(seqs_.size());
+  j.qlen = std::max(qlen, 0);
+  j.tOffset = j.qOffset + j.qlen;
+  j.tlen = std::max(tlen, 0);
+  seqs_.resize(seqs_.size() + j.qlen + j.tlen);
+  uint8_t* out = seqs_.data() + j.qOffset;
+  for (int32_t i = 0; i < j.qlen; ++i) {
+    *out++ = encodeBase(query[i]);
+  }
+  for (int32_t i = 0; i < j.tlen; ++i) {
+    *out++ = encodeBase(target[i]);
+  }
+  jobs_.push_back(j);
+  return jobs_.size() - 1;
+}
+
+void BatchExtensionScorer::clear() {
+  seqs_.clear();
+  jobs_.clear();
+  scores_.clear();
+}
+
+bool BatchExtensionScorer::setKernel(Kernel k) {
+  bool haveSSE41{false};
+  bool haveAVX2{false};
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  haveSSE41 = __builtin_cpu_supports("sse4.1");
+  haveAVX2 = __builtin_cpu_supports("avx2");
+#endif
+  switch (k) {
+  case Kernel::KSW2:
+    useSSE41_ = useAVX2_ = false;
+    return true;
+  case Kernel::SSE41:
+    if (!haveSSE41) {
+      return false;
+    }
+    useSSE41_ = true;
+    useAVX2_ = false;
+    return true;
+  case Kernel::AVX2:
+    if (!haveSSE41 or !haveAVX2) {
+      return false;
+    }
+    useSSE41_ = useAVX2_ = true;
+    return true;
+  }
+  return false;
+}
+
+BatchExtensionScorer::Kernel BatchExtensionScorer::kernel() const {
+  return useAVX2_ ? Kernel::AVX2 : (useSSE41_ ? Kernel::SSE41 : Kernel::KSW2);
+}
+
+void BatchExtensionScorer::scoreWithKSW2_(size_t i) {
+  const Job& j = jobs_[i];
+  ez_.max_q = ez_.max_t = ez_.mqe_t = ez_.mte_q = -1;
+  ez_.max = 0, ez_.mqe = ez_.mte = KSW_NEG_INF;
+  ez_.n_cigar = 0;
+  aligner_(seqs_.data() + j.qOffset, j.qlen, seqs_.data() + j.tOffset, j.tlen,
+           &ez_, ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::EXTENSION>());
+  scores_[i] = std::max(ez_.mqe, ez_.mte);
+}
+
+void BatchExtensionScorer::run() {
+  scores_.assign(jobs_.size(), KSW_NEG_INF);
+  // ksw_extz2_sse() gives up on scoring schemes in which a mismatch costs
+  // more than opening gaps in both sequences.
+  if (-mismatch_ > 2 * (gapo_ + gape_)) {
+    return;
+  }
+
+  order_.clear();
+  for (uint32_t i = 0; i < jobs_.size(); ++i) {
+    const Job& j = jobs_[i];
+    if (j.qlen == 0 or j.tlen == 0) {
+      continue;
+    }
+    // (without a band, ksw2 uses one as wide as the longer sequence, which
+    // would differ from lane to lane)
+    if (!useSSE41_ or bandwidth_ < 0 or j.qlen > MAX_KERNEL_LEN or
+        j.tlen > MAX_KERNEL_LEN) {
+      scoreWithKSW2_(i);
+      continue;
+    }
+    order_.push_back(i);
+  }
+  if (!order_.empty()) {
+    runBatches_();
+  }
+}
+
+void BatchExtensionScorer::runBatches_() {
+  // Batch together alignments of similar sizes, so that the anti-diagonals
+  // of the lanes of a batch (mostly) line up.
+  std::sort(order_.begin(), order_.end(),
+            [this](uint32_t x, uint32_t y) -> bool {
+              const Job& a = jobs_[x];
+              const Job& b = jobs_[y];
+              return (a.tlen < b.tlen) or
+                     (a.tlen == b.tlen and a.qlen < b.qlen);
+            });
+
+  const int L = useAVX2_ ? 32 : 16;
+  int32_t qlens[MAX_LANES];
+  int32_t tlens[MAX_LANES];
+  int32_t laneScores[MAX_LANES];
+
+  batch_kernel::KernelArgs args;
+  args.match = match_;
+  args.mismatch = mismatch_;
+  args.gapo = gapo_;
+  args.gape = gape_;
+  args.w = bandwidth_;
+  args.qlen = qlens;
+  args.tlen = tlens;
+  args.scores = laneScores;
+
+  for (size_t b = 0; b < order_.size(); b += L) {
+    int n = static_cast<int>(
+        std::min(order_.size() - b, static_cast<size_t>(L)));
+    int qmax{0}, tmax{0};
+    for (int l = 0; l < n; ++l) {
+      const Job& j = jobs_[order_[b + l]];
+      qlens[l] = j.qlen;
+      tlens[l] = j.tlen;
+      qmax = std::max(qmax, j.qlen);
+      tmax = std::max(tmax, j.tlen);
+    }
+    int tspan = (tmax + 15) / 16 * 16;
+
+    // transpose the sequences of the batch so that each position is one
+    // (SIMD) load
+    qcodes_.assign((qmax + batch_kernel::QUERY_PAD) * L, 0);
+    tcodes_.assign(tspan * L, 0);
+    for (int l = 0; l < n; ++l) {
+      const Job& j = jobs_[order_[b + l]];
+      const uint8_t* q = seqs_.data() + j.qOffset;
+      uint8_t* qc = qcodes_.data() + batch_kernel::QUERY_PAD * L + l;
+      for (int32_t k = 0; k < j.qlen; ++k) {
+        qc[k * L] = q[k];
+      }
+      const uint8_t* t = seqs_.data() + j.tOffset;
+      for (int32_t k = 0; k < j.tlen; ++k) {
+        tcodes_[k * L + l] = t[k];
+      }
+    }
+    diffs_.resize(5 * tspan * L);
+    H_.resize(tspan * L);
+
+    args.numUsed = n;
+    args.qcodes = qcodes_.data();
+    args.tcodes = tcodes_.data();
+    args.tspan = tspan;
+    args.u = diffs_.data();
+    args.v = args.u + tspan * L;
+    args.x = args.v + tspan * L;
+    args.y = args.x + tspan * L;
+    args.s = args.y + tspan * L;
+    args.H = H_.data();
+    if (useAVX2_) {
+      batch_kernel::extz2BatchAVX2(args);
+    } else {
+      batch_kernel::extz2BatchSSE41(args);
+    }
+    for (int l = 0; l < n; ++l) {
+      scores_[order_[b + l]] = laneScores[l];
+    }
+  }
+}
+}
+}
@@ -0,0 +1,90 @@
+// Compiled with -mavx2 (see src/CMakeLists.txt); only called when the CPU
+// supports AVX2.
+#include "BatchExtensionScorerKernel.hpp"
+
+#include <immintrin.h>
+
+namespace salmon {
+namespace mapping {
+namespace batch_kernel {
+namespace {
+struct AVX2Ops {
+  using V = __m256i;
+  using W = __m256i;
+  static constexpr const int LANES = 32;
+  static constexpr const int W_LANES = 8;
+
+  static inline V set1(int8_t x) { return _mm256_set1_epi8(x); }
+  static inline V load(const uint8_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const V*>(p));
+  }
+  static inline void store(uint8_t* p, V x) {
+    _mm256_storeu_si256(reinterpret_cast<V*>(p), x);
+  }
+  static inline V add(V a, V b) { return _mm256_add_epi8(a, b); }
+  static inline V sub(V a, V b) { return _mm256_sub_epi8(a, b); }
+  static inline V maxi(V a, V b) { return _mm256_max_epi8(a, b); }
+  static inline V maxu(V a, V b) { return _mm256_max_epu8(a, b); }
+  static inline V minu(V a, V b) { return _mm256_min_epu8(a, b); }
+  static inline V cmpeq(V a, V b) { return _mm256_cmpeq_epi8(a, b); }
+  static inline V or_(V a, V b) { return _mm256_or_si256(a, b); }
+  // mask ? b : a
+  static inline V blend(V a, V b, V mask) {
+    return _mm256_blendv_epi8(a, b, mask);
+  }
+  // packs works within each 128-bit half; put the lanes back in order
+  static inline V pack16(__m256i a, __m256i b) {
+    return _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+  }
+  // lanes with lo <= t <= hi
+  static inline V rangeMask(const int16_t* lo, const int16_t* hi, int t) {
+    const __m256i tv = _mm256_set1_epi16(static_cast<int16_t>(t));
+    __m256i out0 = _mm256_or_si256(
+        _mm256_cmpgt_epi16(_mm256_loadu_si256(reinterpret_cast<const V*>(lo)),
+                           tv),
+        _mm256_cmpgt_epi16(tv,
+                           _mm256_loadu_si256(reinterpret_cast<const V*>(hi))));
+    __m256i out1 = _mm256_or_si256(
+        _mm256_cmpgt_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const V*>(lo + 16)), tv),
+        _mm256_cmpgt_epi16(
+            tv, _mm256_loadu_si256(reinterpret_cast<const V*>(hi + 16))));
+    return _mm256_andnot_si256(pack16(out0, out1), _mm256_set1_epi8(-1));
+  }
+  // lanes with lo == t
+  static inline V eqMask(const int16_t* lo, int t) {
+    const __m256i tv = _mm256_set1_epi16(static_cast<int16_t>(t));
+    return pack16(
+        _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const V*>(lo)),
+                           tv),
+        _mm256_cmpeq_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const V*>(lo + 16)), tv));
+  }
+
+  static inline W set1W(int32_t x) { return _mm256_set1_epi32(x); }
+  static inline W loadW(const int32_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const W*>(p));
+  }
+  static inline void storeW(int32_t* p, W x) {
+    _mm256_storeu_si256(reinterpret_cast<W*>(p), x);
+  }
+  // W_LANES unsigned bytes -> 32 bits
+  static inline W widen(const uint8_t* p) {
+    return _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+  }
+  static inline W addW(W a, W b) { return _mm256_add_epi32(a, b); }
+  static inline W subW(W a, W b) { return _mm256_sub_epi32(a, b); }
+  static inline W cmpgtW(W a, W b) { return _mm256_cmpgt_epi32(a, b); }
+  static inline W cmpeqW(W a, W b) { return _mm256_cmpeq_epi32(a, b); }
+  static inline W andnotW(W a, W b) { return _mm256_andnot_si256(a, b); }
+  static inline W blendW(W a, W b, W mask) {
+    return _mm256_blendv_epi8(a, b, mask);
+  }
+};
+} // namespace
+
+void extz2BatchAVX2(const KernelArgs& args) { extz2Batch<AVX2Ops>(args); }
+}
+}
+}
@@ -0,0 +1,82 @@
+// Compiled with -msse4.1 (see src/CMakeLists.txt); only called when the CPU
+// supports SSE4.1.
+#include "BatchExtensionScorerKernel.hpp"
+
+#include <smmintrin.h>
+
+#include <cstring>
+
+namespace salmon {
+namespace mapping {
+namespace batch_kernel {
+namespace {
+struct SSE41Ops {
+  using V = __m128i;
+  using W = __m128i;
+  static constexpr const int LANES = 16;
+  static constexpr const int W_LANES = 4;
+
+  static inline V set1(int8_t x) { return _mm_set1_epi8(x); }
+  static inline V load(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const V*>(p));
+  }
+  static inline void store(uint8_t* p, V x) {
+    _mm_storeu_si128(reinterpret_cast<V*>(p), x);
+  }
+  static inline V add(V a, V b) { return _mm_add_epi8(a, b); }
+  static inline V sub(V a, V b) { return _mm_sub_epi8(a, b); }
+  static inline V maxi(V a, V b) { return _mm_max_epi8(a, b); }
+  static inline V maxu(V a, V b) { return _mm_max_epu8(a, b); }
+  static inline V minu(V a, V b) { return _mm_min_epu8(a, b); }
+  static inline V cmpeq(V a, V b) { return _mm_cmpeq_epi8(a, b); }
+  static inline V or_(V a, V b) { return _mm_or_si128(a, b); }
+  // mask ? b : a
+  static inline V blend(V a, V b, V mask) { return _mm_blendv_epi8(a, b, mask); }
+  // lanes with lo <= t <= hi
+  static inline V rangeMask(const int16_t* lo, const int16_t* hi, int t) {
+    const __m128i tv = _mm_set1_epi16(static_cast<int16_t>(t));
+    __m128i out0 = _mm_or_si128(
+        _mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const V*>(lo)), tv),
+        _mm_cmpgt_epi16(tv, _mm_loadu_si128(reinterpret_cast<const V*>(hi))));
+    __m128i out1 = _mm_or_si128(
+        _mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const V*>(lo + 8)),
+                        tv),
+        _mm_cmpgt_epi16(tv,
+                        _mm_loadu_si128(reinterpret_cast<const V*>(hi + 8))));
+    return _mm_andnot_si128(_mm_packs_epi16(out0, out1), _mm_set1_epi8(-1));
+  }
+  // lanes with lo == t
+  static inline V eqMask(const int16_t* lo, int t) {
+    const __m128i tv = _mm_set1_epi16(static_cast<int16_t>(t));
+    return _mm_packs_epi16(
+        _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const V*>(lo)), tv),
+        _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const V*>(lo + 8)),
+                        tv));
+  }
+
+  static inline W set1W(int32_t x) { return _mm_set1_epi32(x); }
+  static inline W loadW(const int32_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const W*>(p));
+  }
+  static inline void storeW(int32_t* p, W x) {
+    _mm_storeu_si128(reinterpret_cast<W*>(p), x);
+  }
+  // W_LANES unsigned bytes -> 32 bits
+  static inline W widen(const uint8_t* p) {
+    int32_t b;
+    std::memcpy(&b, p, sizeof(b));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(b));
+  }
+  static inline W addW(W a, W b) { return _mm_add_epi32(a, b); }
+  static inline W subW(W a, W b) { return _mm_sub_epi32(a, b); }
+  static inline W cmpgtW(W a, W b) { return _mm_cmpgt_epi32(a, b); }
+  static inline W cmpeqW(W a, W b) { return _mm_cmpeq_epi32(a, b); }
+  static inline W andnotW(W a, W b) { return _mm_andnot_si128(a, b); }
+  static inline W blendW(W a, W b, W mask) { return _mm_blendv_epi8(a, b, mask); }
+};
+} // namespace
+
+void extz2BatchSSE41(const KernelArgs& args) { extz2Batch<SSE41Ops>(args); }
+}
+}
+}
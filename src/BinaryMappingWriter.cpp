@@ -0,0 +1,4 @@
+#include "BinaryMappingWriter.hpp"
+
+constexpr const char BinaryMappingWriter::magic[];
+constexpr const uint32_t BinaryMappingWriter::version;
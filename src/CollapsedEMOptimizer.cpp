@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 #include <exception>
 
 #include "tbb/blocked_range.h"
+#include "tbb/enumerable_thread_specific.h"
 #include "tbb/parallel_for.h"
 #include "tbb/parallel_for_each.h"
 #include "tbb/parallel_reduce.h"
@@ -22,6 +26,8 @@
 #include "AlignmentLibrary.hpp"
 #include "BootstrapWriter.hpp"
 #include "CollapsedEMOptimizer.hpp"
+#include "EquivalenceClassCSR.hpp"
+#include "ExpDigamma.hpp"
 #include "MultinomialSampler.hpp"
 #include "ReadExperiment.hpp"
 #include "ReadPair.hpp"
@@ -40,6 +46,11 @@ constexpr double minEQClassWeight = std::numeric_limits<double>::min();
 constexpr double minWeight = std::numeric_limits<double>::min();
 // A bit more conservative of a minimum as an argument to the digamma function.
 constexpr double digammaMin = 1e-10;
+// The number of expected thetas the parallel VBEM update computes at once
+constexpr size_t expThetaBlockSize = 256;
+// Connected components of the classes with more (class, transcript) entries
+// than this are iterated with the parallel update, and the rest serially.
+constexpr size_t maxSerialComponentEntries = size_t(1) << 16;
 
 double normalize(std::vector<tbb::atomic<double>>& vec) {
   double sum{0.0};
@@ -101,8 +112,7 @@ std::vector<double> populatePriorAlphas_(
  * Single-threaded VBEM-update routine for use in bootstrapping
  */
 template <typename VecT>
-void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
-                 std::vector<std::vector<double>>& txpGroupCombinedWeights,
+void VBEMUpdate_(const EquivalenceClassCSR& eqClasses,
                  const std::vector<uint64_t>& txpGroupCounts,
                  std::vector<Transcript>& transcripts,
                  std::vector<double>& priorAlphas, double totLen,
@@ -110,7 +120,7 @@ void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
 
   assert(alphaIn.size() == alphaOut.size());
   size_t M = alphaIn.size();
-  size_t numEQClasses = txpGroupLabels.size();
+  size_t numEQClasses = eqClasses.size();
   double alphaSum = {0.0};
   for (size_t i = 0; i < M; ++i) {
     alphaSum += alphaIn[i] + priorAlphas[i];
@@ -121,23 +131,22 @@ void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
   // double prior = priorAlpha;
 
   for (size_t i = 0; i < M; ++i) {
-    auto ap = alphaIn[i] + priorAlphas[i];
-    if (ap > ::digammaMin) {
-        expTheta[i] =
-          std::exp(boost::math::digamma(ap) - logNorm);
-    } else {
-      expTheta[i] = 0.0;
-    }
+    expTheta[i] = alphaIn[i] + priorAlphas[i];
     alphaOut[i] = 0.0; // priorAlphas[i];
   }
+  salmon::math::expDigamma(expTheta.data(), M, logNorm, ::digammaMin,
+                           expTheta.data());
 
   for (size_t eqID = 0; eqID < numEQClasses; ++eqID) {
+    if (!eqClasses.valid(eqID)) {
+      continue;
+    }
     uint64_t count = txpGroupCounts[eqID];
-    const std::vector<uint32_t>& txps = txpGroupLabels[eqID];
-    const auto& auxs = txpGroupCombinedWeights[eqID];
+    const uint32_t* txps = eqClasses.txps(eqID);
+    const double* auxs = eqClasses.combinedWeights(eqID);
 
     double denom = 0.0;
-    size_t groupSize = txpGroupCombinedWeights[eqID].size(); // txps.size();
+    size_t groupSize = eqClasses.classSize(eqID);
     // If this is a single-transcript group,
     // then it gets the full count.  Otherwise,
     // update according to our VBEM rule.
@@ -165,70 +174,244 @@ void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
       }
 
     } else {
-      salmon::utils::incLoop(alphaOut[txps.front()], count);
+      salmon::utils::incLoop(alphaOut[txps[0]], count);
     }
   }
 }
 
+/**
+ * Gathers the new abundance of each transcript in an EM (or VBEM) update
+ * without the threads contending, through atomics, for alphaOut.  Each
+ * update computes, for every transcript t,
+ *
+ *   alphaOut[t] = (the counts of the valid single-transcript classes of t) +
+ *                 w[t] * sum over the valid classes c containing t of
+ *                   aux[c, t] * count[c] / (sum over t' in c of w[t'] aux[c, t'])
+ *
+ * where w is alphaIn for the EM, and expTheta for the VBEM.  How the sums
+ * are gathered depends on the size of the transcriptome:
+ *
+ *  - If a vector of abundances per thread is small enough, each thread
+ *    scatters the classes it processes into its own vector, and the vectors
+ *    are then summed (in parallel, over the transcripts).
+ *  - Otherwise, the classes are processed "owner-computes": a first pass
+ *    over the classes writes the (class, transcript) terms to a buffer with
+ *    the layout of the classes, and a second pass over the transcripts sums
+ *    the terms of each transcript, through an index of its entries built up
+ *    front.
+ *
+ * The (size-ordered) classes of a single transcript are never visited, as
+ * their contribution doesn't change from one update to the next.  The
+ * accumulator must be constructed once the degenerate classes have been
+ * marked.
+ */
+class AbundanceAccumulator {
+public:
+  AbundanceAccumulator(EquivalenceClassCSR& eqClasses, size_t numTranscripts,
+                       size_t numThreads)
+      : eqClasses_(eqClasses), numTranscripts_(numTranscripts),
+        singletonCounts_(numTranscripts, 0.0),
+        usePartials_(numTranscripts * std::max(numThreads, size_t(1)) <=
+                     maxPartialAlphaEntries),
+        partials_(std::vector<double>(usePartials_ ? numTranscripts : 0,
+                                      0.0)) {
+    size_t numClasses = eqClasses_.size();
+    firstMulti_ = 0;
+    while (firstMulti_ < numClasses and eqClasses_.classSize(firstMulti_) < 2) {
+      if (eqClasses_.valid(firstMulti_)) {
+        singletonCounts_[eqClasses_.txps(firstMulti_)[0]] +=
+            eqClasses_.count(firstMulti_);
+      }
+      ++firstMulti_;
+    }
+
+    if (!usePartials_) {
+      // Index the entries (of the multi-transcript classes) by transcript
+      size_t begin = (firstMulti_ < numClasses) ? eqClasses_.offset(firstMulti_)
+                                                : eqClasses_.numEntries();
+      size_t end = eqClasses_.numEntries();
+      const uint32_t* txps = (end > begin) ? eqClasses_.txps(firstMulti_)
+                                           : nullptr;
+      txpOffsets_.assign(numTranscripts_ + 1, 0);
+      for (size_t e = begin; e < end; ++e) {
+        ++txpOffsets_[txps[e - begin] + 1];
+      }
+      for (size_t t = 0; t < numTranscripts_; ++t) {
+        txpOffsets_[t + 1] += txpOffsets_[t];
+      }
+      txpEntries_.resize(end - begin);
+      std::vector<uint64_t> next(txpOffsets_.begin(), txpOffsets_.end() - 1);
+      for (size_t e = begin; e < end; ++e) {
+        txpEntries_[next[txps[e - begin]]++] = e;
+      }
+      terms_.assign(end, 0.0);
+    }
+  }
+
+  template <typename WeightVecT>
+  void update(const WeightVecT& w, CollapsedEMOptimizer::VecType& alphaOut) {
+    if (usePartials_) {
+      scatterPartials_(w);
+      tbb::parallel_for(
+          BlockedIndexRange(size_t(0), numTranscripts_),
+          [this, &alphaOut](const BlockedIndexRange& range) -> void {
+            for (auto t : boost::irange(range.begin(), range.end())) {
+              double sum = singletonCounts_[t];
+              for (auto& p : partials_) {
+                sum += p[t];
+                p[t] = 0.0;
+              }
+              alphaOut[t] = sum;
+            }
+          });
+    } else {
+      computeTerms_(w);
+      tbb::parallel_for(
+          BlockedIndexRange(size_t(0), numTranscripts_),
+          [this, &w, &alphaOut](const BlockedIndexRange& range) -> void {
+            for (auto t : boost::irange(range.begin(), range.end())) {
+              double sum{0.0};
+              for (auto i = txpOffsets_[t]; i < txpOffsets_[t + 1]; ++i) {
+                sum += terms_[txpEntries_[i]];
+              }
+              double v = w[t] * sum;
+              alphaOut[t] = singletonCounts_[t] + (std::isnan(v) ? 0.0 : v);
+            }
+          });
+    }
+  }
+
+  /**
+   * The log-likelihood of the (valid) classes under the abundances alpha,
+   * up to a constant:
+   *
+   *   sum over c of count[c] * log(sum over t in c of alpha[t] aux[c, t])
+   *     - (sum over c of count[c]) * log(sum over t of alpha[t])
+   *
+   * which is -infinity if some class has no support under alpha.
+   */
+  template <typename VecT> double logLikelihood(const VecT& alpha) const {
+    using LLPair = std::pair<double, double>;
+    auto ll = tbb::parallel_reduce(
+        BlockedIndexRange(size_t(0), eqClasses_.size()), LLPair(0.0, 0.0),
+        [this, &alpha](const BlockedIndexRange& range,
+                       LLPair partial) -> LLPair {
+          for (auto eqID : boost::irange(range.begin(), range.end())) {
+            if (!eqClasses_.valid(eqID)) {
+              continue;
+            }
+            const uint32_t* txps = eqClasses_.txps(eqID);
+            const double* auxs = eqClasses_.combinedWeights(eqID);
+            size_t groupSize = eqClasses_.classSize(eqID);
+            double denom = 0.0;
+            for (size_t i = 0; i < groupSize; ++i) {
+              denom += alpha[txps[i]] * auxs[i];
+            }
+            double count = eqClasses_.count(eqID);
+            partial.first += count * std::log(denom);
+            partial.second += count;
+          }
+          return partial;
+        },
+        [](const LLPair& a, const LLPair& b) -> LLPair {
+          return LLPair(a.first + b.first, a.second + b.second);
+        });
+    double alphaSum{0.0};
+    for (size_t t = 0; t < numTranscripts_; ++t) {
+      alphaSum += alpha[t];
+    }
+    return ll.first - ll.second * std::log(alphaSum);
+  }
+
+private:
+  // The largest number of per-thread abundances we're willing to keep
+  static constexpr size_t maxPartialAlphaEntries = size_t(1) << 23;
+
+  // The normalizer of the valid class eqID, or 0 if it's degenerate (under w)
+  template <typename WeightVecT>
+  inline double invDenom_(const WeightVecT& w, size_t eqID) const {
+    if (!eqClasses_.valid(eqID)) {
+      return 0.0;
+    }
+    const uint32_t* txps = eqClasses_.txps(eqID);
+    const double* auxs = eqClasses_.combinedWeights(eqID);
+    size_t groupSize = eqClasses_.classSize(eqID);
+    double denom = 0.0;
+    for (size_t i = 0; i < groupSize; ++i) {
+      denom += w[txps[i]] * auxs[i];
+    }
+    return (denom <= ::minEQClassWeight) ? 0.0
+                                         : eqClasses_.count(eqID) / denom;
+  }
+
+  template <typename WeightVecT> void scatterPartials_(const WeightVecT& w) {
+    tbb::parallel_for(
+        BlockedIndexRange(firstMulti_, eqClasses_.size()),
+        [this, &w](const BlockedIndexRange& range) -> void {
+          auto& local = partials_.local();
+          for (auto eqID : boost::irange(range.begin(), range.end())) {
+            double invDenom = invDenom_(w, eqID);
+            if (invDenom == 0.0) {
+              continue;
+            }
+            const uint32_t* txps = eqClasses_.txps(eqID);
+            const double* auxs = eqClasses_.combinedWeights(eqID);
+            size_t groupSize = eqClasses_.classSize(eqID);
+            for (size_t i = 0; i < groupSize; ++i) {
+              double v = w[txps[i]] * auxs[i];
+              if (!std::isnan(v)) {
+                local[txps[i]] += v * invDenom;
+              }
+            }
+          }
+        });
+  }
+
+  template <typename WeightVecT> void computeTerms_(const WeightVecT& w) {
+    tbb::parallel_for(
+        BlockedIndexRange(firstMulti_, eqClasses_.size()),
+        [this, &w](const BlockedIndexRange& range) -> void {
+          for (auto eqID : boost::irange(range.begin(), range.end())) {
+            double invDenom = invDenom_(w, eqID);
+            const double* auxs = eqClasses_.combinedWeights(eqID);
+            double* terms = &terms_[eqClasses_.offset(eqID)];
+            size_t groupSize = eqClasses_.classSize(eqID);
+            for (size_t i = 0; i < groupSize; ++i) {
+              terms[i] = auxs[i] * invDenom;
+            }
+          }
+        });
+  }
+
+  EquivalenceClassCSR& eqClasses_;
+  size_t numTranscripts_;
+  // the first class with more than one transcript
+  size_t firstMulti_{0};
+  std::vector<double> singletonCounts_;
+  bool usePartials_;
+  // for the per-thread scheme
+  tbb::enumerable_thread_specific<std::vector<double>> partials_;
+  // for the owner-computes scheme
+  std::vector<uint64_t> txpOffsets_;
+  std::vector<uint64_t> txpEntries_;
+  std::vector<double> terms_;
+};
+
+constexpr size_t AbundanceAccumulator::maxPartialAlphaEntries;
+
 /*
  * Use the "standard" EM algorithm over equivalence
  * classes to estimate the latent variables (alphaOut)
  * given the current estimates (alphaIn).
  */
-template <typename EQVecT>
-void EMUpdate_(EQVecT& eqVec,
+void EMUpdate_(AbundanceAccumulator& accumulator,
                std::vector<Transcript>& transcripts,
 	       std::vector<double>& priorAlphas,
                const CollapsedEMOptimizer::VecType& alphaIn,
                CollapsedEMOptimizer::VecType& alphaOut) {
 
   assert(alphaIn.size() == alphaOut.size());
-
-  tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &priorAlphas, &alphaIn, &alphaOut](const BlockedIndexRange& range) -> void {
-        for (auto eqID : boost::irange(range.begin(), range.end())) {
-          auto& kv = eqVec[eqID];
-
-          uint64_t count = kv.second.count;
-          // for each transcript in this class
-          const TranscriptGroup& tgroup = kv.first;
-          if (tgroup.valid) {
-            const std::vector<uint32_t>& txps = tgroup.txps;
-            const auto& auxs = kv.second.combinedWeights;
-
-            double denom = 0.0;
-            size_t groupSize = kv.second.weights.size(); // txps.size();
-            // If this is a single-transcript group,
-            // then it gets the full count.  Otherwise,
-            // update according to our VBEM rule.
-            if (BOOST_LIKELY(groupSize > 1)) {
-              for (size_t i = 0; i < groupSize; ++i) {
-                auto tid = txps[i];
-                auto aux = auxs[i];
-                double v = (alphaIn[tid]) * aux;
-                denom += v;
-              }
-
-              if (denom <= ::minEQClassWeight) {
-                // tgroup.setValid(false);
-              } else {
-                double invDenom = count / denom;
-                for (size_t i = 0; i < groupSize; ++i) {
-                  auto tid = txps[i];
-                  auto aux = auxs[i];
-                  double v = (alphaIn[tid]) * aux;
-                  if (!std::isnan(v)) {
-                    salmon::utils::incLoop(alphaOut[tid], v * invDenom);
-                  }
-                }
-              }
-            } else {
-              salmon::utils::incLoop(alphaOut[txps.front()], count);
-            }
-          }
-        }
-      });
+  accumulator.update(alphaIn, alphaOut);
 }
 
 /*
@@ -236,8 +419,7 @@ void EMUpdate_(EQVecT& eqVec,
  * classes to estimate the latent variables (alphaOut)
  * given the current estimates (alphaIn).
  */
-template <typename EQVecT>
-void VBEMUpdate_(EQVecT& eqVec,
+void VBEMUpdate_(AbundanceAccumulator& accumulator,
                  std::vector<Transcript>& transcripts,
                  std::vector<double>& priorAlphas, double totLen,
                  const CollapsedEMOptimizer::VecType& alphaIn,
@@ -253,92 +435,213 @@ void VBEMUpdate_(EQVecT& eqVec,
 
   double logNorm = boost::math::digamma(alphaSum);
 
-  tbb::parallel_for(BlockedIndexRange(size_t(0), size_t(transcripts.size())),
-                    [logNorm, totLen, &priorAlphas, &alphaIn, &alphaOut,
-                     &expTheta](const BlockedIndexRange& range) -> void {
-
-                      // double prior = priorAlpha;
-
-                      for (auto i : boost::irange(range.begin(), range.end())) {
-                        auto ap = alphaIn[i].load() + priorAlphas[i];
-                        if (ap > ::digammaMin) {
-                          expTheta[i] =
-                              std::exp(boost::math::digamma(ap) - logNorm);
-                        } else {
-                          expTheta[i] = 0.0;
-                        }
-                        // alphaOut[i] = prior * transcripts[i].RefLength;
-                        alphaOut[i] = 0.0;
-                      }
-                    });
-
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &alphaIn, &alphaOut,
+      BlockedIndexRange(size_t(0), M),
+      [logNorm, &priorAlphas, &alphaIn,
        &expTheta](const BlockedIndexRange& range) -> void {
-        for (auto eqID : boost::irange(range.begin(), range.end())) {
-          auto& kv = eqVec[eqID];
+        // (through a buffer, as expTheta holds atomics)
+        double ap[expThetaBlockSize];
+        for (size_t b = range.begin(); b < range.end();
+             b += expThetaBlockSize) {
+          size_t n = std::min(expThetaBlockSize, range.end() - b);
+          for (size_t i = 0; i < n; ++i) {
+            ap[i] = alphaIn[b + i].load() + priorAlphas[b + i];
+          }
+          salmon::math::expDigamma(ap, n, logNorm, ::digammaMin, ap);
+          for (size_t i = 0; i < n; ++i) {
+            expTheta[b + i] = ap[i];
+          }
+        }
+      });
 
-          uint64_t count = kv.second.count;
-          // for each transcript in this class
-          const TranscriptGroup& tgroup = kv.first;
-          if (tgroup.valid) {
-            const std::vector<uint32_t>& txps = tgroup.txps;
-            const auto& auxs = kv.second.combinedWeights;
+  accumulator.update(expTheta, alphaOut);
+}
 
-            double denom = 0.0;
-            size_t groupSize = kv.second.weights.size(); // txps.size();
-            // If this is a single-transcript group,
-            // then it gets the full count.  Otherwise,
-            // update according to our VBEM rule.
-            if (BOOST_LIKELY(groupSize > 1)) {
-              for (size_t i = 0; i < groupSize; ++i) {
-                auto tid = txps[i];
-                auto aux = auxs[i];
-                if (expTheta[tid] > 0.0) {
-                  double v = expTheta[tid] * aux;
-                  denom += v;
-                }
-              }
-              if (denom <= ::minEQClassWeight) {
-                // tgroup.setValid(false);
-              } else {
-                double invDenom = count / denom;
-                for (size_t i = 0; i < groupSize; ++i) {
-                  auto tid = txps[i];
-                  auto aux = auxs[i];
-                  if (expTheta[tid] > 0.0) {
-                    double v = expTheta[tid] * aux;
-                    salmon::utils::incLoop(alphaOut[tid], v * invDenom);
-                  }
-                }
-              }
+/**
+ * Accelerates the EM (or VBEM) with SQUAREM [1], using the update as the
+ * base map F.  From the current abundances theta0, each step takes two
+ * plain updates, theta1 = F(theta0) and theta2 = F(theta1), extrapolates
+ * along r = theta1 - theta0 and v = (theta2 - theta1) - r to
+ *
+ *   theta' = max(floor, theta0 + 2 s r + s^2 v),  s = |r| / |v|
+ *
+ * (s = 1 gives theta2 back), where the floor is min(theta2, minAbundance),
+ * so that no abundance still positive in theta2 is zeroed, and stabilizes
+ * the result with one more update, F(theta').  If that doesn't improve the
+ * log-likelihood over theta0, the step falls back to theta2, and the bound
+ * on s is pulled back in; each step that makes full use of the bound grows
+ * it.  The stepper works on either kind of abundance vector, so it serves
+ * both the parallel and the serial updates.
+ *
+ * [1] Simple and globally convergent methods for accelerating the
+ * convergence of any EM algorithm.  Varadhan R and Roland C.  Scandinavian
+ * Journal of Statistics, 2008; 35(2):335-353.
+ */
+template <typename VecT> class SquaremStepper {
+public:
+  explicit SquaremStepper(size_t numTranscripts)
+      : theta1_(numTranscripts, 0.0), theta2_(numTranscripts, 0.0),
+        thetaExt_(numTranscripts, 0.0) {}
+
+  /**
+   * Write the abundances following alphaIn to alphaOut, updating with
+   * update(in, out) and scoring the estimates with logLikelihood(alpha);
+   * returns the number of updates taken.
+   */
+  template <typename UpdateFn, typename LogLikelihoodFn>
+  size_t step(UpdateFn& update, LogLikelihoodFn& logLikelihood,
+              const VecT& alphaIn, VecT& alphaOut) {
+    size_t M = alphaIn.size();
+    if (!haveLogLikelihood_) {
+      logLikelihood_ = logLikelihood(alphaIn);
+      haveLogLikelihood_ = true;
+    }
 
-            } else {
-              salmon::utils::incLoop(alphaOut[txps.front()], count);
-            }
-          }
+    update(alphaIn, theta1_);
+    update(theta1_, theta2_);
+
+    double rr{0.0};
+    double vv{0.0};
+    for (size_t i = 0; i < M; ++i) {
+      double r = theta1_[i] - alphaIn[i];
+      double v = (theta2_[i] - theta1_[i]) - r;
+      rr += r * r;
+      vv += v * v;
+    }
+
+    size_t numUpdates{2};
+    double s = (vv > 0.0) ? std::sqrt(rr / vv) : 1.0;
+    s = std::max(minStep, std::min(stepMax_, s));
+    if (std::isfinite(s)) {
+      for (size_t i = 0; i < M; ++i) {
+        double a = alphaIn[i];
+        double r = theta1_[i] - a;
+        double v = (theta2_[i] - theta1_[i]) - r;
+        // (an abundance of 0 would stay 0 in every later update, so those
+        // still positive in theta2 are kept from reaching it)
+        double floor = std::min<double>(theta2_[i], minAbundance);
+        thetaExt_[i] = std::max(floor, a + 2.0 * s * r + s * s * v);
+      }
+      update(thetaExt_, alphaOut);
+      ++numUpdates;
+      double ll = logLikelihood(alphaOut);
+      if (std::isfinite(ll) and ll >= logLikelihood_) {
+        logLikelihood_ = ll;
+        if (s == stepMax_) {
+          stepMax_ *= stepFactor;
         }
-      });
+        return numUpdates;
+      }
+      // The extrapolation overshot; use the plain updates instead
+      if (s == stepMax_) {
+        stepMax_ = std::max(minStep, stepMax_ / stepFactor);
+      }
+    }
+
+    for (size_t i = 0; i < M; ++i) {
+      double t = theta2_[i];
+      alphaOut[i] = t;
+    }
+    logLikelihood_ = logLikelihood(alphaOut);
+    return numUpdates;
+  }
+
+private:
+  static constexpr double minStep = 1.0;
+  static constexpr double stepFactor = 4.0;
+  // The smallest abundance an extrapolation can leave a transcript with
+  static constexpr double minAbundance = 1e-8;
+
+  VecT theta1_;
+  VecT theta2_;
+  VecT thetaExt_;
+  double stepMax_{1.0};
+  double logLikelihood_{0.0};
+  bool haveLogLikelihood_{false};
+};
+
+template <typename VecT> constexpr double SquaremStepper<VecT>::minStep;
+template <typename VecT> constexpr double SquaremStepper<VecT>::stepFactor;
+template <typename VecT> constexpr double SquaremStepper<VecT>::minAbundance;
+
+/**
+ * The log-likelihood of the (valid) classes under the abundances alpha, as
+ * AbundanceAccumulator::logLikelihood() computes it, but on this thread.
+ */
+template <typename VecT>
+double logLikelihood_(const EquivalenceClassCSR& eqClasses,
+                      const VecT& alpha) {
+  double ll{0.0};
+  double totalCount{0.0};
+  for (size_t eqID = 0; eqID < eqClasses.size(); ++eqID) {
+    if (!eqClasses.valid(eqID)) {
+      continue;
+    }
+    const uint32_t* txps = eqClasses.txps(eqID);
+    const double* auxs = eqClasses.combinedWeights(eqID);
+    size_t groupSize = eqClasses.classSize(eqID);
+    double denom = 0.0;
+    for (size_t i = 0; i < groupSize; ++i) {
+      denom += alpha[txps[i]] * auxs[i];
+    }
+    double count = eqClasses.count(eqID);
+    ll += count * std::log(denom);
+    totalCount += count;
+  }
+  double alphaSum{0.0};
+  for (size_t t = 0; t < alpha.size(); ++t) {
+    alphaSum += alpha[t];
+  }
+  return ll - totalCount * std::log(alphaSum);
+}
+
+/**
+ * Take one round of the EM (or VBEM) over the classes of accumulator, from
+ * alphaIn to alphaOut, accelerated with SQUAREM if squarem isn't null;
+ * returns the number of updates taken.
+ */
+size_t updateRound_(AbundanceAccumulator& accumulator,
+                    SquaremStepper<CollapsedEMOptimizer::VecType>* squarem,
+                    bool useVBEM, std::vector<Transcript>& transcripts,
+                    std::vector<double>& priorAlphas, double totalLen,
+                    const CollapsedEMOptimizer::VecType& alphaIn,
+                    CollapsedEMOptimizer::VecType& alphaOut,
+                    CollapsedEMOptimizer::VecType& expTheta) {
+  auto update = [&](const CollapsedEMOptimizer::VecType& in,
+                    CollapsedEMOptimizer::VecType& out) -> void {
+    if (useVBEM) {
+      VBEMUpdate_(accumulator, transcripts, priorAlphas, totalLen, in, out,
+                  expTheta);
+    } else {
+      EMUpdate_(accumulator, transcripts, priorAlphas, in, out);
+    }
+  };
+  if (squarem) {
+    auto logLikelihood =
+        [&accumulator](const CollapsedEMOptimizer::VecType& alpha) -> double {
+      return accumulator.logLikelihood(alpha);
+    };
+    return squarem->step(update, logLikelihood, alphaIn, alphaOut);
+  }
+  update(alphaIn, alphaOut);
+  return 1;
 }
 
-template <typename VecT, typename EQVecT>
+template <typename VecT>
 size_t markDegenerateClasses(
-    EQVecT& eqVec,
+    EquivalenceClassCSR& eqClasses,
     VecT& alphaIn, Eigen::VectorXd& effLens, std::vector<bool>& available,
     std::shared_ptr<spdlog::logger> jointLog, bool verbose = false) {
 
   size_t numDropped{0};
-  size_t idx{0};
-  for (auto& kv : eqVec) {
-    uint64_t count = kv.second.count;
+  for (size_t eqID = 0; eqID < eqClasses.size(); ++eqID) {
+    uint64_t count = eqClasses.count(eqID);
     // for each transcript in this class
-    const TranscriptGroup& tgroup = kv.first;
-    const std::vector<uint32_t>& txps = tgroup.txps;
-    const auto& auxs = kv.second.combinedWeights;
+    const uint32_t* txps = eqClasses.txps(eqID);
+    const double* auxs = eqClasses.combinedWeights(eqID);
 
     double denom = 0.0;
-    size_t groupSize = kv.second.weights.size();
+    size_t groupSize = eqClasses.classSize(eqID);
     for (size_t i = 0; i < groupSize; ++i) {
       auto tid = txps[i];
       auto aux = auxs[i];
@@ -358,18 +661,18 @@ size_t markDegenerateClasses(
 
       errstream << "denom = 0, count = " << count << "\n";
       errstream << "class = { ";
-      for (auto e : txps) {
-        errstream << e << " ";
+      for (size_t i = 0; i < groupSize; ++i) {
+        errstream << txps[i] << " ";
       }
       errstream << "}\n";
       errstream << "alphas = { ";
-      for (auto e : txps) {
-        errstream << alphaIn[e] << " ";
+      for (size_t i = 0; i < groupSize; ++i) {
+        errstream << alphaIn[txps[i]] << " ";
       }
       errstream << "}\n";
       errstream << "weights = { ";
-      for (auto e : auxs) {
-        errstream << e << " ";
+      for (size_t i = 0; i < groupSize; ++i) {
+        errstream << auxs[i] << " ";
       }
       errstream << "}\n";
       errstream << "============================\n\n";
@@ -379,7 +682,7 @@ size_t markDegenerateClasses(
         jointLog->info(errstream.str());
       }
       ++numDropped;
-      kv.first.setValid(false);
+      eqClasses.setValid(eqID, false);
     } else {
       for (size_t i = 0; i < groupSize; ++i) {
         auto tid = txps[i];
@@ -390,13 +693,141 @@ size_t markDegenerateClasses(
   return numDropped;
 }
 
+/**
+ * The connected components of the transcripts, linked by the valid classes
+ * that contain them.  No class spans two components, so the EM (or VBEM)
+ * update of one component doesn't depend on the abundances of any other,
+ * and each component can be iterated to its own convergence.
+ */
+struct EqClassComponents {
+  // The transcripts of component k are txps[txpOffsets[k], txpOffsets[k+1])
+  std::vector<uint32_t> txpOffsets;
+  std::vector<uint32_t> txps;
+  // and its valid classes (in the order of the eqClasses) are
+  // classes[classOffsets[k], classOffsets[k+1])
+  std::vector<uint64_t> classOffsets;
+  std::vector<uint64_t> classes;
+  // the number of (class, transcript) entries of each component
+  std::vector<uint64_t> numEntries;
+  // the index of each transcript within its component
+  std::vector<uint32_t> localIDs;
+
+  size_t size() const { return numEntries.size(); }
+};
+
+EqClassComponents findComponents(const EquivalenceClassCSR& eqClasses,
+                                 size_t numTranscripts) {
+  // union-find, with the smallest transcript of each set as its root
+  std::vector<uint32_t> parent(numTranscripts);
+  for (size_t t = 0; t < numTranscripts; ++t) {
+    parent[t] = static_cast<uint32_t>(t);
+  }
+  auto find = [&parent](uint32_t t) -> uint32_t {
+    while (parent[t] != t) {
+      parent[t] = parent[parent[t]];
+      t = parent[t];
+    }
+    return t;
+  };
+  size_t numClasses = eqClasses.size();
+  for (size_t eqID = 0; eqID < numClasses; ++eqID) {
+    if (!eqClasses.valid(eqID)) {
+      continue;
+    }
+    const uint32_t* txps = eqClasses.txps(eqID);
+    size_t groupSize = eqClasses.classSize(eqID);
+    for (size_t i = 1; i < groupSize; ++i) {
+      uint32_t a = find(txps[0]);
+      uint32_t b = find(txps[i]);
+      if (a != b) {
+        parent[std::max(a, b)] = std::min(a, b);
+      }
+    }
+  }
+
+  EqClassComponents comps;
+  // number the components, and lay out their transcripts
+  std::vector<uint32_t> componentOf(numTranscripts);
+  size_t numComponents{0};
+  for (size_t t = 0; t < numTranscripts; ++t) {
+    uint32_t root = find(static_cast<uint32_t>(t));
+    componentOf[t] = (root == t) ? numComponents++ : componentOf[root];
+  }
+  comps.txpOffsets.assign(numComponents + 1, 0);
+  for (size_t t = 0; t < numTranscripts; ++t) {
+    ++comps.txpOffsets[componentOf[t] + 1];
+  }
+  for (size_t k = 0; k < numComponents; ++k) {
+    comps.txpOffsets[k + 1] += comps.txpOffsets[k];
+  }
+  comps.txps.resize(numTranscripts);
+  comps.localIDs.resize(numTranscripts);
+  std::vector<uint32_t> nextTxp(comps.txpOffsets.begin(),
+                                comps.txpOffsets.end() - 1);
+  for (size_t t = 0; t < numTranscripts; ++t) {
+    auto k = componentOf[t];
+    comps.localIDs[t] = nextTxp[k] - comps.txpOffsets[k];
+    comps.txps[nextTxp[k]++] = static_cast<uint32_t>(t);
+  }
+
+  // and their classes
+  comps.classOffsets.assign(numComponents + 1, 0);
+  comps.numEntries.assign(numComponents, 0);
+  for (size_t eqID = 0; eqID < numClasses; ++eqID) {
+    if (eqClasses.valid(eqID)) {
+      auto k = componentOf[eqClasses.txps(eqID)[0]];
+      ++comps.classOffsets[k + 1];
+      comps.numEntries[k] += eqClasses.classSize(eqID);
+    }
+  }
+  for (size_t k = 0; k < numComponents; ++k) {
+    comps.classOffsets[k + 1] += comps.classOffsets[k];
+  }
+  comps.classes.resize(comps.classOffsets.back());
+  std::vector<uint64_t> nextClass(comps.classOffsets.begin(),
+                                  comps.classOffsets.end() - 1);
+  for (size_t eqID = 0; eqID < numClasses; ++eqID) {
+    if (eqClasses.valid(eqID)) {
+      auto k = componentOf[eqClasses.txps(eqID)[0]];
+      comps.classes[nextClass[k]++] = eqID;
+    }
+  }
+  return comps;
+}
+
+/**
+ * Move the abundances of alphasPrime to alphas (zeroing alphasPrime), and
+ * return whether none of those above alphaCheckCutoff changed (relative to
+ * its new value) by more than relDiffTolerance; the largest such change is
+ * written to maxRelDiff.
+ */
+template <typename VecT>
+bool checkConvergence_(VecT& alphas, VecT& alphasPrime,
+                       double alphaCheckCutoff, double relDiffTolerance,
+                       double& maxRelDiff) {
+  bool converged = true;
+  maxRelDiff = -std::numeric_limits<double>::max();
+  for (size_t i = 0; i < alphas.size(); ++i) {
+    if (alphasPrime[i] > alphaCheckCutoff) {
+      double relDiff = std::abs(alphas[i] - alphasPrime[i]) / alphasPrime[i];
+      maxRelDiff = (relDiff > maxRelDiff) ? relDiff : maxRelDiff;
+      if (relDiff > relDiffTolerance) {
+        converged = false;
+      }
+    }
+    alphas[i] = alphasPrime[i];
+    alphasPrime[i] = 0.0;
+  }
+  return converged;
+}
+
 CollapsedEMOptimizer::CollapsedEMOptimizer() {}
 
 bool doBootstrap(
-    std::vector<std::vector<uint32_t>>& txpGroups,
-    std::vector<std::vector<double>>& txpGroupCombinedWeights,
+    const EquivalenceClassCSR& eqClasses,
     std::vector<Transcript>& transcripts, Eigen::VectorXd& effLens,
-    const std::vector<double>& sampleWeights, std::vector<uint64_t>& origCounts,
+    const std::vector<double>& sampleWeights,
+    const std::vector<uint64_t>& origCounts,
     uint64_t totalNumFrags,
     uint64_t numMappedFrags, double uniformTxpWeight,
     std::atomic<uint32_t>& bsNum, SalmonOpts& sopt,
@@ -410,7 +841,7 @@ bool doBootstrap(
   // Determine up front if we're going to use scaled counts.
   bool useScaledCounts = !(sopt.useQuasi or sopt.allowOrphans);
   bool useVBEM{sopt.useVBOpt};
-  size_t numClasses = txpGroups.size();
+  size_t numClasses = eqClasses.size();
   CollapsedEMOptimizer::SerialVecType alphas(transcripts.size(), 0.0);
   CollapsedEMOptimizer::SerialVecType alphasPrime(transcripts.size(), 0.0);
   CollapsedEMOptimizer::SerialVecType expTheta(transcripts.size(), 0.0);
@@ -461,11 +892,10 @@ bool doBootstrap(
     while (itNum < minIter or (itNum < maxIter and !converged)) {
 
       if (useVBEM) {
-        VBEMUpdate_(txpGroups, txpGroupCombinedWeights, sampCounts, transcripts,
-                    priorAlphas, totalLen, alphas, alphasPrime, expTheta);
+        VBEMUpdate_(eqClasses, sampCounts, transcripts, priorAlphas, totalLen,
+                    alphas, alphasPrime, expTheta);
       } else {
-        EMUpdate_(txpGroups, txpGroupCombinedWeights, sampCounts, transcripts,
-                  alphas, alphasPrime);
+        EMUpdate_(eqClasses, sampCounts, transcripts, alphas, alphasPrime);
       }
 
       converged = true;
@@ -490,11 +920,10 @@ bool doBootstrap(
     // counts
     if (sopt.bootstrapReproject) {
       if (useVBEM) {
-        VBEMUpdate_(txpGroups, txpGroupCombinedWeights, origCounts, transcripts,
-                    priorAlphas, totalLen, alphas, alphasPrime, expTheta);
+        VBEMUpdate_(eqClasses, origCounts, transcripts, priorAlphas, totalLen,
+                    alphas, alphasPrime, expTheta);
       } else {
-        EMUpdate_(txpGroups, txpGroupCombinedWeights, origCounts, transcripts,
-                  alphas, alphasPrime);
+        EMUpdate_(eqClasses, origCounts, transcripts, alphas, alphasPrime);
       }
     }
 
@@ -567,15 +996,14 @@ bool CollapsedEMOptimizer::gatherBootstraps(
 
   uint32_t numBootstraps = sopt.numBootstraps;
 
-  auto& eqVec =
-      readExp.equivalenceClassBuilder().eqVec();
+  auto& eqClasses = readExp.equivalenceClassBuilder().eqClasses();
 
   std::unordered_set<uint32_t> activeTranscriptIDs;
-  for (auto& kv : eqVec) {
-    auto& tg = kv.first;
-    for (auto& t : tg.txps) {
-      transcripts[t].setActive();
-      activeTranscriptIDs.insert(t);
+  for (size_t eqID = 0; eqID < eqClasses.size(); ++eqID) {
+    const uint32_t* txps = eqClasses.txps(eqID);
+    for (size_t i = 0; i < eqClasses.classSize(eqID); ++i) {
+      transcripts[txps[i]].setActive();
+      activeTranscriptIDs.insert(txps[i]);
     }
   }
 
@@ -586,7 +1014,7 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   auto jointLog = sopt.jointLog;
 
   jointLog->info("Will draw {} bootstrap samples", numBootstraps);
-  jointLog->info("Optimizing over {} equivalence classes", eqVec.size());
+  jointLog->info("Optimizing over {} equivalence classes", eqClasses.size());
 
   double totalNumFrags{static_cast<double>(numMappedFrags)};
   double totalLen{0.0};
@@ -611,8 +1039,8 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   std::vector<double> priorAlphas = populatePriorAlphas_(
       transcripts, effLens, priorValue, perTranscriptPrior);
 
-  auto numRemoved =
-      markDegenerateClasses(eqVec, alphas, effLens, available, sopt.jointLog);
+  auto numRemoved = markDegenerateClasses(eqClasses, alphas, effLens,
+                                          available, sopt.jointLog);
   sopt.jointLog->info("Marked {} weighted equivalence classes as degenerate",
                       numRemoved);
 
@@ -622,35 +1050,24 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   double minAlpha = 1e-8;
   double cutoff = minAlpha;
 
-  // Since we will use the same weights and transcript groups for each
-  // of the bootstrap samples (only the count vector will change), it
-  // makes sense to keep only one copy of these.
-  using TGroupLabelT = std::vector<uint32_t>;
-  using TGroupWeightVec = std::vector<double>;
-  std::vector<TGroupLabelT> txpGroups;
-  std::vector<TGroupWeightVec> txpGroupCombinedWeights;
-  std::vector<uint64_t> origCounts;
+  // The same weights and transcript groups are used for each of the
+  // bootstrap samples (only the count vector will change), so they are
+  // shared, as they are, by all of the bootstrap threads.  The degenerate
+  // classes are skipped by the updates, and are never sampled.
+  const std::vector<uint64_t>& origCounts = eqClasses.counts();
   uint64_t totalCount{0};
-
-  for (auto& kv : eqVec) {
-    uint64_t count = kv.second.count;
-    // for each transcript in this class
-    const TranscriptGroup& tgroup = kv.first;
-    if (tgroup.valid) {
-      const std::vector<uint32_t>& txps = tgroup.txps;
-      const auto& auxs = kv.second.combinedWeights;
-      txpGroups.push_back(txps);
-      // Convert to non-atomic
-      txpGroupCombinedWeights.emplace_back(auxs.begin(), auxs.end());
-      origCounts.push_back(count);
-      totalCount += count;
+  for (size_t eqID = 0; eqID < eqClasses.size(); ++eqID) {
+    if (eqClasses.valid(eqID)) {
+      totalCount += origCounts[eqID];
     }
   }
 
   double floatCount = totalCount;
-  std::vector<double> samplingWeights(txpGroups.size(), 0.0);
+  std::vector<double> samplingWeights(eqClasses.size(), 0.0);
   for (size_t i = 0; i < origCounts.size(); ++i) {
-    samplingWeights[i] = origCounts[i] / floatCount;
+    if (eqClasses.valid(i)) {
+      samplingWeights[i] = origCounts[i] / floatCount;
+    }
   }
 
   size_t numWorkerThreads{1};
@@ -662,8 +1079,8 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   std::vector<std::thread> workerThreads;
   for (size_t tn = 0; tn < numWorkerThreads; ++tn) {
     workerThreads.emplace_back(
-        doBootstrap, std::ref(txpGroups), std::ref(txpGroupCombinedWeights),
-        std::ref(transcripts), std::ref(effLens), std::ref(samplingWeights), std::ref(origCounts),
+        doBootstrap, std::cref(eqClasses),
+        std::ref(transcripts), std::ref(effLens), std::ref(samplingWeights), std::cref(origCounts),
         totalCount, numMappedFrags, scale, std::ref(bsCounter), std::ref(sopt),
         std::ref(priorAlphas), std::ref(writeBootstrap), relDiffTolerance,
         maxIter);
@@ -675,37 +1092,35 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   return true;
 }
 
-template <typename EQVecT>
 void updateEqClassWeights(
-    EQVecT& eqVec,
+    EquivalenceClassCSR& eqClasses,
     Eigen::VectorXd& effLens) {
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &effLens](const BlockedIndexRange& range) -> void {
-        // For each index in the equivalence class vector
+      BlockedIndexRange(size_t(0), size_t(eqClasses.size())),
+      [&eqClasses, &effLens](const BlockedIndexRange& range) -> void {
+        // For each equivalence class
         for (auto eqID : boost::irange(range.begin(), range.end())) {
-          // The vector entry
-          auto& kv = eqVec[eqID];
           // The label of the equivalence class
-          const TranscriptGroup& k = kv.first;
+          const uint32_t* txps = eqClasses.txps(eqID);
           // The size of the label
-          size_t classSize = kv.second.weights.size(); // k.txps.size();
+          size_t classSize = eqClasses.classSize(eqID);
           // The weights of the label
-          auto& v = kv.second;
+          const double* weights = eqClasses.weights(eqID);
+          double* combinedWeights = eqClasses.combinedWeights(eqID);
+          uint64_t count = eqClasses.count(eqID);
 
           // Iterate over each weight and set it equal to
           // 1 / effLen of the corresponding transcript
           double wsum{0.0};
           for (size_t i = 0; i < classSize; ++i) {
-            auto tid = k.txps[i];
+            auto tid = txps[i];
             auto probStartPos = 1.0 / effLens(tid);
-            v.combinedWeights[i] =
-                kv.second.count * (v.weights[i] * probStartPos);
-            wsum += v.combinedWeights[i];
+            combinedWeights[i] = count * (weights[i] * probStartPos);
+            wsum += combinedWeights[i];
           }
           double wnorm = 1.0 / wsum;
           for (size_t i = 0; i < classSize; ++i) {
-            v.combinedWeights[i] *= wnorm;
+            combinedWeights[i] *= wnorm;
           }
         }
       });
@@ -736,8 +1151,7 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
 
   Eigen::VectorXd effLens(transcripts.size());
 
-  auto& eqVec =
-      readExp.equivalenceClassBuilder().eqVec();
+  auto& eqClasses = readExp.equivalenceClassBuilder().eqClasses();
 
   bool noRichEq = sopt.noRichEqClasses;
   bool useFSPD{sopt.useFSPD};
@@ -814,49 +1228,49 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
   // the effective length).  Otherwise, multiply the existing weight terms
   // by the effective length term.
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &effLens, noRichEq](const BlockedIndexRange& range) -> void {
-        // For each index in the equivalence class vector
+      BlockedIndexRange(size_t(0), size_t(eqClasses.size())),
+      [&eqClasses, &effLens, noRichEq](const BlockedIndexRange& range) -> void {
+        // For each equivalence class
         for (auto eqID : boost::irange(range.begin(), range.end())) {
-          // The vector entry
-          auto& kv = eqVec[eqID];
           // The label of the equivalence class
-          const TranscriptGroup& k = kv.first;
+          const uint32_t* txps = eqClasses.txps(eqID);
           // The size of the label
-          size_t classSize = kv.second.weights.size(); // k.txps.size();
+          size_t classSize = eqClasses.classSize(eqID);
           // The weights of the label
-          auto& v = kv.second;
+          double* weights = eqClasses.weights(eqID);
+          double* combinedWeights = eqClasses.combinedWeights(eqID);
+          uint64_t count = eqClasses.count(eqID);
 
           // Iterate over each weight and set it
           double wsum{0.0};
 
           for (size_t i = 0; i < classSize; ++i) {
-            auto tid = k.txps[i];
+            auto tid = txps[i];
             double el = effLens(tid);
             if (el <= 1.0) {
               el = 1.0;
             }
             if (noRichEq) {
               // Keep length factor separate for the time being
-              v.weights[i] = 1.0;
+              weights[i] = 1.0;
             }
             // meaningful values.
             auto probStartPos = 1.0 / el;
 
             // combined weight
-            v.combinedWeights.push_back(v.count * v.weights[i] * probStartPos);
-            wsum += v.combinedWeights.back();
+            combinedWeights[i] = count * weights[i] * probStartPos;
+            wsum += combinedWeights[i];
           }
 
           double wnorm = 1.0 / wsum;
           for (size_t i = 0; i < classSize; ++i) {
-            v.combinedWeights[i] = v.combinedWeights[i] * wnorm;
+            combinedWeights[i] = combinedWeights[i] * wnorm;
           }
         }
       });
 
-  auto numRemoved =
-      markDegenerateClasses(eqVec, alphas, effLens, available, sopt.jointLog);
+  auto numRemoved = markDegenerateClasses(eqClasses, alphas, effLens,
+                                          available, sopt.jointLog);
   sopt.jointLog->info("Marked {} weighted equivalence classes as degenerate",
                       numRemoved);
 
@@ -880,88 +1294,231 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
   double alphaSum = 0.0;
   */
 
-  while (itNum < minIter or (itNum < maxIter and !converged) or needBias) {
-    if (needBias and (itNum > targetIt or converged)) {
+  // Until the effective lengths have been adjusted for the biases, iterate
+  // over all of the classes at once.
+  if (needBias) {
+    AbundanceAccumulator accumulator(eqClasses, transcripts.size(),
+                                     sopt.numThreads);
+    std::unique_ptr<SquaremStepper<VecType>> squarem{nullptr};
+    if (sopt.useSquarem) {
+      squarem.reset(new SquaremStepper<VecType>(transcripts.size()));
+    }
 
-      jointLog->info(
-          "iteration {}, adjusting effective lengths to account for biases",
-          itNum);
-      effLens = salmon::utils::updateEffectiveLengths(sopt, readExp, effLens,
-                                                      alphas, available, true);
-      // if we're doing the VB optimization, update the priors
-      if (useVBEM) {
-        priorAlphas = populatePriorAlphas_(transcripts, effLens, priorValue,
-                                           perTranscriptPrior);
-      }
+    while (needBias) {
+      if (itNum > targetIt or converged) {
+        jointLog->info(
+            "iteration {}, adjusting effective lengths to account for biases",
+            itNum);
+        effLens = salmon::utils::updateEffectiveLengths(
+            sopt, readExp, effLens, alphas, available, true);
+        // if we're doing the VB optimization, update the priors
+        if (useVBEM) {
+          priorAlphas = populatePriorAlphas_(transcripts, effLens, priorValue,
+                                             perTranscriptPrior);
+        }
 
-      // Check for strangeness with the lengths.
-      for (int32_t i = 0; i < effLens.size(); ++i) {
-        if (effLens(i) <= 0.0) {
-          jointLog->warn("Transcript {} had length {}", i, effLens(i));
+        // Check for strangeness with the lengths.
+        for (int32_t i = 0; i < effLens.size(); ++i) {
+          if (effLens(i) <= 0.0) {
+            jointLog->warn("Transcript {} had length {}", i, effLens(i));
+          }
         }
+        updateEqClassWeights(eqClasses, effLens);
+        needBias = false;
+        break;
       }
-      updateEqClassWeights(eqVec, effLens);
-      needBias = false;
-    }
 
-    if (useVBEM) {
-      VBEMUpdate_(eqVec, transcripts, priorAlphas, totalLen, alphas,
-                  alphasPrime, expTheta);
-    } else {
-      /*
-      if (itNum > 0 and (itNum % 250 == 0)) {
-        for (size_t i = 0; i < transcripts.size(); ++i) {
-      	  if (alphas[i] < 1.0) { alphas[i] = 0.0; }
-      	}
+      // (the number of updates taken in this round)
+      size_t numUpdates =
+          updateRound_(accumulator, squarem.get(), useVBEM, transcripts,
+                       priorAlphas, totalLen, alphas, alphasPrime, expTheta);
+      converged = checkConvergence_(alphas, alphasPrime, alphaCheckCutoff,
+                                    relDiffTolerance, maxRelDiff);
+
+      // (if one of this round's updates was a multiple of 100)
+      if ((itNum + numUpdates - 1) / 100 * 100 >= itNum) {
+        jointLog->info("iteration = {} | max rel diff. = {}", itNum,
+                       maxRelDiff);
       }
-      */
-      EMUpdate_(eqVec, transcripts, priorAlphas, alphas, alphasPrime);
+
+      itNum += numUpdates;
     }
+  }
 
-    converged = true;
-    maxRelDiff = -std::numeric_limits<double>::max();
-    for (size_t i = 0; i < transcripts.size(); ++i) {
-      if (alphasPrime[i] > alphaCheckCutoff) {
-        double relDiff = std::abs(alphas[i] - alphasPrime[i]) / alphasPrime[i];
-        maxRelDiff = (relDiff > maxRelDiff) ? relDiff : maxRelDiff;
-        if (relDiff > relDiffTolerance) {
-          converged = false;
-        }
-      }
-      alphas[i] = alphasPrime[i];
-      alphasPrime[i] = 0.0;
+  // Then iterate each connected component of the classes until it has
+  // converged on its own: the large components one after another, with the
+  // parallel update, and the rest many at once, each with the serial update.
+  auto components = findComponents(eqClasses, transcripts.size());
+  size_t numComponents = components.size();
+  std::vector<size_t> componentIts(numComponents, itNum);
+  std::vector<double> componentRelDiffs(
+      numComponents, -std::numeric_limits<double>::max());
+  std::vector<size_t> largeComponents;
+  std::vector<size_t> smallComponents;
+  for (size_t k = 0; k < numComponents; ++k) {
+    if (components.numEntries[k] > maxSerialComponentEntries) {
+      largeComponents.push_back(k);
+    } else {
+      smallComponents.push_back(k);
+    }
+  }
+  // (largest first, so that the last of the tasks are the quickest)
+  std::sort(smallComponents.begin(), smallComponents.end(),
+            [&components](size_t a, size_t b) -> bool {
+              return components.numEntries[a] > components.numEntries[b];
+            });
+
+  for (auto k : largeComponents) {
+    const uint32_t* txps = &components.txps[components.txpOffsets[k]];
+    size_t numTxps = components.txpOffsets[k + 1] - components.txpOffsets[k];
+    EquivalenceClassCSR localClasses;
+    localClasses.buildSubset(
+        eqClasses, components.classes.begin() + components.classOffsets[k],
+        components.classes.begin() + components.classOffsets[k + 1],
+        components.localIDs);
+
+    AbundanceAccumulator accumulator(localClasses, numTxps, sopt.numThreads);
+    std::unique_ptr<SquaremStepper<VecType>> squarem{nullptr};
+    if (sopt.useSquarem) {
+      squarem.reset(new SquaremStepper<VecType>(numTxps));
+    }
+    VecType localAlphas(numTxps, 0.0);
+    VecType localAlphasPrime(numTxps, 0.0);
+    VecType localExpTheta(numTxps);
+    std::vector<double> localPriors(numTxps);
+    for (size_t i = 0; i < numTxps; ++i) {
+      localAlphas[i] = alphas[txps[i]].load();
+      localPriors[i] = priorAlphas[txps[i]];
     }
 
-    /* -- v0.8.x
-    if (converged and itNum > minIter and !needBias) {
-      if (useVBEM and !perTranscriptPrior) {
-        std::vector<double> cutoffs(transcripts.size(), 0.0);
-        for (size_t i = 0; i < transcripts.size(); ++i) {
-          cutoffs[i] = minAlpha;
-        }
-        alphaSum = truncateCountVector(alphas, cutoffs);
-      } else {
-        // Truncate tiny expression values
-        alphaSum = truncateCountVector(alphas, cutoff);
-      }
-      if (useVBEM) {
-        VBEMUpdate_(eqVec, transcripts, priorAlphas, totalLen, alphas,
-    alphasPrime, expTheta); } else { EMUpdate_(eqVec, transcripts, alphas,
-    alphasPrime);
-      }
-      for (size_t i = 0; i < transcripts.size(); ++i) {
-        alphas[i] = alphasPrime[i];
-        alphasPrime[i] = 0.0;
+    jointLog->info("iterating over a component of {} transcripts and {} "
+                   "equivalence classes",
+                   numTxps, localClasses.size());
+    size_t localIt{itNum};
+    bool localConverged{false};
+    double localRelDiff = -std::numeric_limits<double>::max();
+    while (localIt < minIter or (localIt < maxIter and !localConverged)) {
+      size_t numUpdates = updateRound_(
+          accumulator, squarem.get(), useVBEM, transcripts, localPriors,
+          totalLen, localAlphas, localAlphasPrime, localExpTheta);
+      localConverged =
+          checkConvergence_(localAlphas, localAlphasPrime, alphaCheckCutoff,
+                            relDiffTolerance, localRelDiff);
+      if ((localIt + numUpdates - 1) / 100 * 100 >= localIt) {
+        jointLog->info("iteration = {} | max rel diff. = {}", localIt,
+                       localRelDiff);
       }
+      localIt += numUpdates;
     }
-    */
 
-    if (itNum % 100 == 0) {
-      jointLog->info("iteration = {} | max rel diff. = {}", itNum, maxRelDiff);
+    for (size_t i = 0; i < numTxps; ++i) {
+      alphas[txps[i]] = localAlphas[i].load();
     }
+    componentIts[k] = localIt;
+    componentRelDiffs[k] = localRelDiff;
+  }
+
+  tbb::parallel_for(
+      BlockedIndexRange(size_t(0), smallComponents.size()),
+      [&](const BlockedIndexRange& range) -> void {
+        for (auto j : boost::irange(range.begin(), range.end())) {
+          auto k = smallComponents[j];
+          const uint32_t* txps = &components.txps[components.txpOffsets[k]];
+          size_t numTxps =
+              components.txpOffsets[k + 1] - components.txpOffsets[k];
+          auto classBegin =
+              components.classes.begin() + components.classOffsets[k];
+          auto classEnd =
+              components.classes.begin() + components.classOffsets[k + 1];
+
+          // The classes of a lone transcript fix its abundance in one update
+          if (numTxps == 1) {
+            double count{0.0};
+            for (auto it = classBegin; it != classEnd; ++it) {
+              count += eqClasses.count(*it);
+            }
+            alphas[txps[0]] = count;
+            componentIts[k] = itNum + 1;
+            continue;
+          }
+
+          EquivalenceClassCSR localClasses;
+          localClasses.buildSubset(eqClasses, classBegin, classEnd,
+                                   components.localIDs);
+          std::vector<double> localAlphas(numTxps);
+          std::vector<double> localAlphasPrime(numTxps, 0.0);
+          std::vector<double> localExpTheta(numTxps);
+          std::vector<double> localPriors(numTxps);
+          for (size_t i = 0; i < numTxps; ++i) {
+            localAlphas[i] = alphas[txps[i]];
+            localPriors[i] = priorAlphas[txps[i]];
+          }
+
+          auto update = [&](const std::vector<double>& in,
+                            std::vector<double>& out) -> void {
+            if (useVBEM) {
+              VBEMUpdate_(localClasses, localClasses.counts(), transcripts,
+                          localPriors, totalLen, in, out, localExpTheta);
+            } else {
+              // (this one adds to out, rather than overwriting it)
+              std::fill(out.begin(), out.end(), 0.0);
+              EMUpdate_(localClasses, localClasses.counts(), transcripts, in,
+                        out);
+            }
+          };
+          auto logLikelihood =
+              [&localClasses](const std::vector<double>& alpha) -> double {
+            return logLikelihood_(localClasses, alpha);
+          };
+          std::unique_ptr<SquaremStepper<std::vector<double>>> squarem{
+              nullptr};
+          if (sopt.useSquarem) {
+            squarem.reset(new SquaremStepper<std::vector<double>>(numTxps));
+          }
+
+          size_t localIt{itNum};
+          bool localConverged{false};
+          double localRelDiff = -std::numeric_limits<double>::max();
+          while (localIt < minIter or
+                 (localIt < maxIter and !localConverged)) {
+            size_t numUpdates{1};
+            if (squarem) {
+              numUpdates = squarem->step(update, logLikelihood, localAlphas,
+                                         localAlphasPrime);
+            } else {
+              update(localAlphas, localAlphasPrime);
+            }
+            localConverged = checkConvergence_(
+                localAlphas, localAlphasPrime, alphaCheckCutoff,
+                relDiffTolerance, localRelDiff);
+            localIt += numUpdates;
+          }
+
+          for (size_t i = 0; i < numTxps; ++i) {
+            alphas[txps[i]] = localAlphas[i];
+          }
+          componentIts[k] = localIt;
+          componentRelDiffs[k] = localRelDiff;
+        }
+      });
 
-    ++itNum;
+  // The iterations reported are those of the slowest component
+  size_t classVisits{0};
+  size_t lastIt{itNum};
+  maxRelDiff = -std::numeric_limits<double>::max();
+  for (size_t k = 0; k < numComponents; ++k) {
+    size_t numClasses = components.classOffsets[k + 1] -
+                        components.classOffsets[k];
+    classVisits += (componentIts[k] - itNum) * numClasses;
+    lastIt = std::max(lastIt, componentIts[k]);
+    maxRelDiff = std::max(maxRelDiff, componentRelDiffs[k]);
   }
+  itNum = lastIt;
+  jointLog->info("Iterated over {} connected components of the equivalence "
+                 "classes separately ({} large ones one after another, and "
+                 "the other {} in parallel), with {} class visits in all",
+                 numComponents, largeComponents.size(),
+                 smallComponents.size(), classVisits);
 
   /* -- v0.8.x
   if (alphaSum < ::minWeight) {
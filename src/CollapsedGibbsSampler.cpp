@@ -30,6 +30,7 @@
 #include "AlignmentLibrary.hpp"
 #include "BootstrapWriter.hpp"
 #include "CollapsedGibbsSampler.hpp"
+#include "EquivalenceClassCSR.hpp"
 #include "MultinomialSampler.hpp"
 #include "ReadExperiment.hpp"
 #include "ReadPair.hpp"
@@ -89,14 +90,12 @@ divide_work(Iterator begin, Iterator end, std::size_t n) {
  *RNA-seq reads. Turro E, Su S-Y, Goncalves A, Coin L, Richardson S and Lewin A.
  * Genome Biology, 2011 Feb; 12:R13.  doi: 10.1186/gb-2011-12-2-r13.
  **/
-template <typename EQVecT>
 void sampleRoundNonCollapsedMultithreaded_(
-    EQVecT& eqVec,
+    EquivalenceClassCSR& eqClasses,
     std::vector<bool>& active, std::vector<uint32_t>& activeList,
     std::vector<uint64_t>& countMap, std::vector<double>& probMap,
     std::vector<double>& muGlobal, Eigen::VectorXd& effLens,
     const std::vector<double>& priorAlphas, std::vector<double>& txpCount,
-    std::vector<uint32_t>& offsetMap,
     bool noGammaDraw) {
 
   // generate coeff for \mu from \alpha and \effLens
@@ -169,26 +168,23 @@ void sampleRoundNonCollapsedMultithreaded_(
   std::mutex writeMut;
   // resample within each equivalence class
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
+      BlockedIndexRange(size_t(0), size_t(eqClasses.size())),
       [&](const BlockedIndexRange& range) -> void {
 
         auto& txpCountLoc = combineableCounts.local().txpCount;
         auto& gen = *(combineableCounts.local().gen.get());
         for (auto eqid : boost::irange(range.begin(), range.end())) {
-          auto& eqClass = eqVec[eqid];
-          size_t offset = offsetMap[eqid];
+          // where the information for this class begins in probMap
+          size_t offset = eqClasses.offset(eqid);
 
           // get total number of reads for an equivalence class
-          uint64_t classCount = eqClass.second.count;
+          uint64_t classCount = eqClasses.count(eqid);
 
           // for each transcript in this class
-          const TranscriptGroup& tgroup = eqClass.first;
-          const size_t groupSize =
-              eqClass.second.weights.size(); // tgroup.txps.size();
-          if (tgroup.valid) {
-            const std::vector<uint32_t>& txps = tgroup.txps;
-            const auto& auxs = eqClass.second.combinedWeights;
-            const auto& weights = eqClass.second.weights;
+          const size_t groupSize = eqClasses.classSize(eqid);
+          if (eqClasses.valid(eqid)) {
+            const uint32_t* txps = eqClasses.txps(eqid);
+            const double* weights = eqClasses.weights(eqid);
 
             double denom = 0.0;
             // If this is a single-transcript group,
@@ -314,8 +310,7 @@ bool CollapsedGibbsSampler::sample(
   // Fill in the effective length vector
   Eigen::VectorXd effLens(transcripts.size());
 
-  auto& eqVec =
-      readExp.equivalenceClassBuilder().eqVec();
+  auto& eqClasses = readExp.equivalenceClassBuilder().eqClasses();
 
   using VecT = CollapsedGibbsSampler::VecType;
 
@@ -353,17 +348,13 @@ bool CollapsedGibbsSampler::sample(
   **/
 
   std::vector<bool> active(numTranscripts, false);
-  size_t countMapSize{0};
-  std::vector<uint32_t> offsetMap(eqVec.size(), 0);
-  for (size_t i = 0; i < eqVec.size(); ++i) {
-    if (eqVec[i].first.valid) {
-      countMapSize +=
-          eqVec[i].second.weights.size(); // eqVec[i].first.txps.size();
-      for (auto t : eqVec[i].first.txps) {
-        active[t] = true;
-      }
-      if (i < eqVec.size() - 1) {
-        offsetMap[i + 1] = countMapSize;
+  // (the entries of each class are at the same offsets as in eqClasses)
+  size_t countMapSize{eqClasses.numEntries()};
+  for (size_t i = 0; i < eqClasses.size(); ++i) {
+    if (eqClasses.valid(i)) {
+      const uint32_t* txps = eqClasses.txps(i);
+      for (size_t j = 0; j < eqClasses.classSize(i); ++j) {
+        active[txps[j]] = true;
       }
     }
   }
@@ -439,7 +430,7 @@ bool CollapsedGibbsSampler::sample(
     // Thin the chain by a factor of (numInternalRounds)
     for (size_t i = 0; i < numInternalRounds; ++i) {
       sampleRoundNonCollapsedMultithreaded_(
-          eqVec,      // encodes equivalence classes
+          eqClasses,  // encodes equivalence classes
           active,     // the set of active transcripts
           activeList, // the list of active transcript ids
           countMap,   // the count of reads in each eq coming from each eq class
@@ -450,7 +441,6 @@ bool CollapsedGibbsSampler::sample(
           priorAlphas, // the prior transcript counts
           alphasIn, // [input/output param] the (hard) fragment counts per txp
                     // from the previous iteration
-          offsetMap, // where the information begins for each equivalence class
           sopt.noGammaDraw      // true if we should skip the Gamma draw, false otherwise
       );
     }
@@ -52,6 +52,54 @@ void EMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
   }
 }
 
+/**
+ * Single-threaded EM-update routine over flat equivalence classes, for use
+ * in bootstrapping
+ */
+template <typename VecT>
+void EMUpdate_(const EquivalenceClassCSR& eqClasses,
+               const std::vector<uint64_t>& counts,
+               std::vector<Transcript>& transcripts, const VecT& alphaIn,
+               VecT& alphaOut) {
+
+  assert(alphaIn.size() == alphaOut.size());
+
+  size_t numEqClasses = eqClasses.size();
+  for (size_t eqID = 0; eqID < numEqClasses; ++eqID) {
+    if (!eqClasses.valid(eqID)) {
+      continue;
+    }
+    uint64_t count = counts[eqID];
+    // for each transcript in this class
+    const uint32_t* txps = eqClasses.txps(eqID);
+    const double* auxs = eqClasses.combinedWeights(eqID);
+
+    double denom = 0.0;
+    size_t groupSize = eqClasses.classSize(eqID);
+    // If this is a single-transcript group,
+    // then it gets the full count.  Otherwise,
+    // update according to our EM rule.
+    if (BOOST_LIKELY(groupSize > 1)) {
+      for (size_t i = 0; i < groupSize; ++i) {
+        denom += alphaIn[txps[i]] * auxs[i];
+      }
+
+      if (denom > std::numeric_limits<double>::denorm_min()) {
+        double invDenom = count / denom;
+        for (size_t i = 0; i < groupSize; ++i) {
+          auto tid = txps[i];
+          double v = alphaIn[tid] * auxs[i];
+          if (!std::isnan(v)) {
+            salmon::utils::incLoop(alphaOut[tid], v * invDenom);
+          }
+        }
+      }
+    } else {
+      salmon::utils::incLoop(alphaOut[txps[0]], count);
+    }
+  }
+}
+
 template <typename VecT>
 double truncateCountVector(VecT& alphas, double cutoff) {
   // Truncate tiny expression values
@@ -80,6 +128,11 @@ void EMUpdate_<std::vector<tbb::atomic<double>>>(std::vector<std::vector<uint32_
                                                  std::vector<Transcript>& transcripts, const std::vector<tbb::atomic<double>>& alphaIn,
                                                  std::vector<tbb::atomic<double>>& alphaOut);
 
+template void EMUpdate_<std::vector<double>>(
+    const EquivalenceClassCSR& eqClasses, const std::vector<uint64_t>& counts,
+    std::vector<Transcript>& transcripts, const std::vector<double>& alphaIn,
+    std::vector<double>& alphaOut);
+
 template
 double truncateCountVector<std::vector<double>>(std::vector<double>& alphas, double cutoff);
 
@@ -0,0 +1,34 @@
+#include "ExpDigamma.hpp"
+#include "ExpDigammaKernel.hpp"
+
+namespace salmon {
+namespace math {
+namespace digamma_kernel {
+// (in ExpDigammaAVX2.cpp)
+void expDigammaAVX2(const double* x, size_t n, double logNorm, double minArg,
+                    double* out);
+}
+
+namespace {
+bool haveAVX2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+}
+
+void expDigamma(const double* x, size_t n, double logNorm, double minArg,
+                double* out) {
+  static const bool useAVX2 = haveAVX2();
+  if (useAVX2) {
+    digamma_kernel::expDigammaAVX2(x, n, logNorm, minArg, out);
+  } else {
+    digamma_kernel::expDigammaBatch<digamma_kernel::ScalarOps>(
+        x, n, logNorm, minArg, out);
+  }
+}
+
+} // namespace math
+} // namespace salmon
@@ -0,0 +1,45 @@
+// Compiled with -mavx2 (see src/CMakeLists.txt); only called when the CPU
+// supports AVX2.
+#include "ExpDigammaKernel.hpp"
+
+#include <immintrin.h>
+
+namespace salmon {
+namespace math {
+namespace digamma_kernel {
+namespace {
+struct AVX2Ops {
+  using V = __m256d;
+  using M = __m256d;
+  static constexpr const size_t LANES = 4;
+
+  static inline V set1(double x) { return _mm256_set1_pd(x); }
+  static inline V load(const double* p) { return _mm256_loadu_pd(p); }
+  static inline void store(double* p, V x) { _mm256_storeu_pd(p, x); }
+  static inline V add(V a, V b) { return _mm256_add_pd(a, b); }
+  static inline V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+  static inline V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+  static inline V div(V a, V b) { return _mm256_div_pd(a, b); }
+  static inline V min(V a, V b) { return _mm256_min_pd(a, b); }
+  static inline V max(V a, V b) { return _mm256_max_pd(a, b); }
+  static inline M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static inline M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  // mask ? a : b
+  static inline V select(M mask, V a, V b) {
+    return _mm256_blendv_pd(b, a, mask);
+  }
+  static inline V pow2(V kd) {
+    __m256i bits = _mm256_add_epi64(_mm256_castpd_si256(kd),
+                                    _mm256_set1_epi64x(1023));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+  }
+};
+} // namespace
+
+void expDigammaAVX2(const double* x, size_t n, double logNorm, double minArg,
+                    double* out) {
+  expDigammaBatch<AVX2Ops>(x, n, logNorm, minArg, out);
+}
+}
+}
+}
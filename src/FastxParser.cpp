@@ -1,10 +1,16 @@
 #include "FastxParser.hpp"
 #include "FastxParserThreadUtils.hpp"
+#include "FastxRecordReader.hpp"
+#include "ParallelGzipReader.hpp"
+#include "UnalignedBAMReader.hpp"
+#include "xxhash.h"
 
 #include "fcntl.h"
 #include "unistd.h"
 #include <sstream>
+#include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <stdexcept>
@@ -12,10 +18,6 @@
 #include <poll.h>
 #include <thread>
 #include <vector>
-#include <zlib.h>
-
-// STEP 1: declare the type of file handler and the read() function
-KSEQ_INIT(gzFile, gzread)
 
 namespace fastx_parser {
 template <typename T>
@@ -29,8 +31,8 @@ FastxParser<T>::FastxParser(std::vector<std::string> files,
                             std::vector<std::string> files2,
                             uint32_t numConsumers, uint32_t numParsers,
                             uint32_t chunkSize)
-    : inputStreams_(files), inputStreams2_(files2), numParsing_(0),
-      blockSize_(chunkSize) {
+    : inputStreams_(files), inputStreams2_(files2),
+      numConsumers_(numConsumers), numParsing_(0), blockSize_(chunkSize) {
 
   if (numParsers > files.size()) {
     std::cerr << "Can't make user of more parsing threads than file (pairs); "
@@ -39,6 +41,7 @@ FastxParser<T>::FastxParser(std::vector<std::string> files,
     numParsers = files.size();
   }
   numParsers_ = numParsers;
+  maxParsers_ = numParsers;
 
   // nobody is parsing yet
   numParsing_ = 0;
@@ -74,6 +77,49 @@ FastxParser<T>::FastxParser(std::vector<std::string> files,
   }
 }
 
+template <typename T> void FastxParser<T>::setMaxParsers(uint32_t n) {
+  if (isActive_ or subsampler_.byCount()) {
+    return;
+  }
+  n = std::max(numParsers_,
+               std::min(n, static_cast<uint32_t>(inputStreams_.size())));
+  if (n == maxParsers_) {
+    return;
+  }
+  maxParsers_ = n;
+
+  // The read queue pre-allocates room for each of its producers, so it
+  // has to be re-created to account for the extra parsing threads (nothing
+  // has been put on it yet).
+  produceReads_.clear();
+  readQueue_ = moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>(
+      4 * numConsumers_, maxParsers_, 0);
+
+  // every parsing thread gets its own tokens
+  for (size_t i = consumeContainers_.size(); i < maxParsers_; ++i) {
+    consumeContainers_.emplace_back(
+        new moodycamel::ConsumerToken(seqContainerQueue_));
+  }
+  for (size_t i = 0; i < maxParsers_; ++i) {
+    produceReads_.emplace_back(new moodycamel::ProducerToken(readQueue_));
+  }
+}
+
+template <typename T>
+void FastxParser<T>::setSubsample(double value, uint64_t seed) {
+  if (isActive_ or value <= 0.0) {
+    return;
+  }
+  if (value < 1.0) {
+    subsampler_.setFraction(value, seed);
+    return;
+  }
+  subsampler_.setCount(static_cast<uint64_t>(value));
+  // "the first n" is only well defined if the files are read in order
+  numParsers_ = 1;
+  maxParsers_ = 1;
+}
+
 template <typename T> ReadGroup<T> FastxParser<T>::getReadGroup() {
   return ReadGroup<T>(getProducerToken_(), getConsumerToken_());
 }
@@ -109,13 +155,22 @@ template <typename T> FastxParser<T>::~FastxParser() {
   bool FastxParser<T>::stop() {
     bool ret{false};
     if (isActive_) {
-      for (auto& t : parsingThreads_) {
-        t->join();
+      {
+        // A consumer may be adding a parsing thread (see noteDelivery_());
+        // wait for it, and don't let any more be added once we're done.
+        std::lock_guard<std::mutex> l(parserStartMutex_);
+        for (auto& t : parsingThreads_) {
+          t->join();
+        }
+        isActive_ = false;
       }
-      isActive_ = false;
       for (auto& res : threadResults_) {
         if (res == -3) {
           throw std::range_error("Error reading from the FASTA/Q stream. Make sure the file is valid.");
+        } else if (res == -4) {
+          throw std::range_error("Found consecutive records with different names in "
+                                 "interleaved paired-end input. Make sure that the two mates "
+                                 "of each fragment follow one another.");
         } else if (res < -1) {
           std::stringstream ss;
           ss << "Error reading from the FASTA/Q stream. Minimum return code for left and right read was ("
@@ -132,25 +187,108 @@ template <typename T> FastxParser<T>::~FastxParser() {
     return ret;
   }
 
-inline void copyRecord(kseq_t* seq, ReadSeq* s) {
-  // Copy over the sequence and read name
-  s->seq.assign(seq->seq.s, seq->seq.l);
-  s->name.assign(seq->name.s, seq->name.l);
+// Parse the next record directly into the (reused) strings of the chunk
+inline int readRecord(FastxRecordReader& reader, ReadSeq* s) {
+  return reader.read(s->name, s->seq, nullptr);
+}
+
+inline int readRecord(FastxRecordReader& reader, ReadQual* s) {
+  return reader.read(s->name, s->seq, &s->qual);
+}
+
+inline int readRecord(UnalignedBAMReader& reader, ReadSeq* s) {
+  return reader.read(s->name, s->seq, nullptr);
+}
+
+inline int readRecord(UnalignedBAMReader& reader, ReadQual* s) {
+  return reader.read(s->name, s->seq, &s->qual);
+}
+
+// Unaligned BAM input is recognized by its extension (as in BAMQueue)
+inline bool isBAMFile(const std::string& file) {
+  if (file.size() < 4) {
+    return false;
+  }
+  std::string ext = file.substr(file.size() - 4);
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return ext == ".bam";
+}
+
+// The length of a read name without its "/1" or "/2" mate suffix (if any)
+inline size_t fragmentNameLength(const std::string& name) {
+  size_t len = name.size();
+  if (len > 2 and name[len - 2] == '/' and
+      (name[len - 1] == '1' or name[len - 1] == '2')) {
+    len -= 2;
+  }
+  return len;
+}
+
+// True if two read names agree, up to a trailing "/1" and "/2"
+inline bool sameFragment(const std::string& n1, const std::string& n2) {
+  size_t l1 = fragmentNameLength(n1);
+  size_t l2 = fragmentNameLength(n2);
+  return l1 == l2 and n1.compare(0, l1, n2, 0, l2) == 0;
+}
+
+/**
+ * Read the next two mates from an interleaved source (in which the mates of
+ * each fragment follow one another).  A lone final record is reported as
+ * truncated (-2), and a pair of records with different names as -4.
+ */
+template <typename ReaderT, typename MateT>
+inline int readInterleavedPair(ReaderT& reader, MateT* m1, MateT* m2) {
+  int r1 = readRecord(reader, m1);
+  if (r1 < 0) {
+    return r1;
+  }
+  int r2 = readRecord(reader, m2);
+  if (r2 < 0) {
+    return (r2 == -1) ? -2 : r2;
+  }
+  return sameFragment(m1->name, m2->name) ? r1 : -4;
+}
+
+bool ReadSubsampler::keep(const std::string& name) {
+  if (maxCount_ > 0) {
+    return numKept_++ < maxCount_;
+  }
+  if (fraction_ >= 1.0) {
+    return true;
+  }
+  // hash the name without its /1 or /2 suffix, so that both mates agree
+  uint64_t h = XXH64(name.data(), fragmentNameLength(name), seed_);
+  // the top 53 bits of the hash, as a uniform value in [0, 1)
+  return static_cast<double>(h >> 11) * (1.0 / 9007199254740992.0) < fraction_;
+}
+
+// The name by which a record is subsampled
+inline const std::string& recordName(const ReadSeq& s) { return s.name; }
+inline const std::string& recordName(const ReadQual& s) { return s.name; }
+inline const std::string& recordName(const ReadPair& s) {
+  return s.first.name;
+}
+inline const std::string& recordName(const ReadQualPair& s) {
+  return s.first.name;
 }
 
-inline void copyRecord(kseq_t* seq, ReadQual* s) {
-    // Copy over the sequence and read name 
-    // and quality
-    s->seq.assign(seq->seq.s, seq->seq.l);
-    s->name.assign(seq->name.s, seq->name.l);
-    s->qual.assign(seq->qual.s, seq->qual.l);
+// The number of bases a record contributes to the size of its chunk
+inline size_t recordBases(const ReadSeq& s) { return s.seq.size(); }
+inline size_t recordBases(const ReadQual& s) { return s.seq.size(); }
+inline size_t recordBases(const ReadPair& s) {
+  return s.first.seq.size() + s.second.seq.size();
+}
+inline size_t recordBases(const ReadQualPair& s) {
+  return s.first.seq.size() + s.second.seq.size();
 }
 
 
 template <typename T>
 int parseReads(
     std::vector<std::string>& inputStreams, std::atomic<uint32_t>& numParsing,
-    moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
+    uint32_t numInflaters, uint32_t readAheadDepth, size_t chunkBases,
+    ReadSubsampler& subsampler, moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
     moodycamel::ConcurrentQueue<uint32_t>& workQueue,
     moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
         seqContainerQueue_,
@@ -158,10 +296,14 @@ int parseReads(
 
   using fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
   auto curMaxDelay = MIN_BACKOFF_ITERS;
-  kseq_t* seq;
   T* s;
+  ParallelGzipReader fp(numInflaters, readAheadDepth);
   uint32_t fn{0};
   while (workQueue.try_dequeue(fn)) {
+    if (subsampler.exhausted()) {
+      // we already have all of the reads we want
+      continue;
+    }
     auto file = inputStreams[fn];
     std::unique_ptr<ReadChunk<T>> local;
     while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
@@ -169,37 +311,53 @@ int parseReads(
       // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
       // std::cerr << "couldn't dequeue read chunk\n";
     }
-    size_t numObtained{local->size()};
+    size_t numObtained{local->want()};
     // open the file and init the parser
-    auto fp = gzopen(file.c_str(), "r");
+    if (!fp.open(file)) {
+      --numParsing;
+      return -3;
+    }
 
-    // The number of reads we have in the local vector
+    // The number of reads (and bases) we have in the local vector
     size_t numWaiting{0};
+    size_t basesWaiting{0};
 
-    seq = kseq_init(fp);
-    int ksv = kseq_read(seq);
+    FastxRecordReader reader(fp);
+    s = &((*local)[numWaiting]);
+    int ksv = readRecord(reader, s);
 
     while (ksv >= 0) {
-      s = &((*local)[numWaiting++]);
-
-      copyRecord(seq, s);
+      if (subsampler.active() and !subsampler.keep(recordName(*s))) {
+        if (subsampler.exhausted()) {
+          break;
+        }
+        // the next record goes into the same slot
+        ksv = readRecord(reader, s);
+        continue;
+      }
+      ++numWaiting;
+      basesWaiting += recordBases(*s);
 
-      // If we've filled the local vector, then dump to the concurrent queue
-      if (numWaiting == numObtained) {
+      // If we've filled the local vector (or reached the base budget
+      // for a chunk), then dump to the concurrent queue
+      if (numWaiting == numObtained or basesWaiting >= chunkBases) {
+        local->have(numWaiting);
         curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!readQueue_.try_enqueue(std::move(local))) {
+        while (!readQueue_.try_enqueue(*pRead, std::move(local))) {
           fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
         }
         numWaiting = 0;
+        basesWaiting = 0;
         numObtained = 0;
         // And get more empty reads
         curMaxDelay = MIN_BACKOFF_ITERS;
         while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
           fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
         }
-        numObtained = local->size();
+        numObtained = local->want();
       }
-      ksv = kseq_read(seq);
+      s = &((*local)[numWaiting]);
+      ksv = readRecord(reader, s);
     }
 
     if (ksv == -3) {
@@ -216,10 +374,13 @@ int parseReads(
         fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
       }
       numWaiting = 0;
+      basesWaiting = 0;
+    } else {
+      // (e.g. every read left was dropped) put the unused chunk back
+      seqContainerQueue_.enqueue(std::move(local));
     }
-    // destroy the parser and close the file
-    kseq_destroy(seq);
-    gzclose(fp);
+    // close the file
+    fp.close();
   }
 
   --numParsing;
@@ -230,7 +391,8 @@ template <typename T>
 int parseReadPair(
     std::vector<std::string>& inputStreams,
     std::vector<std::string>& inputStreams2, std::atomic<uint32_t>& numParsing,
-    moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
+    uint32_t numInflaters, uint32_t readAheadDepth, size_t chunkBases,
+    ReadSubsampler& subsampler, moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
     moodycamel::ConcurrentQueue<uint32_t>& workQueue,
     moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
         seqContainerQueue_,
@@ -238,15 +400,22 @@ int parseReadPair(
 
   using fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
   size_t curMaxDelay = MIN_BACKOFF_ITERS;
-  kseq_t* seq;
-  kseq_t* seq2;
   T* s;
+  ParallelGzipReader fp(numInflaters, readAheadDepth);
+  ParallelGzipReader fp2(numInflaters, readAheadDepth);
+  UnalignedBAMReader bamReader(numInflaters);
+  // Without a second list of files, each file holds both mates
+  bool interleaved = inputStreams2.empty();
 
   uint32_t fn{0};
   while (workQueue.try_dequeue(fn)) {
     // for (size_t fn = 0; fn < inputStreams.size(); ++fn) {
+    if (subsampler.exhausted()) {
+      // we already have all of the reads we want
+      continue;
+    }
     auto& file = inputStreams[fn];
-    auto& file2 = inputStreams2[fn];
+    bool isBAM = interleaved and isBAMFile(file);
 
     std::unique_ptr<ReadChunk<T>> local;
     while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
@@ -254,42 +423,69 @@ int parseReadPair(
       // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
       // std::cerr << "couldn't dequeue read chunk\n";
     }
-    size_t numObtained{local->size()};
-    // open the file and init the parser
-    auto fp = gzopen(file.c_str(), "r");
-    auto fp2 = gzopen(file2.c_str(), "r");
+    size_t numObtained{local->want()};
+    // open the file(s) and init the parser
+    bool opened = isBAM ? bamReader.open(file)
+                        : (fp.open(file) and
+                           (interleaved or fp2.open(inputStreams2[fn])));
+    if (!opened) {
+      --numParsing;
+      return -3;
+    }
 
-    // The number of reads we have in the local vector
+    // The number of reads (and bases) we have in the local vector
     size_t numWaiting{0};
+    size_t basesWaiting{0};
+
+    FastxRecordReader reader(fp);
+    FastxRecordReader reader2(fp2);
+    int ksv{0};
+    int ksv2{0};
+    auto readMates = [&](T* rp) -> void {
+      if (isBAM) {
+        ksv = ksv2 = readInterleavedPair(bamReader, &rp->first, &rp->second);
+      } else if (interleaved) {
+        ksv = ksv2 = readInterleavedPair(reader, &rp->first, &rp->second);
+      } else {
+        ksv = readRecord(reader, &rp->first);
+        ksv2 = readRecord(reader2, &rp->second);
+      }
+    };
 
-    seq = kseq_init(fp);
-    seq2 = kseq_init(fp2);
-
-    int ksv = kseq_read(seq);
-    int ksv2 = kseq_read(seq2);
+    s = &((*local)[numWaiting]);
+    readMates(s);
     while (ksv >= 0 and ksv2 >= 0) {
+      if (subsampler.active() and !subsampler.keep(recordName(*s))) {
+        if (subsampler.exhausted()) {
+          break;
+        }
+        // the next fragment goes into the same slot
+        readMates(s);
+        continue;
+      }
+      ++numWaiting;
+      basesWaiting += recordBases(*s);
 
-      s = &((*local)[numWaiting++]);
-      copyRecord(seq, &s->first);
-      copyRecord(seq2, &s->second);
-
-      // If we've filled the local vector, then dump to the concurrent queue
-      if (numWaiting == numObtained) {
+      // If we've filled the local vector (or reached the base budget
+      // for a chunk), then dump to the concurrent queue
+      if (numWaiting == numObtained or basesWaiting >= chunkBases) {
+        local->have(numWaiting);
         curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!readQueue_.try_enqueue(std::move(local))) {
+        while (!readQueue_.try_enqueue(*pRead, std::move(local))) {
           fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
         }
         numWaiting = 0;
+        basesWaiting = 0;
         numObtained = 0;
         // And get more empty reads
         curMaxDelay = MIN_BACKOFF_ITERS;
         while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
           fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
         }
-        numObtained = local->size();
+        numObtained = local->want();
       }
-      ksv = kseq_read(seq);
-      ksv2 = kseq_read(seq2);
+      s = &((*local)[numWaiting]);
+      readMates(s);
     }
 
     if (ksv == -3 or ksv2 == -3) {
@@ -309,31 +505,84 @@ int parseReadPair(
         fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
       }
       numWaiting = 0;
+      basesWaiting = 0;
+    } else {
+      // (e.g. every read left was dropped) put the unused chunk back
+      seqContainerQueue_.enqueue(std::move(local));
+    }
+    // close the files
+    if (isBAM) {
+      bamReader.close();
+    } else {
+      fp.close();
+      fp2.close();
     }
-    // destroy the parser and close the file
-    kseq_destroy(seq);
-    gzclose(fp);
-    kseq_destroy(seq2);
-    gzclose(fp2);
   }
 
   --numParsing;
   return 0;
 }
 
+template <> void FastxParser<ReadSeq>::startParser_(uint32_t i) {
+  ++numParsing_;
+  ++numStarted_;
+  parsingThreads_.emplace_back(new std::thread([this, i]() {
+    this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
+               this->numInflaters_, this->readAheadDepth_,
+               this->chunkBases_, this->subsampler_,
+               this->consumeContainers_[i].get(),
+               this->produceReads_[i].get(), this->workQueue_,
+               this->seqContainerQueue_, this->readQueue_);
+  }));
+}
+
+template <> void FastxParser<ReadQual>::startParser_(uint32_t i) {
+  ++numParsing_;
+  ++numStarted_;
+  parsingThreads_.emplace_back(new std::thread([this, i]() {
+    this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
+               this->numInflaters_, this->readAheadDepth_,
+               this->chunkBases_, this->subsampler_,
+               this->consumeContainers_[i].get(),
+               this->produceReads_[i].get(), this->workQueue_,
+               this->seqContainerQueue_, this->readQueue_);
+  }));
+}
+
+template <> void FastxParser<ReadPair>::startParser_(uint32_t i) {
+  ++numParsing_;
+  ++numStarted_;
+  parsingThreads_.emplace_back(new std::thread([this, i]() {
+        this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
+                  this->numParsing_, this->numInflaters_,
+                  this->readAheadDepth_, this->chunkBases_, this->subsampler_,
+                  this->consumeContainers_[i].get(),
+                  this->produceReads_[i].get(), this->workQueue_,
+                  this->seqContainerQueue_, this->readQueue_);
+  }));
+}
+
+template <> void FastxParser<ReadQualPair>::startParser_(uint32_t i) {
+  ++numParsing_;
+  ++numStarted_;
+  parsingThreads_.emplace_back(new std::thread([this, i]() {
+        this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
+                  this->numParsing_, this->numInflaters_,
+                  this->readAheadDepth_, this->chunkBases_, this->subsampler_,
+                  this->consumeContainers_[i].get(),
+                  this->produceReads_[i].get(), this->workQueue_,
+                  this->seqContainerQueue_, this->readQueue_);
+  }));
+}
+
 template <> bool FastxParser<ReadSeq>::start() {
   if (numParsing_ == 0) {
     isActive_ = true;
-    threadResults_.resize(numParsers_);
+    threadResults_.resize(maxParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    parsingThreads_.reserve(maxParsers_);
     for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-        this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
-                   this->consumeContainers_[i].get(),
-                   this->produceReads_[i].get(), this->workQueue_,
-                   this->seqContainerQueue_, this->readQueue_);
-      }));
+      startParser_(i);
     }
     return true;
   } else {
@@ -344,12 +593,14 @@ template <> bool FastxParser<ReadSeq>::start() {
 template <> bool FastxParser<ReadPair>::start() {
   if (numParsing_ == 0) {
     isActive_ = true;
-    // Some basic checking to ensure the read files look "sane".
-    if (inputStreams_.size() != inputStreams2_.size()) {
+    // Some basic checking to ensure the read files look "sane" (without
+    // any #2 files, the mates are interleaved in the #1 files).
+    if (!inputStreams2_.empty() and
+        inputStreams_.size() != inputStreams2_.size()) {
       throw std::invalid_argument("There should be the same number "
                                   "of files for the left and right reads");
     }
-    for (size_t i = 0; i < inputStreams_.size(); ++i) {
+    for (size_t i = 0; i < inputStreams2_.size(); ++i) {
       auto& s1 = inputStreams_[i];
       auto& s2 = inputStreams2_[i];
       if (s1 == s2) {
@@ -358,17 +609,11 @@ template <> bool FastxParser<ReadPair>::start() {
       }
     }
 
-    threadResults_.resize(numParsers_);
+    threadResults_.resize(maxParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
-
+    parsingThreads_.reserve(maxParsers_);
     for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
-                      this->numParsing_, this->consumeContainers_[i].get(),
-                      this->produceReads_[i].get(), this->workQueue_,
-                      this->seqContainerQueue_, this->readQueue_);
-      }));
+      startParser_(i);
     }
     return true;
   } else {
@@ -379,16 +624,11 @@ template <> bool FastxParser<ReadPair>::start() {
 template <> bool FastxParser<ReadQual>::start() {
     if (numParsing_ == 0) {
     isActive_ = true;
-    threadResults_.resize(numParsers_);
+    threadResults_.resize(maxParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    parsingThreads_.reserve(maxParsers_);
     for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-        this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
-                   this->consumeContainers_[i].get(),
-                   this->produceReads_[i].get(), this->workQueue_,
-                   this->seqContainerQueue_, this->readQueue_);
-      }));
+      startParser_(i);
     }
     return true;
   } else {
@@ -399,12 +639,14 @@ template <> bool FastxParser<ReadQual>::start() {
 template <> bool FastxParser<ReadQualPair>::start() {
   if (numParsing_ == 0) {
     isActive_ = true;
-    // Some basic checking to ensure the read files look "sane".
-    if (inputStreams_.size() != inputStreams2_.size()) {
+    // Some basic checking to ensure the read files look "sane" (without
+    // any #2 files, the mates are interleaved in the #1 files).
+    if (!inputStreams2_.empty() and
+        inputStreams_.size() != inputStreams2_.size()) {
       throw std::invalid_argument("There should be the same number "
                                   "of files for the left and right reads");
     }
-    for (size_t i = 0; i < inputStreams_.size(); ++i) {
+    for (size_t i = 0; i < inputStreams2_.size(); ++i) {
       auto& s1 = inputStreams_[i];
       auto& s2 = inputStreams2_[i];
       if (s1 == s2) {
@@ -413,17 +655,11 @@ template <> bool FastxParser<ReadQualPair>::start() {
       }
     }
 
-    threadResults_.resize(numParsers_);
+    threadResults_.resize(maxParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
-
+    parsingThreads_.reserve(maxParsers_);
     for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
-                      this->numParsing_, this->consumeContainers_[i].get(),
-                      this->produceReads_[i].get(), this->workQueue_,
-                      this->seqContainerQueue_, this->readQueue_);
-      }));
+      startParser_(i);
     }
     return true;
   } else {
@@ -431,14 +667,48 @@ template <> bool FastxParser<ReadQualPair>::start() {
   }
 }
 
+/**
+ * Called by the consumers each time they obtain a chunk.  If, over a window
+ * of recent chunks, at least a quarter of them had to be waited for, the
+ * parser can't keep up, so we start another parsing thread (provided there
+ * are files left for it to work on).  When the consumers are the bottleneck,
+ * they essentially never find the read queue empty.
+ */
+template <typename T> void FastxParser<T>::noteDelivery_(bool waited) {
+  if (numStarted_ >= maxParsers_) {
+    return;
+  }
+  if (waited) {
+    ++numStarved_;
+  }
+  uint64_t window = 4 * numConsumers_;
+  uint64_t delivered = ++numDelivered_;
+  if (delivered % window != 0) {
+    return;
+  }
+  uint64_t starved = numStarved_.exchange(0);
+  // The consumers always wait for the first chunks while the parser spins
+  // up; don't count that against it.
+  if (delivered == window or 4 * starved < window) {
+    return;
+  }
+  std::lock_guard<std::mutex> l(parserStartMutex_);
+  if (isActive_ and numStarted_ < maxParsers_ and
+      workQueue_.size_approx() > 0) {
+    startParser_(numStarted_);
+  }
+}
 
 template <typename T> bool FastxParser<T>::refill(ReadGroup<T>& seqs) {
   finishedWithGroup(seqs);
   auto curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+  bool waited{false};
   while (numParsing_ > 0) {
     if (readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr())) {
+      noteDelivery_(waited);
       return true;
     }
+    waited = true;
     fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
   }
   return readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr());
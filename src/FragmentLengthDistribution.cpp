@@ -22,8 +22,7 @@ using namespace std;
 FragmentLengthDistribution::FragmentLengthDistribution(
     double alpha, size_t max_val, size_t prior_mu, size_t prior_sigma,
     size_t kernel_n, double kernel_p, size_t bin_size)
-    : hist_(max_val / bin_size + 1), cachedCMF_(hist_.size()),
-      haveCachedCMF_(false), totMass_(salmon::math::LOG_0),
+    : hist_(max_val / bin_size + 1), totMass_(salmon::math::LOG_0),
       sum_(salmon::math::LOG_0), min_(max_val / bin_size), binSize_(bin_size) {
 
   using salmon::math::logAdd;
@@ -78,57 +77,89 @@ size_t FragmentLengthDistribution::minVal() const {
 }
 
 void FragmentLengthDistribution::addVal(size_t len, double mass) {
+  LocalFragmentLengthDistribution local(*this);
+  local.addVal(len, mass);
+}
+
+void FragmentLengthDistribution::merge(
+    const LocalFragmentLengthDistribution& local) {
+  using salmon::math::logAdd;
+  if (local.numUpdates_ == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lg(histMut_);
+  for (size_t i = local.lo_; i <= local.hi_; ++i) {
+    hist_[i] = logAdd(hist_[i], local.hist_[i]);
+  }
+  sum_ = logAdd(sum_, local.sum_);
+  totMass_ = logAdd(totMass_, local.totMass_);
+  if (local.min_ < min_) {
+    min_ = local.min_;
+  }
+  numUpdates_.fetch_add(local.numUpdates_, std::memory_order_relaxed);
+}
+
+LocalFragmentLengthDistribution::LocalFragmentLengthDistribution(
+    FragmentLengthDistribution& fld)
+    : fld_(fld), hist_(fld.hist_.size(), salmon::math::LOG_0),
+      lo_(fld.hist_.size()), sum_(salmon::math::LOG_0),
+      totMass_(salmon::math::LOG_0), min_(fld.hist_.size()) {}
+
+void LocalFragmentLengthDistribution::addVal(size_t len, double mass) {
   using salmon::math::logAdd;
   // assert(!isnan(mass));
   // assert(kernel_.size());
 
-  len /= binSize_;
+  auto& kernel = fld_.kernel_;
+  ++numUpdates_;
+  len /= fld_.binSize_;
 
-  if (len > maxVal()) {
-    len = maxVal();
+  if (len > fld_.maxVal()) {
+    len = fld_.maxVal();
   }
   if (len < min_) {
     min_ = len;
   }
 
-  size_t offset = len - kernel_.size() / 2;
+  size_t offset = len - kernel.size() / 2;
 
-  for (size_t i = 0; i < kernel_.size(); i++) {
+  for (size_t i = 0; i < kernel.size(); i++) {
     if (offset > 0 && offset < hist_.size()) {
-      double kMass = mass + kernel_[i];
-      double oldVal = hist_[offset];
-      double retVal = oldVal;
-      double newVal = 0.0;
-      do {
-        oldVal = retVal;
-        newVal = logAdd(oldVal, kMass);
-        retVal = hist_[offset].compare_and_swap(newVal, oldVal);
-      } while (retVal != oldVal);
-
-      retVal = sum_;
-      do {
-        oldVal = retVal;
-        newVal = logAdd(oldVal, log(static_cast<double>(offset)) + kMass);
-        retVal = sum_.compare_and_swap(newVal, oldVal);
-      } while (retVal != oldVal);
-
-      retVal = totMass_;
-      do {
-        oldVal = retVal;
-        newVal = logAdd(oldVal, kMass);
-        retVal = totMass_.compare_and_swap(newVal, oldVal);
-      } while (retVal != oldVal);
+      double kMass = mass + kernel[i];
+      hist_[offset] = logAdd(hist_[offset], kMass);
+      sum_ = logAdd(sum_, log(static_cast<double>(offset)) + kMass);
+      totMass_ = logAdd(totMass_, kMass);
+      if (offset < lo_) {
+        lo_ = offset;
+      }
+      if (offset > hi_) {
+        hi_ = offset;
+      }
     }
     offset++;
   }
 }
 
+void LocalFragmentLengthDistribution::flush() {
+  fld_.merge(*this);
+  for (size_t i = lo_; i <= hi_ and i < hist_.size(); ++i) {
+    hist_[i] = salmon::math::LOG_0;
+  }
+  lo_ = hist_.size();
+  hi_ = 0;
+  sum_ = salmon::math::LOG_0;
+  totMass_ = salmon::math::LOG_0;
+  min_ = hist_.size();
+  numUpdates_ = 0;
+}
+
 /**
  * Returns the *LOG* probability of observing a fragment of length *len*.
  */
 double FragmentLengthDistribution::pmf(size_t len) const {
-  if (haveCachedCMF_) {
-    return (len < cachedPMF_.size()) ? cachedPMF_[len] : cachedPMF_.back();
+  if (const Table* t = table()) {
+    return t->pmf(len);
   } else {
     len /= binSize_;
     if (len > maxVal()) {
@@ -154,8 +185,8 @@ void FragmentLengthDistribution::dumpPMF(std::vector<double>& pmfOut,
 }
 
 double FragmentLengthDistribution::cmf(size_t len) const {
-  if (haveCachedCMF_) {
-    return (len < cachedCMF_.size()) ? cachedCMF_[len] : cachedCMF_.back();
+  if (const Table* t = table()) {
+    return t->cmf(len);
   } else {
     double cum = salmon::math::LOG_0;
     len /= binSize_;
@@ -170,33 +201,36 @@ double FragmentLengthDistribution::cmf(size_t len) const {
   }
 }
 
-std::vector<double> getLockedPMF(FragmentLengthDistribution* fld) {
-  std::vector<double> pmfOut;
-  auto maxV = fld->maxVal();
+void FragmentLengthDistribution::cacheCMF() {
+  std::lock_guard<std::mutex> lg(tableMut_);
+  // Hold off merges while we take the snapshot, so that the histogram and
+  // its total mass agree
+  std::lock_guard<std::mutex> hlg(histMut_);
+  uint64_t numUpdates = numUpdates_;
+  const Table* current = table();
+  if (current != nullptr and current->numUpdates_ == numUpdates) {
+    return;
+  }
+
+  // Take the (normalized) pmf from the histogram itself, not the current table
+  std::unique_ptr<Table> t(new Table);
+  t->version_ = tables_.size() + 1;
+  t->numUpdates_ = numUpdates;
+  auto maxV = maxVal();
+  auto& pmfOut = t->pmf_;
   pmfOut.reserve(maxV + 1);
   double totMass = salmon::math::LOG_0;
   for (size_t i = 0; i <= maxV; ++i) {
-    pmfOut.push_back(fld->pmf(i));
+    pmfOut.push_back(hist_[i / binSize_] - totMass_);
     totMass = salmon::math::logAdd(totMass, pmfOut.back());
   }
   for (size_t i = 0; i <= maxV; ++i) {
     pmfOut[i] -= totMass;
   }
-  return pmfOut;
-}
+  t->cmf_ = cmf(pmfOut);
 
-void FragmentLengthDistribution::cacheCMF() {
-  // std::lock_guard<std::mutex> lg(fldMut_);
-  if (sl_.try_lock()) {
-    if (!haveCachedCMF_) {
-      size_t minV, maxV;
-      cachedPMF_ = getLockedPMF(this);
-      cachedCMF_ = cmf(cachedPMF_);
-      haveCachedCMF_ = true;
-    }
-
-    sl_.unlock();
-  }
+  table_.store(t.get(), std::memory_order_release);
+  tables_.push_back(std::move(t));
 }
 
 /**
@@ -88,36 +88,34 @@ bool GZipWriter::writeEquivCounts(const SalmonOpts& opts, ExpT& experiment) {
   std::ofstream equivFile(eqFilePath.string());
 
   auto& transcripts = experiment.transcripts();
-  auto& eqVec =
-      experiment.equivalenceClassBuilder().eqVec();
+  auto& eqClasses = experiment.equivalenceClassBuilder().eqClasses();
   bool dumpRichWeights = opts.dumpEqWeights;
 
   // Number of transcripts
   equivFile << transcripts.size() << '\n';
 
   // Number of equivalence classes
-  equivFile << eqVec.size() << '\n';
+  equivFile << eqClasses.size() << '\n';
 
   for (auto& t : transcripts) {
     equivFile << t.RefName << '\n';
   }
 
-  for (auto& eq : eqVec) {
-    uint64_t count = eq.second.count;
+  for (size_t eqID = 0; eqID < eqClasses.size(); ++eqID) {
+    uint64_t count = eqClasses.count(eqID);
     // for each transcript in this class
-    const TranscriptGroup& tgroup = eq.first;
-    const std::vector<uint32_t>& txps = tgroup.txps;
+    const uint32_t* txps = eqClasses.txps(eqID);
     // group size
-    uint32_t groupSize = eq.second.weights.size();
+    uint32_t groupSize = eqClasses.classSize(eqID);
     equivFile << groupSize << '\t';
     // each group member
     for (uint32_t i = 0; i < groupSize; i++) {
       equivFile << txps[i] << '\t';
     }
     if (dumpRichWeights) {
-      const auto& auxs = eq.second.combinedWeights;
-      for (auto aux : auxs) {
-        equivFile << aux << '\t';
+      const double* auxs = eqClasses.combinedWeights(eqID);
+      for (uint32_t i = 0; i < groupSize; i++) {
+        equivFile << auxs[i] << '\t';
       }
     }
     // count for this class
@@ -589,6 +587,17 @@ bool GZipWriter::writeMeta(const SalmonOpts& opts, const ExpT& experiment) {
     oa(cereal::make_nvp("num_mapped", experiment.numMappedFragments()));
     oa(cereal::make_nvp("percent_mapped",
                         experiment.effectiveMappingRate() * 100.0));
+    if (opts.validateMappings) {
+      oa(cereal::make_nvp("aln_score_cache_hits", opts.numAlnScoreCacheHits.load()));
+      oa(cereal::make_nvp("aln_score_cache_misses", opts.numAlnScoreCacheMisses.load()));
+    }
+    if (opts.readMemoSize > 0) {
+      oa(cereal::make_nvp("read_memo_hits", opts.numReadMemoHits.load()));
+      oa(cereal::make_nvp("read_memo_misses", opts.numReadMemoMisses.load()));
+      uint64_t numMemoLookups = opts.numReadMemoHits + opts.numReadMemoMisses;
+      oa(cereal::make_nvp("read_memo_hit_rate",
+                          (numMemoLookups > 0) ? static_cast<double>(opts.numReadMemoHits) / numMemoLookups : 0.0));
+    }
     oa(cereal::make_nvp("call", std::string("quant")));
     oa(cereal::make_nvp("start_time", opts.runStartTime));
     oa(cereal::make_nvp("end_time", opts.runStopTime));
@@ -600,8 +609,8 @@ bool GZipWriter::writeMeta(const SalmonOpts& opts, const ExpT& experiment) {
     os << "UniqueCount\tAmbigCount\n";
 
     auto& transcripts = experiment.transcripts();
-    auto& eqVec =
-        const_cast<ExpT&>(experiment).equivalenceClassBuilder().eqVec();
+    auto& eqClasses =
+        const_cast<ExpT&>(experiment).equivalenceClassBuilder().eqClasses();
 
     class CountPair {
     public:
@@ -610,16 +619,16 @@ bool GZipWriter::writeMeta(const SalmonOpts& opts, const ExpT& experiment) {
     };
 
     std::vector<CountPair> counts(transcripts.size());
-    for (auto& eq : eqVec) {
-      uint64_t count = eq.second.count;
-      const TranscriptGroup& tgroup = eq.first;
-      const std::vector<uint32_t>& txps = tgroup.txps;
-      if (txps.size() > 1) {
-        for (auto tid : txps) {
-          counts[tid].potential += count;
+    for (size_t eqID = 0; eqID < eqClasses.size(); ++eqID) {
+      uint64_t count = eqClasses.count(eqID);
+      const uint32_t* txps = eqClasses.txps(eqID);
+      size_t groupSize = eqClasses.classSize(eqID);
+      if (groupSize > 1) {
+        for (size_t i = 0; i < groupSize; ++i) {
+          counts[txps[i]].potential += count;
         }
       } else {
-        counts[txps.front()].unique += count;
+        counts[txps[0]].unique += count;
       }
     }
     for (size_t i = 0; i < transcripts.size(); ++i) {
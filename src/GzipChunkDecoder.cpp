@@ -0,0 +1,612 @@
+#include "GzipChunkDecoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fastx_parser {
+
+namespace {
+const uint16_t LEN_BASE[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                               15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                               67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LEN_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DIST_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,
+                                4, 4, 5, 5, 6, 6, 7, 7,  8,  8,
+                                9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// the order in which the lengths of the code length code are stored
+const uint8_t CL_ORDER[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                              11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+constexpr const unsigned LIT_ROOT_BITS = 10;
+constexpr const unsigned DIST_ROOT_BITS = 8;
+constexpr const unsigned CL_ROOT_BITS = 7;
+constexpr const unsigned MAX_CODE_LEN = 15;
+
+// A table entry is (value << 16) | (subtable bits << 5) | flag | length:
+//  - a symbol, and the length of its code (or what's left of it, in a
+//    subtable), or
+//  - with SUBTABLE set, the offset of the subtable of the codes longer than
+//    the root bits with this prefix, and the number of bits it's indexed by.
+// An entry of 0 is a bit pattern that no code starts with.
+constexpr const uint32_t SUBTABLE = 0x10;
+
+/**
+ * Build the decoding table of the canonical Huffman code with the n code
+ * lengths in lens.  As zlib does, we only accept complete codes, except for
+ * a literal / length or distance code of a single 1-bit code (or of no codes
+ * at all, in which case any attempt to decode a symbol fails).
+ */
+bool buildTable(const uint8_t* lens, unsigned n, unsigned rootBits,
+                bool codeLengths, std::vector<uint32_t>& table) {
+  uint16_t count[MAX_CODE_LEN + 1] = {0};
+  for (unsigned i = 0; i < n; ++i) {
+    ++count[lens[i]];
+  }
+  count[0] = 0;
+  unsigned maxLen = MAX_CODE_LEN;
+  while (maxLen > 0 and count[maxLen] == 0) {
+    --maxLen;
+  }
+  table.assign(size_t(1) << rootBits, 0);
+  if (maxLen == 0) {
+    return true;
+  }
+  int left = 1;
+  for (unsigned len = 1; len <= MAX_CODE_LEN; ++len) {
+    left <<= 1;
+    left -= count[len];
+    if (left < 0) {
+      return false;
+    }
+  }
+  if (left > 0 and (codeLengths or maxLen != 1)) {
+    return false;
+  }
+
+  uint32_t next[MAX_CODE_LEN + 1];
+  uint32_t code{0};
+  next[0] = 0;
+  for (unsigned len = 1; len <= MAX_CODE_LEN; ++len) {
+    code = (code + count[len - 1]) << 1;
+    next[len] = code;
+  }
+  unsigned subBits = (maxLen > rootBits) ? maxLen - rootBits : 0;
+  uint32_t rootMask = (uint32_t(1) << rootBits) - 1;
+  for (unsigned sym = 0; sym < n; ++sym) {
+    unsigned len = lens[sym];
+    if (len == 0) {
+      continue;
+    }
+    // the bits of a code are read starting from its most significant one
+    uint32_t c = next[len]++;
+    uint32_t rev{0};
+    for (unsigned i = 0; i < len; ++i) {
+      rev = (rev << 1) | ((c >> i) & 1);
+    }
+    if (len <= rootBits) {
+      for (uint32_t i = rev; i <= rootMask; i += (uint32_t(1) << len)) {
+        table[i] = (sym << 16) | len;
+      }
+    } else {
+      uint32_t& root = table[rev & rootMask];
+      if (root == 0) {
+        root = (static_cast<uint32_t>(table.size()) << 16) | (subBits << 5) |
+               SUBTABLE;
+        // (this may move the table, so root isn't used past here)
+        table.resize(table.size() + (size_t(1) << subBits), 0);
+      }
+      uint32_t offset = table[rev & rootMask] >> 16;
+      unsigned subLen = len - rootBits;
+      for (uint32_t i = rev >> rootBits; i < (uint32_t(1) << subBits);
+           i += (uint32_t(1) << subLen)) {
+        table[offset + i] = (sym << 16) | subLen;
+      }
+    }
+  }
+  return true;
+}
+
+inline uint64_t load64(const unsigned char* p) {
+  uint64_t x;
+  std::memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  x = __builtin_bswap64(x);
+#endif
+  return x;
+}
+
+inline uint32_t le32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/**
+ * The length of the gzip member header at the start of p (of len bytes), 0
+ * if it's not a valid header, or len + 1 if it runs past the end of p.
+ */
+size_t gzipHeaderLength(const unsigned char* p, size_t len) {
+  const size_t truncated = len + 1;
+  if (len < 10) {
+    return (len >= 3 and (p[0] != 0x1f or p[1] != 0x8b or p[2] != 8))
+               ? 0
+               : truncated;
+  }
+  // ID1, ID2, CM = deflate, and no reserved flags
+  if (p[0] != 0x1f or p[1] != 0x8b or p[2] != 8 or (p[3] & 0xe0)) {
+    return 0;
+  }
+  unsigned char flags = p[3];
+  size_t pos = 10;
+  if (flags & 0x04) {
+    // FEXTRA
+    if (pos + 2 > len) {
+      return truncated;
+    }
+    pos += 2 + (static_cast<size_t>(p[pos]) | (static_cast<size_t>(p[pos + 1]) << 8));
+  }
+  // FNAME, then FCOMMENT
+  for (unsigned char flag : {0x08, 0x10}) {
+    if (flags & flag) {
+      while (pos < len and p[pos] != 0) {
+        ++pos;
+      }
+      ++pos;
+    }
+  }
+  if (flags & 0x02) {
+    // FHCRC
+    pos += 2;
+  }
+  return (pos > len) ? truncated : pos;
+}
+}
+
+/**
+ * Reads the input a bit at a time (least significant bit of each byte
+ * first), keeping up to 64 bits of it in a register.  Past the end of the
+ * input it reads zeros; overrun() tells whether any of those were consumed.
+ */
+struct GzipChunkDecoder::BitReader {
+  const unsigned char* in;
+  size_t len;
+  size_t ip{0};
+  size_t pad{0};
+  uint64_t bits{0};
+  unsigned numBits{0};
+
+  BitReader(const unsigned char* in_, size_t len_) : in(in_), len(len_) {}
+
+  void seek(uint64_t bit) {
+    ip = std::min(static_cast<size_t>(bit >> 3), len);
+    pad = static_cast<size_t>(bit >> 3) - ip;
+    bits = 0;
+    numBits = 0;
+    refill();
+    consume(static_cast<unsigned>(bit & 7));
+  }
+
+  // make sure that at least 56 bits are available
+  inline void refill() {
+    if (ip + 8 <= len) {
+      bits |= load64(in + ip) << numBits;
+      ip += (63 - numBits) >> 3;
+      numBits |= 56;
+    } else {
+      while (numBits <= 56) {
+        uint64_t b{0};
+        if (ip < len) {
+          b = in[ip++];
+        } else {
+          ++pad;
+        }
+        bits |= b << numBits;
+        numBits += 8;
+      }
+    }
+  }
+  inline uint32_t peek(unsigned n) const {
+    return static_cast<uint32_t>(bits & ((uint64_t(1) << n) - 1));
+  }
+  inline void consume(unsigned n) {
+    bits >>= n;
+    numBits -= n;
+  }
+  inline uint32_t take(unsigned n) {
+    uint32_t x = peek(n);
+    consume(n);
+    return x;
+  }
+  uint64_t bitPos() const { return (ip + pad) * 8 - numBits; }
+  bool overrun() const { return pad > 0 and bitPos() > len * 8; }
+
+  // Decode a symbol with table; -1 if no code matches.
+  inline int decode(const uint32_t* table, unsigned rootBits) {
+    uint32_t e = table[peek(rootBits)];
+    if (e & SUBTABLE) {
+      consume(rootBits);
+      e = table[(e >> 16) + peek((e >> 5) & 0xf)];
+    }
+    unsigned n = e & 0xf;
+    if (n == 0) {
+      return -1;
+    }
+    consume(n);
+    return static_cast<int>(e >> 16);
+  }
+};
+
+bool GzipChunkDecoder::readDynamicTables_(BitReader& br) {
+  br.refill();
+  unsigned numLit = br.take(5) + 257;
+  unsigned numDist = br.take(5) + 1;
+  unsigned numCL = br.take(4) + 4;
+  if (numLit > 286 or numDist > 30) {
+    return false;
+  }
+  uint8_t clLens[19] = {0};
+  for (unsigned i = 0; i < numCL; ++i) {
+    br.refill();
+    clLens[CL_ORDER[i]] = static_cast<uint8_t>(br.take(3));
+  }
+  if (!buildTable(clLens, 19, CL_ROOT_BITS, true, clTable_)) {
+    return false;
+  }
+
+  uint8_t lens[286 + 30];
+  unsigned n{0};
+  while (n < numLit + numDist) {
+    br.refill();
+    int sym = br.decode(clTable_.data(), CL_ROOT_BITS);
+    if (sym < 0) {
+      return false;
+    }
+    if (sym < 16) {
+      lens[n++] = static_cast<uint8_t>(sym);
+      continue;
+    }
+    uint8_t value{0};
+    unsigned repeat{0};
+    if (sym == 16) {
+      if (n == 0) {
+        return false;
+      }
+      value = lens[n - 1];
+      repeat = 3 + br.take(2);
+    } else if (sym == 17) {
+      repeat = 3 + br.take(3);
+    } else {
+      repeat = 11 + br.take(7);
+    }
+    if (n + repeat > numLit + numDist) {
+      return false;
+    }
+    std::fill(lens + n, lens + n + repeat, value);
+    n += repeat;
+  }
+  if (br.overrun() or lens[256] == 0) {
+    return false;
+  }
+  return buildTable(lens, numLit, LIT_ROOT_BITS, false, litTable_) and
+         buildTable(lens + numLit, numDist, DIST_ROOT_BITS, false,
+                    distTable_);
+}
+
+GzipChunkDecoder::Status GzipChunkDecoder::decodeBlock_(BitReader& br,
+                                                        bool& final,
+                                                        size_t& outLen,
+                                                        Result& res) {
+  br.refill();
+  final = br.take(1);
+  unsigned type = br.take(2);
+  const uint32_t* lit{nullptr};
+  const uint32_t* dist{nullptr};
+  if (type == 0) {
+    // stored: LEN and NLEN at the next byte boundary, then LEN bytes
+    br.consume(br.numBits & 7);
+    uint32_t storedLen = br.take(16);
+    uint32_t check = br.take(16);
+    if (br.overrun()) {
+      return Status::NEED_INPUT;
+    }
+    if ((storedLen ^ 0xffff) != check) {
+      return Status::INVALID;
+    }
+    uint64_t pos = br.bitPos() >> 3;
+    if (pos + storedLen > br.len) {
+      return Status::NEED_INPUT;
+    }
+    if (res.out.size() < outLen + storedLen) {
+      res.out.resize(std::max(2 * res.out.size(), outLen + storedLen));
+    }
+    for (uint32_t i = 0; i < storedLen; ++i) {
+      res.out[outLen + i] = br.in[pos + i];
+    }
+    outLen += storedLen;
+    br.seek((pos + storedLen) * 8);
+    return Status::STOPPED;
+  } else if (type == 1) {
+    if (fixedLitTable_.empty()) {
+      // (including the codes of the symbols that can't occur: 286 and 287,
+      // and distances 30 and 31)
+      uint8_t lens[288 + 32];
+      std::fill(lens, lens + 144, 8);
+      std::fill(lens + 144, lens + 256, 9);
+      std::fill(lens + 256, lens + 280, 7);
+      std::fill(lens + 280, lens + 288, 8);
+      std::fill(lens + 288, lens + 320, 5);
+      buildTable(lens, 288, LIT_ROOT_BITS, false, fixedLitTable_);
+      buildTable(lens + 288, 32, DIST_ROOT_BITS, false, fixedDistTable_);
+    }
+    lit = fixedLitTable_.data();
+    dist = fixedDistTable_.data();
+  } else if (type == 2) {
+    if (!readDynamicTables_(br)) {
+      return br.overrun() ? Status::NEED_INPUT : Status::INVALID;
+    }
+    lit = litTable_.data();
+    dist = distTable_.data();
+  } else {
+    return Status::INVALID;
+  }
+
+  uint16_t* out = res.out.data();
+  size_t capacity = res.out.size();
+  size_t o = outLen;
+  while (true) {
+    if (o + 258 > capacity) {
+      res.out.resize(std::max<size_t>(2 * capacity, 1 << 16));
+      out = res.out.data();
+      capacity = res.out.size();
+    }
+    br.refill();
+    int sym = br.decode(lit, LIT_ROOT_BITS);
+    if (sym < 256) {
+      if (sym < 0) {
+        return br.overrun() ? Status::NEED_INPUT : Status::INVALID;
+      }
+      out[o++] = static_cast<uint16_t>(sym);
+      // (a second literal still fits in what was refilled)
+      sym = br.decode(lit, LIT_ROOT_BITS);
+      if (sym < 256) {
+        if (sym < 0) {
+          return br.overrun() ? Status::NEED_INPUT : Status::INVALID;
+        }
+        out[o++] = static_cast<uint16_t>(sym);
+        if (br.pad > 0 and br.overrun()) {
+          return Status::NEED_INPUT;
+        }
+        continue;
+      }
+      br.refill();
+    }
+    if (sym == 256) {
+      break;
+    }
+    sym -= 257;
+    if (sym >= 29) {
+      return Status::INVALID;
+    }
+    size_t length = LEN_BASE[sym] + br.take(LEN_EXTRA[sym]);
+    int dsym = br.decode(dist, DIST_ROOT_BITS);
+    if (dsym < 0 or dsym >= 30) {
+      return (br.overrun()) ? Status::NEED_INPUT : Status::INVALID;
+    }
+    size_t d = DIST_BASE[dsym] + br.take(DIST_EXTRA[dsym]);
+    if (br.pad > 0 and br.overrun()) {
+      return Status::NEED_INPUT;
+    }
+    uint16_t* dest = out + o;
+    if (d <= o) {
+      const uint16_t* src = dest - d;
+      if (d >= length) {
+        std::memcpy(dest, src, length * sizeof(uint16_t));
+      } else {
+        for (size_t i = 0; i < length; ++i) {
+          dest[i] = src[i];
+        }
+      }
+    } else {
+      // (partly) before the start of the decoding: refer to the window
+      size_t i{0};
+      for (; i < length and i < d - o; ++i) {
+        dest[i] = static_cast<uint16_t>(MARKER_BASE + WINDOW_SIZE - (d - o) + i);
+      }
+      for (; i < length; ++i) {
+        dest[i] = dest[i - d];
+      }
+    }
+    o += length;
+  }
+  if (br.overrun()) {
+    return Status::NEED_INPUT;
+  }
+  outLen = o;
+  return Status::STOPPED;
+}
+
+GzipChunkDecoder::Status
+GzipChunkDecoder::decode(const unsigned char* in, size_t len, uint64_t base,
+                         bool atEnd, uint64_t startBit, bool atHeader,
+                         uint64_t stopBit, size_t maxOut, Result& res) {
+  const uint64_t baseBit = base * 8;
+  BitReader br(in, len);
+  br.seek(startBit - baseBit);
+  const uint64_t stop = (stopBit > baseBit) ? stopBit - baseBit : 0;
+
+  res.startBit = startBit;
+  res.members.clear();
+  size_t outLen{0};
+  // the last position we could resume decoding from
+  uint64_t resume = startBit - baseBit;
+  bool resumeAtHeader = atHeader;
+  size_t resumeOut{0};
+  size_t resumeMembers{0};
+  bool header = atHeader;
+
+  Status status{Status::STOPPED};
+  while (true) {
+    if (header) {
+      uint64_t pos = br.bitPos() >> 3;
+      size_t avail = (pos < len) ? len - pos : 0;
+      if (avail < 2 and atEnd) {
+        status = Status::STREAM_END;
+        break;
+      }
+      if (avail >= 2 and (in[pos] != 0x1f or in[pos + 1] != 0x8b)) {
+        // whatever follows the last member is ignored (as gzread() does)
+        status = Status::STREAM_END;
+        break;
+      }
+      size_t hdrLen = gzipHeaderLength(in + pos, avail);
+      if (hdrLen == 0) {
+        status = Status::INVALID;
+        break;
+      }
+      if (hdrLen > avail) {
+        status = Status::NEED_INPUT;
+        break;
+      }
+      br.seek((pos + hdrLen) * 8);
+      header = false;
+    }
+
+    // at the start of a block
+    uint64_t pos = br.bitPos();
+    if (pos >= stop) {
+      status = Status::STOPPED;
+      break;
+    }
+    if (outLen >= maxOut) {
+      status = Status::OUTPUT_FULL;
+      break;
+    }
+    resume = pos;
+    resumeAtHeader = false;
+    resumeOut = outLen;
+    resumeMembers = res.members.size();
+
+    bool final{false};
+    status = decodeBlock_(br, final, outLen, res);
+    if (status != Status::STOPPED) {
+      break;
+    }
+    if (final) {
+      // the 8 byte trailer (CRC32, ISIZE) follows at the next byte boundary
+      uint64_t trailer = (br.bitPos() + 7) >> 3;
+      if (trailer + 8 > len) {
+        status = Status::NEED_INPUT;
+        break;
+      }
+      MemberEnd m;
+      m.outPos = outLen;
+      m.crc = le32(in + trailer);
+      m.isize = le32(in + trailer + 4);
+      res.members.push_back(m);
+      br.seek((trailer + 8) * 8);
+      header = true;
+      resume = br.bitPos();
+      resumeAtHeader = true;
+      resumeOut = outLen;
+      resumeMembers = res.members.size();
+    }
+  }
+
+  if (status == Status::NEED_INPUT) {
+    if (atEnd) {
+      // the stream is truncated
+      status = Status::INVALID;
+    } else {
+      outLen = resumeOut;
+      res.members.resize(resumeMembers);
+      res.endBit = resume + baseBit;
+      res.endAtHeader = resumeAtHeader;
+    }
+  } else {
+    res.endBit = br.bitPos() + baseBit;
+    res.endAtHeader = header;
+  }
+  res.outLen = outLen;
+  res.status = status;
+  return status;
+}
+
+/**
+ * A cheap test of whether a non-final dynamic block could start at bit: the
+ * header fields must be in range, and the code length code complete.
+ */
+bool GzipChunkDecoder::looksLikeBlock_(const unsigned char* in, size_t len,
+                                       uint64_t bit) const {
+  size_t pos = bit >> 3;
+  if (pos + 16 > len) {
+    return false;
+  }
+  uint64_t w = load64(in + pos) >> (bit & 7);
+  // BFINAL = 0, BTYPE = 2
+  if ((w & 7) != 4) {
+    return false;
+  }
+  if (((w >> 3) & 31) > 29 or ((w >> 8) & 31) > 29) {
+    return false;
+  }
+  unsigned numCL = ((w >> 13) & 15) + 4;
+  uint64_t bit2 = bit + 17;
+  uint64_t lens = load64(in + (bit2 >> 3)) >> (bit2 & 7);
+  // the Kraft sum of the code, in units of 2^-7
+  int sum{0};
+  for (unsigned i = 0; i < numCL; ++i) {
+    unsigned l = (lens >> (3 * i)) & 7;
+    if (l != 0) {
+      sum += 128 >> l;
+    }
+  }
+  return sum == 128;
+}
+
+bool GzipChunkDecoder::find(const unsigned char* in, size_t len,
+                            uint64_t base, bool atEnd, uint64_t fromBit,
+                            uint64_t toBit, uint64_t stopBit, size_t maxOut,
+                            Result& res) {
+  const uint64_t baseBit = base * 8;
+  for (uint64_t bit = fromBit; bit < toBit; ++bit) {
+    if (!looksLikeBlock_(in, len, bit - baseBit)) {
+      continue;
+    }
+    Status s = decode(in, len, base, atEnd, bit, false, stopBit, maxOut, res);
+    if (s == Status::STOPPED or s == Status::STREAM_END or
+        s == Status::OUTPUT_FULL) {
+      return true;
+    }
+    if (s == Status::NEED_INPUT) {
+      // (we can't tell a block that runs past the end of the input from one
+      // that doesn't exist, unless it was followed by another)
+      return res.endBit > bit;
+    }
+  }
+  return false;
+}
+
+bool GzipChunkDecoder::resolve(const uint16_t* syms, size_t n,
+                               const unsigned char* window, size_t windowLen,
+                               unsigned char* out) {
+  const size_t missing = WINDOW_SIZE - windowLen;
+  for (size_t i = 0; i < n; ++i) {
+    uint16_t s = syms[i];
+    if (s < MARKER_BASE) {
+      out[i] = static_cast<unsigned char>(s);
+    } else {
+      size_t j = s - MARKER_BASE;
+      if (j < missing) {
+        return false;
+      }
+      out[i] = window[j - missing];
+    }
+  }
+  return true;
+}
+}
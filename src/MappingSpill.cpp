@@ -0,0 +1,67 @@
+#include "MappingSpill.hpp"
+
+#include <cstdio>
+#include <sys/types.h>
+
+MappingSpill::MappingSpill(const std::string& path) : path_(path) {
+  file_ = std::fopen(path_.c_str(), "w+b");
+}
+
+MappingSpill::~MappingSpill() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+    file_ = nullptr;
+    std::remove(path_.c_str());
+  }
+}
+
+void MappingSpill::writeRaw_(const BatchHeader& h,
+                             const std::vector<char>& buf) {
+  std::lock_guard<std::mutex> lock(mut_);
+  if (!good()) {
+    return;
+  }
+  bool ok = std::fwrite(&h, sizeof(h), 1, file_) == 1;
+  if (ok and !buf.empty()) {
+    ok = std::fwrite(buf.data(), buf.size(), 1, file_) == 1;
+  }
+  if (!ok) {
+    failed_ = true;
+    return;
+  }
+  numFragments_ += h.numFragments;
+  numBytes_ += sizeof(h) + buf.size();
+}
+
+bool MappingSpill::rewind() {
+  std::lock_guard<std::mutex> lock(mut_);
+  if (!good()) {
+    return false;
+  }
+  if (std::fflush(file_) != 0 or fseeko(file_, 0, SEEK_SET) != 0) {
+    failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+bool MappingSpill::readRaw_(BatchHeader& h, std::vector<char>& buf) {
+  std::lock_guard<std::mutex> lock(mut_);
+  if (!good()) {
+    return false;
+  }
+  size_t n = std::fread(&h, 1, sizeof(h), file_);
+  if (n != sizeof(h)) {
+    // A clean end of the spill, unless we stopped part way through a header
+    if (n != 0 or std::ferror(file_)) {
+      failed_ = true;
+    }
+    return false;
+  }
+  buf.resize(h.numBytes);
+  if (h.numBytes > 0 and std::fread(buf.data(), h.numBytes, 1, file_) != 1) {
+    failed_ = true;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,1034 @@
+#include "ParallelGzipReader.hpp"
+
+#include "fcntl.h"
+#include "unistd.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <zlib.h>
+
+namespace fastx_parser {
+
+namespace {
+// how much raw input we try to read from the file at once
+constexpr const size_t RAW_READ_BYTES = 1 << 20;
+// size (and alignment) of the buffers filled by the read-ahead I/O thread
+constexpr const size_t IO_BLOCK_BYTES = 1 << 21;
+constexpr const size_t IO_ALIGNMENT = 4096;
+// size of the decompressed blocks produced for PLAIN and GZIP input
+constexpr const size_t OUT_BLOCK_BYTES = 1 << 20;
+// amount of compressed BGZF data batched into a single inflater job
+constexpr const size_t BGZF_JOB_BYTES = 1 << 18;
+// size of the chunks a regular gzip file is cut into, to be inflated in
+// parallel, and how much of the next chunk each of them is given
+constexpr const size_t CHUNK_BYTES = 1 << 20;
+constexpr const size_t CHUNK_OVERLAP = 1 << 18;
+// a chunk (of very compressible data) is inflated this many bytes at a time
+constexpr const size_t MAX_CHUNK_OUT = 1 << 24;
+// a BGZF header is a gzip header with (at least) the 6 byte "BC" extra field
+constexpr const size_t BGZF_MIN_HEADER = 18;
+constexpr const size_t GZIP_TRAILER = 8;
+
+inline uint16_t le16(const unsigned char* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t le32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline bool isGzipMagic(const unsigned char* p) {
+  return p[0] == 0x1f and p[1] == 0x8b;
+}
+
+/**
+ * Given the (at least 12 + XLEN bytes of the) header of a gzip member, returns
+ * the total size of the member as recorded in its BGZF "BC" extra subfield,
+ * or 0 if this is not a BGZF block.
+ */
+size_t bgzfBlockSize(const unsigned char* hdr) {
+  // ID1, ID2, CM = deflate and FLG.FEXTRA set
+  if (!isGzipMagic(hdr) or hdr[2] != 8 or !(hdr[3] & 0x04)) {
+    return 0;
+  }
+  uint16_t xlen = le16(hdr + 10);
+  const unsigned char* sub = hdr + 12;
+  const unsigned char* subEnd = sub + xlen;
+  while (sub + 4 <= subEnd) {
+    uint16_t slen = le16(sub + 2);
+    if (sub[0] == 'B' and sub[1] == 'C' and slen == 2 and sub + 6 <= subEnd) {
+      return static_cast<size_t>(le16(sub + 4)) + 1;
+    }
+    sub += 4 + slen;
+  }
+  return 0;
+}
+}
+
+ParallelGzipReader::ParallelGzipReader(uint32_t numInflaters,
+                                       uint32_t readAheadDepth)
+    : numInflaters_(std::max(numInflaters, uint32_t(1))),
+      readAheadDepth_(readAheadDepth), maxInFlight_(4 * numInflaters_ + 2),
+      maxChunks_(2 * numInflaters_ + 2) {}
+
+ParallelGzipReader::~ParallelGzipReader() { close(); }
+
+bool ParallelGzipReader::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  stop_ = false;
+  readerDone_ = false;
+  failed_ = false;
+  rawEOF_ = false;
+  rawBeg_ = rawEnd_ = 0;
+  raw_.resize(RAW_READ_BYTES);
+  inputDone_ = false;
+  streamDone_ = false;
+  sequencing_ = false;
+  needInput_ = false;
+  nextBit_ = 0;
+  nextAtHeader_ = true;
+  window_.clear();
+  crc_ = crc32(0L, Z_NULL, 0);
+  isize_ = 0;
+
+  if (readAheadDepth_ > 0) {
+    ioStop_ = false;
+    ioPos_ = 0;
+    ioThread_ = std::thread([this]() { this->ioReader_(); });
+  }
+
+  // Sniff the format from the first bytes of the file.  We can't seek back
+  // (the input may be a pipe), so whatever is read here stays in raw_ and
+  // is consumed by the reader thread.
+  if (!fillRaw_(BGZF_MIN_HEADER)) {
+    close();
+    return false;
+  }
+  const unsigned char* hdr = raw_.data() + rawBeg_;
+  if (rawAvail_() >= 2 and isGzipMagic(hdr)) {
+    mode_ = (rawAvail_() >= BGZF_MIN_HEADER and
+             rawAvail_() >= 12 + static_cast<size_t>(le16(hdr + 10)) and
+             bgzfBlockSize(hdr) > 0)
+                ? Mode::BGZF
+                : Mode::GZIP;
+  } else {
+    mode_ = Mode::PLAIN;
+  }
+
+  switch (mode_) {
+  case Mode::PLAIN:
+    readerThread_ = std::thread([this]() { this->readerPlain_(); });
+    break;
+  case Mode::GZIP:
+    if (numInflaters_ > 1) {
+      for (size_t i = 0; i < numInflaters_; ++i) {
+        inflaterThreads_.emplace_back([this]() { this->chunkInflater_(); });
+      }
+      readerThread_ = std::thread([this]() { this->readerGzipChunks_(); });
+    } else {
+      readerThread_ = std::thread([this]() { this->readerGzip_(); });
+    }
+    break;
+  case Mode::BGZF:
+    for (size_t i = 0; i < numInflaters_; ++i) {
+      inflaterThreads_.emplace_back([this]() { this->inflater_(); });
+    }
+    readerThread_ = std::thread([this]() { this->readerBGZF_(); });
+    break;
+  }
+  return true;
+}
+
+void ParallelGzipReader::close() {
+  {
+    std::lock_guard<std::mutex> l(mut_);
+    stop_ = true;
+  }
+  {
+    std::lock_guard<std::mutex> l(ioMut_);
+    ioStop_ = true;
+  }
+  readyCV_.notify_all();
+  spaceCV_.notify_all();
+  workCV_.notify_all();
+  chunkSpaceCV_.notify_all();
+  moreInputCV_.notify_all();
+  ioFilledCV_.notify_all();
+  ioFreeCV_.notify_all();
+
+  if (readerThread_.joinable()) {
+    readerThread_.join();
+  }
+  for (auto& t : inflaterThreads_) {
+    t.join();
+  }
+  inflaterThreads_.clear();
+  if (ioThread_.joinable()) {
+    ioThread_.join();
+  }
+
+  // keep the buffers around in case this reader is re-opened
+  for (auto& blk : inFlight_) {
+    freeBlocks_.push_back(std::move(blk));
+  }
+  inFlight_.clear();
+  toInflate_.clear();
+  for (auto& chunk : chunks_) {
+    freeChunks_.push_back(std::move(chunk));
+  }
+  chunks_.clear();
+  toDecode_.clear();
+  if (cur_) {
+    freeBlocks_.push_back(std::move(cur_));
+  }
+  for (auto& buf : ioFilled_) {
+    ioFree_.push_back(std::move(buf));
+  }
+  ioFilled_.clear();
+  if (ioCur_) {
+    ioFree_.push_back(std::move(ioCur_));
+  }
+
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+int ParallelGzipReader::next(const unsigned char*& buf) {
+  while (!failed_) {
+    // Hand back the block the consumer is done with and wait for the next
+    // one (in file order) to become ready.
+    std::unique_lock<std::mutex> l(mut_);
+    if (cur_) {
+      freeBlocks_.push_back(std::move(cur_));
+    }
+    readyCV_.wait(l, [this]() -> bool {
+      return stop_ or (!inFlight_.empty() and inFlight_.front()->ready) or
+             (inFlight_.empty() and readerDone_);
+    });
+    if (inFlight_.empty() or !inFlight_.front()->ready) {
+      // end of the stream (or we were stopped)
+      return 0;
+    }
+    cur_ = std::move(inFlight_.front());
+    inFlight_.pop_front();
+    l.unlock();
+    spaceCV_.notify_one();
+
+    if (cur_->failed) {
+      failed_ = true;
+    } else if (cur_->outLen > 0) {
+      buf = cur_->out.data();
+      return static_cast<int>(cur_->outLen);
+    }
+  }
+  return -1;
+}
+
+ssize_t ParallelGzipReader::readFd_(unsigned char* dest, size_t len) {
+  ssize_t n{0};
+  do {
+    n = ::read(fd_, dest, len);
+  } while (n < 0 and errno == EINTR);
+  return n;
+}
+
+/**
+ * Runs on the I/O thread: reads the file, front to back, into the read-ahead
+ * buffers.  At most readAheadDepth_ buffers are filled (or being consumed) at
+ * any time.
+ */
+void ParallelGzipReader::ioReader_() {
+  // Let the kernel know that we'll read the whole file sequentially, so that
+  // it can read ahead more aggressively (this fails harmlessly on a pipe).
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  size_t numAllocated{0};
+  {
+    std::lock_guard<std::mutex> l(ioMut_);
+    numAllocated = ioFree_.size();
+  }
+  off_t offset{0};
+  bool done{false};
+  while (!done) {
+    std::unique_ptr<IOBuffer> buf{nullptr};
+    {
+      std::unique_lock<std::mutex> l(ioMut_);
+      ioFreeCV_.wait(l, [this, numAllocated]() -> bool {
+        return ioStop_ or !ioFree_.empty() or numAllocated < readAheadDepth_;
+      });
+      if (ioStop_) {
+        break;
+      }
+      if (!ioFree_.empty()) {
+        buf = std::move(ioFree_.back());
+        ioFree_.pop_back();
+      }
+    }
+    if (!buf) {
+      buf.reset(new IOBuffer);
+      void* p{nullptr};
+      if (posix_memalign(&p, IO_ALIGNMENT, IO_BLOCK_BYTES) == 0) {
+        buf->data.reset(static_cast<unsigned char*>(p));
+      }
+      ++numAllocated;
+    }
+
+    buf->len = 0;
+    buf->eof = false;
+    buf->failed = !buf->data;
+    if (!buf->failed) {
+      // Have the kernel start on the next block while we wait on this one.
+      posix_fadvise(fd_, offset + static_cast<off_t>(IO_BLOCK_BYTES),
+                    IO_BLOCK_BYTES, POSIX_FADV_WILLNEED);
+      while (buf->len < IO_BLOCK_BYTES) {
+        ssize_t n =
+            readFd_(buf->data.get() + buf->len, IO_BLOCK_BYTES - buf->len);
+        if (n < 0) {
+          buf->failed = true;
+          break;
+        }
+        if (n == 0) {
+          buf->eof = true;
+          break;
+        }
+        buf->len += static_cast<size_t>(n);
+      }
+      offset += static_cast<off_t>(buf->len);
+    }
+    done = buf->eof or buf->failed;
+
+    {
+      std::lock_guard<std::mutex> l(ioMut_);
+      ioFilled_.push_back(std::move(buf));
+    }
+    ioFilledCV_.notify_one();
+  }
+}
+
+/**
+ * Read up to len bytes of the file into dest, from the read-ahead buffers
+ * (or straight from the file if read-ahead is disabled).  Returns the number
+ * of bytes read, 0 at the end of the file, and -1 on an error.
+ */
+ssize_t ParallelGzipReader::readInput_(unsigned char* dest, size_t len) {
+  if (readAheadDepth_ == 0) {
+    return readFd_(dest, len);
+  }
+  while (!ioCur_ or ioPos_ == ioCur_->len) {
+    if (ioCur_ and ioCur_->failed) {
+      return -1;
+    }
+    if (ioCur_ and ioCur_->eof) {
+      return 0;
+    }
+    if (ioCur_) {
+      {
+        std::lock_guard<std::mutex> l(ioMut_);
+        ioFree_.push_back(std::move(ioCur_));
+      }
+      ioFreeCV_.notify_one();
+    }
+    std::unique_lock<std::mutex> l(ioMut_);
+    ioFilledCV_.wait(
+        l, [this]() -> bool { return ioStop_ or !ioFilled_.empty(); });
+    if (ioFilled_.empty()) {
+      // we were stopped
+      return -1;
+    }
+    ioCur_ = std::move(ioFilled_.front());
+    ioFilled_.pop_front();
+    ioPos_ = 0;
+  }
+  size_t n = std::min(len, ioCur_->len - ioPos_);
+  std::memcpy(dest, ioCur_->data.get() + ioPos_, n);
+  ioPos_ += n;
+  return static_cast<ssize_t>(n);
+}
+
+/**
+ * Make sure that at least need bytes of raw input are available (or that
+ * we've hit the end of the file).  Returns false on a read error.
+ */
+bool ParallelGzipReader::fillRaw_(size_t need) {
+  if (rawAvail_() >= need or rawEOF_) {
+    return true;
+  }
+  // move what's left to the front of the buffer
+  if (rawBeg_ > 0) {
+    std::memmove(raw_.data(), raw_.data() + rawBeg_, rawAvail_());
+    rawEnd_ -= rawBeg_;
+    rawBeg_ = 0;
+  }
+  if (raw_.size() < need) {
+    raw_.resize(need);
+  }
+  while (rawEnd_ < need) {
+    ssize_t n = readInput_(raw_.data() + rawEnd_, raw_.size() - rawEnd_);
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      rawEOF_ = true;
+      break;
+    }
+    rawEnd_ += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+std::unique_ptr<ParallelGzipReader::Block> ParallelGzipReader::acquireBlock_() {
+  std::unique_lock<std::mutex> l(mut_);
+  spaceCV_.wait(
+      l, [this]() -> bool { return stop_ or inFlight_.size() < maxInFlight_; });
+  if (stop_) {
+    return nullptr;
+  }
+  std::unique_ptr<Block> blk{nullptr};
+  if (freeBlocks_.empty()) {
+    blk.reset(new Block);
+  } else {
+    blk = std::move(freeBlocks_.back());
+    freeBlocks_.pop_back();
+  }
+  blk->in.clear();
+  blk->outLen = 0;
+  blk->ready = false;
+  blk->failed = false;
+  return blk;
+}
+
+void ParallelGzipReader::submitBlock_(std::unique_ptr<Block>&& blk,
+                                      bool needsInflate) {
+  {
+    std::lock_guard<std::mutex> l(mut_);
+    blk->ready = !needsInflate;
+    if (needsInflate) {
+      toInflate_.push_back(blk.get());
+    }
+    inFlight_.push_back(std::move(blk));
+  }
+  if (needsInflate) {
+    workCV_.notify_one();
+  } else {
+    readyCV_.notify_all();
+  }
+}
+
+void ParallelGzipReader::submitError_() {
+  auto blk = acquireBlock_();
+  if (blk) {
+    blk->failed = true;
+    submitBlock_(std::move(blk), false);
+  }
+}
+
+void ParallelGzipReader::finishReading_() {
+  {
+    std::lock_guard<std::mutex> l(mut_);
+    readerDone_ = true;
+  }
+  readyCV_.notify_all();
+  workCV_.notify_all();
+}
+
+void ParallelGzipReader::readerPlain_() {
+  bool done{false};
+  while (!done) {
+    auto blk = acquireBlock_();
+    if (!blk) {
+      break;
+    }
+    if (blk->out.size() < OUT_BLOCK_BYTES) {
+      blk->out.resize(OUT_BLOCK_BYTES);
+    }
+    // first hand over anything that was buffered while sniffing the format
+    size_t n = std::min(rawAvail_(), blk->out.size());
+    std::memcpy(blk->out.data(), raw_.data() + rawBeg_, n);
+    rawBeg_ += n;
+    while (n < blk->out.size()) {
+      ssize_t r = readInput_(blk->out.data() + n, blk->out.size() - n);
+      if (r < 0) {
+        blk->failed = true;
+        done = true;
+        break;
+      }
+      if (r == 0) {
+        done = true;
+        break;
+      }
+      n += static_cast<size_t>(r);
+    }
+    blk->outLen = n;
+    submitBlock_(std::move(blk), false);
+  }
+  finishReading_();
+}
+
+void ParallelGzipReader::readerGzip_() {
+  z_stream strm;
+  std::memset(&strm, 0, sizeof(strm));
+  // 15 + 16 : expect a gzip header and trailer
+  if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+    submitError_();
+    finishReading_();
+    return;
+  }
+
+  bool memberDone{false};
+  bool done{false};
+  bool ok{true};
+  while (!done) {
+    auto blk = acquireBlock_();
+    if (!blk) {
+      break;
+    }
+    if (blk->out.size() < OUT_BLOCK_BYTES) {
+      blk->out.resize(OUT_BLOCK_BYTES);
+    }
+    strm.next_out = blk->out.data();
+    strm.avail_out = static_cast<uInt>(blk->out.size());
+
+    while (strm.avail_out > 0) {
+      if (rawAvail_() == 0) {
+        if (!fillRaw_(1)) {
+          ok = false;
+          break;
+        }
+        if (rawAvail_() == 0) {
+          // A stream that ends in the middle of a member is truncated.
+          ok = memberDone;
+          done = true;
+          break;
+        }
+      }
+      strm.next_in = raw_.data() + rawBeg_;
+      strm.avail_in = static_cast<uInt>(rawAvail_());
+      memberDone = false;
+      int ret = inflate(&strm, Z_NO_FLUSH);
+      rawBeg_ = rawEnd_ - strm.avail_in;
+
+      if (ret == Z_STREAM_END) {
+        memberDone = true;
+        // A gzip file may consist of several concatenated members; anything
+        // else following a member is ignored (as gzread() does).
+        if (!fillRaw_(2)) {
+          ok = false;
+          break;
+        }
+        if (rawAvail_() >= 2 and isGzipMagic(raw_.data() + rawBeg_)) {
+          inflateReset(&strm);
+        } else {
+          done = true;
+          break;
+        }
+      } else if (ret != Z_OK and ret != Z_BUF_ERROR) {
+        ok = false;
+        break;
+      }
+    }
+
+    blk->outLen = blk->out.size() - strm.avail_out;
+    blk->failed = !ok;
+    submitBlock_(std::move(blk), false);
+    if (!ok) {
+      break;
+    }
+  }
+  inflateEnd(&strm);
+  finishReading_();
+}
+
+void ParallelGzipReader::readerBGZF_() {
+  bool done{false};
+  while (!done) {
+    auto blk = acquireBlock_();
+    if (!blk) {
+      break;
+    }
+    // Batch consecutive BGZF blocks into a single job; the inflated size of
+    // each block is recorded in its trailer, so we can size the output exactly.
+    size_t outSize{0};
+    bool ok{true};
+    while (blk->in.size() < BGZF_JOB_BYTES) {
+      if (!fillRaw_(BGZF_MIN_HEADER)) {
+        ok = false;
+        break;
+      }
+      if (rawAvail_() == 0) {
+        done = true;
+        break;
+      }
+      const unsigned char* hdr = raw_.data() + rawBeg_;
+      if (rawAvail_() < BGZF_MIN_HEADER or !isGzipMagic(hdr)) {
+        // truncated block or garbage between blocks
+        ok = false;
+        break;
+      }
+      size_t hdrLen = 12 + static_cast<size_t>(le16(hdr + 10));
+      if (!fillRaw_(hdrLen) or rawAvail_() < hdrLen) {
+        ok = false;
+        break;
+      }
+      size_t blockSize = bgzfBlockSize(raw_.data() + rawBeg_);
+      if (blockSize < hdrLen + GZIP_TRAILER) {
+        // not (or no longer) a BGZF stream
+        ok = false;
+        break;
+      }
+      if (!fillRaw_(blockSize) or rawAvail_() < blockSize) {
+        ok = false;
+        break;
+      }
+      const unsigned char* block = raw_.data() + rawBeg_;
+      outSize += le32(block + blockSize - 4);
+      blk->in.insert(blk->in.end(), block, block + blockSize);
+      rawBeg_ += blockSize;
+    }
+
+    if (!ok) {
+      blk->failed = true;
+      submitBlock_(std::move(blk), false);
+      break;
+    }
+    if (blk->in.empty()) {
+      continue;
+    }
+    if (blk->out.size() < outSize) {
+      blk->out.resize(outSize);
+    }
+    submitBlock_(std::move(blk), true);
+  }
+  finishReading_();
+}
+
+void ParallelGzipReader::inflater_() {
+  z_stream strm;
+  std::memset(&strm, 0, sizeof(strm));
+  // BGZF blocks are inflated as raw deflate streams; we parse the gzip
+  // header and check the trailer ourselves.
+  bool initOK = (inflateInit2(&strm, -15) == Z_OK);
+
+  while (true) {
+    Block* blk{nullptr};
+    {
+      std::unique_lock<std::mutex> l(mut_);
+      workCV_.wait(l, [this]() -> bool {
+        return stop_ or readerDone_ or !toInflate_.empty();
+      });
+      if (stop_ or toInflate_.empty()) {
+        break;
+      }
+      blk = toInflate_.front();
+      toInflate_.pop_front();
+    }
+
+    bool ok{initOK};
+    size_t inPos{0};
+    size_t outPos{0};
+    while (ok and inPos < blk->in.size()) {
+      const unsigned char* hdr = blk->in.data() + inPos;
+      size_t hdrLen = 12 + static_cast<size_t>(le16(hdr + 10));
+      // (already validated by the reader thread)
+      size_t blockSize = bgzfBlockSize(hdr);
+      uint32_t crc = le32(hdr + blockSize - 8);
+      uint32_t isize = le32(hdr + blockSize - 4);
+      inPos += blockSize;
+      // e.g. the empty EOF marker block
+      if (isize == 0) {
+        continue;
+      }
+      inflateReset(&strm);
+      strm.next_in = const_cast<unsigned char*>(hdr + hdrLen);
+      strm.avail_in = static_cast<uInt>(blockSize - hdrLen - GZIP_TRAILER);
+      strm.next_out = blk->out.data() + outPos;
+      strm.avail_out = isize;
+      int ret = inflate(&strm, Z_FINISH);
+      ok = (ret == Z_STREAM_END and strm.avail_out == 0 and
+            crc32(crc32(0L, Z_NULL, 0), blk->out.data() + outPos, isize) ==
+                crc);
+      outPos += isize;
+    }
+
+    {
+      std::lock_guard<std::mutex> l(mut_);
+      blk->outLen = ok ? outPos : 0;
+      blk->failed = !ok;
+      blk->ready = true;
+    }
+    readyCV_.notify_all();
+  }
+
+  if (initOK) {
+    inflateEnd(&strm);
+  }
+}
+
+/**
+ * Runs on the reader thread for a regular gzip file (with more than one
+ * inflater): cuts the file into chunks of CHUNK_BYTES, and hands each of
+ * them, with the start of the next one, to the inflater threads.
+ */
+void ParallelGzipReader::readerGzipChunks_() {
+  uint64_t offset{0};
+  std::unique_ptr<GzipChunk> prev{nullptr};
+  while (true) {
+    std::unique_ptr<GzipChunk> chunk{nullptr};
+    {
+      std::lock_guard<std::mutex> l(mut_);
+      if (!freeChunks_.empty()) {
+        chunk = std::move(freeChunks_.back());
+        freeChunks_.pop_back();
+      }
+    }
+    if (!chunk) {
+      chunk.reset(new GzipChunk);
+    }
+    chunk->offset = offset;
+    chunk->last = false;
+    chunk->failed = false;
+    chunk->atHeader = (offset == 0);
+    chunk->decoded = false;
+    chunk->found = false;
+    chunk->in.resize(CHUNK_BYTES + CHUNK_OVERLAP);
+
+    // first hand over anything that was buffered while sniffing the format
+    size_t n = std::min(rawAvail_(), CHUNK_BYTES);
+    std::memcpy(chunk->in.data(), raw_.data() + rawBeg_, n);
+    rawBeg_ += n;
+    bool eof{false};
+    while (n < CHUNK_BYTES) {
+      ssize_t r = readInput_(chunk->in.data() + n, CHUNK_BYTES - n);
+      if (r < 0) {
+        chunk->failed = true;
+        break;
+      }
+      if (r == 0) {
+        eof = true;
+        break;
+      }
+      n += static_cast<size_t>(r);
+    }
+    chunk->ownLen = n;
+    offset += n;
+
+    if (prev) {
+      size_t overlap = std::min(n, CHUNK_OVERLAP);
+      prev->in.resize(prev->ownLen + overlap);
+      std::memcpy(prev->in.data() + prev->ownLen, chunk->in.data(), overlap);
+      prev->last = (n == 0 and !chunk->failed);
+      if (!publishChunk_(std::move(prev))) {
+        break;
+      }
+    }
+    if (chunk->failed or eof) {
+      if (chunk->failed or n > 0 or offset == 0) {
+        chunk->in.resize(n);
+        chunk->last = true;
+        publishChunk_(std::move(chunk));
+      }
+      break;
+    }
+    prev = std::move(chunk);
+  }
+
+  {
+    std::lock_guard<std::mutex> l(mut_);
+    inputDone_ = true;
+  }
+  workCV_.notify_all();
+  moreInputCV_.notify_all();
+}
+
+// Queue chunk to be inflated; returns false if nothing more is wanted.
+bool ParallelGzipReader::publishChunk_(std::unique_ptr<GzipChunk>&& chunk) {
+  {
+    std::unique_lock<std::mutex> l(mut_);
+    // (the sequencer may need more input than fits, to get past a very long
+    // deflate block)
+    chunkSpaceCV_.wait(l, [this]() -> bool {
+      return stop_ or streamDone_ or needInput_ or chunks_.size() < maxChunks_;
+    });
+    if (stop_ or streamDone_) {
+      return false;
+    }
+    toDecode_.push_back(chunk.get());
+    chunks_.push_back(std::move(chunk));
+  }
+  workCV_.notify_one();
+  moreInputCV_.notify_all();
+  return true;
+}
+
+void ParallelGzipReader::chunkInflater_() {
+  GzipChunkDecoder decoder;
+  while (true) {
+    GzipChunk* chunk{nullptr};
+    {
+      std::unique_lock<std::mutex> l(mut_);
+      workCV_.wait(l, [this]() -> bool {
+        return stop_ or inputDone_ or !toDecode_.empty();
+      });
+      if (stop_ or toDecode_.empty()) {
+        break;
+      }
+      chunk = toDecode_.front();
+      toDecode_.pop_front();
+    }
+
+    if (!chunk->failed) {
+      uint64_t end = (chunk->offset + chunk->ownLen) * 8;
+      if (chunk->atHeader) {
+        chunk->found = decoder.decode(chunk->in.data(), chunk->in.size(),
+                                      chunk->offset, chunk->last, 0, true, end,
+                                      MAX_CHUNK_OUT, chunk->result) !=
+                       GzipChunkDecoder::Status::INVALID;
+      } else {
+        chunk->found = decoder.find(chunk->in.data(), chunk->in.size(),
+                                    chunk->offset, chunk->last,
+                                    chunk->offset * 8, end, end,
+                                    MAX_CHUNK_OUT, chunk->result);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> l(mut_);
+      chunk->decoded = true;
+      if (sequencing_) {
+        continue;
+      }
+      sequencing_ = true;
+    }
+    sequenceChunks_(decoder);
+  }
+}
+
+/**
+ * Deliver the chunks at the front of the queue, in file order, for as long as
+ * they have been inflated.  Only one thread at a time does this.
+ */
+void ParallelGzipReader::sequenceChunks_(GzipChunkDecoder& decoder) {
+  while (true) {
+    GzipChunk* chunk{nullptr};
+    {
+      std::lock_guard<std::mutex> l(mut_);
+      if (stop_ or streamDone_ or chunks_.empty() or
+          !chunks_.front()->decoded) {
+        sequencing_ = false;
+        return;
+      }
+      chunk = chunks_.front().get();
+    }
+    bool more = sequenceChunk_(*chunk, decoder);
+    {
+      std::lock_guard<std::mutex> l(mut_);
+      freeChunks_.push_back(std::move(chunks_.front()));
+      chunks_.pop_front();
+      if (!more) {
+        // the end of the stream, an error, or we were stopped
+        streamDone_ = true;
+        toDecode_.clear();
+      }
+    }
+    chunkSpaceCV_.notify_one();
+    if (!more) {
+      finishReading_();
+      chunkSpaceCV_.notify_all();
+    }
+  }
+}
+
+/**
+ * Deliver the part of the stream from nextBit_ up to the first block that
+ * starts after chunk.  That's chunk's own result if it starts there;
+ * otherwise (or if it stopped short), the stream is inflated from there on
+ * this thread.  Returns false once the stream has ended (or failed).
+ */
+bool ParallelGzipReader::sequenceChunk_(GzipChunk& chunk,
+                                        GzipChunkDecoder& decoder) {
+  using Status = GzipChunkDecoder::Status;
+  if (chunk.failed) {
+    submitError_();
+    return false;
+  }
+  const uint64_t end = (chunk.offset + chunk.ownLen) * 8;
+  if (nextBit_ >= end) {
+    // the preceding chunk was inflated past this one
+    return true;
+  }
+
+  const GzipChunkDecoder::Result* res{nullptr};
+  if (chunk.found and chunk.result.startBit == nextBit_ and
+      chunk.atHeader == nextAtHeader_) {
+    res = &chunk.result;
+  }
+  while (true) {
+    if (!res) {
+      // Inflate from where the stream is known to be, with as many of the
+      // following chunks as it takes to get past the end of this one.
+      size_t numChunks{1};
+      while (true) {
+        std::vector<GzipChunk*> input;
+        {
+          std::unique_lock<std::mutex> l(mut_);
+          needInput_ = (numChunks > chunks_.size());
+          if (needInput_) {
+            chunkSpaceCV_.notify_all();
+            moreInputCV_.wait(l, [this, numChunks]() -> bool {
+              return stop_ or inputDone_ or numChunks <= chunks_.size();
+            });
+            needInput_ = false;
+            if (stop_) {
+              return false;
+            }
+            numChunks = std::min(numChunks, chunks_.size());
+          }
+          for (size_t i = 0; i < numChunks; ++i) {
+            input.push_back(chunks_[i].get());
+          }
+        }
+        if (input.back()->failed) {
+          submitError_();
+          return false;
+        }
+
+        uint64_t from = nextBit_ >> 3;
+        const unsigned char* in{nullptr};
+        size_t len{0};
+        if (input.size() == 1) {
+          in = chunk.in.data() + (from - chunk.offset);
+          len = chunk.in.size() - (from - chunk.offset);
+        } else {
+          seqInput_.clear();
+          for (size_t i = 0; i + 1 < input.size(); ++i) {
+            GzipChunk* c = input[i];
+            size_t skip = (i == 0) ? from - c->offset : 0;
+            seqInput_.insert(seqInput_.end(), c->in.data() + skip,
+                             c->in.data() + c->ownLen);
+          }
+          seqInput_.insert(seqInput_.end(), input.back()->in.begin(),
+                           input.back()->in.end());
+          in = seqInput_.data();
+          len = seqInput_.size();
+        }
+        Status s = decoder.decode(in, len, from, input.back()->last, nextBit_,
+                                  nextAtHeader_, end, MAX_CHUNK_OUT,
+                                  seqResult_);
+        if (s == Status::NEED_INPUT and seqResult_.endBit == nextBit_ and
+            !input.back()->last) {
+          // not even a single block fits in what we have
+          numChunks = input.size() + 1;
+          continue;
+        }
+        break;
+      }
+      res = &seqResult_;
+    }
+
+    if (res->status == Status::INVALID) {
+      submitError_();
+      return false;
+    }
+    if (!deliver_(*res)) {
+      return false;
+    }
+    nextBit_ = res->endBit;
+    nextAtHeader_ = res->endAtHeader;
+    if (res->status == Status::STREAM_END) {
+      return false;
+    }
+    if (res->status == Status::STOPPED) {
+      return true;
+    }
+    // (OUTPUT_FULL or NEED_INPUT) carry on from where it stopped
+    res = nullptr;
+  }
+}
+
+/**
+ * Turn the symbols of res into bytes, check them against the trailers of
+ * the gzip members that end in them, and hand them to the consumer.
+ */
+bool ParallelGzipReader::deliver_(const GzipChunkDecoder::Result& res) {
+  const size_t W = GzipChunkDecoder::WINDOW_SIZE;
+  // the window that follows res, from its last (up to) 32KiB
+  size_t tailLen = std::min(res.outLen, W);
+  windowTail_.resize(tailLen);
+  if (!GzipChunkDecoder::resolve(res.out.data() + res.outLen - tailLen,
+                                 tailLen, window_.data(), window_.size(),
+                                 windowTail_.data())) {
+    submitError_();
+    return false;
+  }
+
+  size_t member{0};
+  auto checkMember = [&](const unsigned char* data, size_t from,
+                         size_t to) -> bool {
+    // (from and to are positions in res.out, data holds position from)
+    while (member < res.members.size() and res.members[member].outPos <= to) {
+      const GzipChunkDecoder::MemberEnd& m = res.members[member];
+      if (m.outPos > from) {
+        crc_ = crc32(crc_, data, static_cast<uInt>(m.outPos - from));
+        isize_ += static_cast<uint32_t>(m.outPos - from);
+        data += m.outPos - from;
+        from = m.outPos;
+      }
+      if (crc_ != m.crc or isize_ != m.isize) {
+        return false;
+      }
+      crc_ = crc32(0L, Z_NULL, 0);
+      isize_ = 0;
+      ++member;
+    }
+    if (to > from) {
+      crc_ = crc32(crc_, data, static_cast<uInt>(to - from));
+      isize_ += static_cast<uint32_t>(to - from);
+    }
+    return true;
+  };
+
+  for (size_t a = 0; a < res.outLen; a += OUT_BLOCK_BYTES) {
+    size_t b = std::min(res.outLen, a + OUT_BLOCK_BYTES);
+    auto blk = acquireBlock_();
+    if (!blk) {
+      return false;
+    }
+    if (blk->out.size() < b - a) {
+      blk->out.resize(OUT_BLOCK_BYTES);
+    }
+    bool ok = GzipChunkDecoder::resolve(res.out.data() + a, b - a,
+                                        window_.data(), window_.size(),
+                                        blk->out.data()) and
+              checkMember(blk->out.data(), a, b);
+    blk->outLen = ok ? b - a : 0;
+    blk->failed = !ok;
+    submitBlock_(std::move(blk), false);
+    if (!ok) {
+      return false;
+    }
+  }
+  // (members that end before any output)
+  if (!checkMember(nullptr, res.outLen, res.outLen)) {
+    submitError_();
+    return false;
+  }
+
+  if (tailLen == W) {
+    window_.swap(windowTail_);
+  } else {
+    window_.insert(window_.end(), windowTail_.begin(), windowTail_.end());
+    if (window_.size() > W) {
+      window_.erase(window_.begin(), window_.end() - W);
+    }
+  }
+  return true;
+}
+}
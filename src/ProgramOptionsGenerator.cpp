@@ -128,6 +128,31 @@ namespace salmon {
        "format.  By default, output will be directed to "
        "stdout, but an alternative file name can be "
        "provided instead.")
+      ("writeBinaryMappings",
+       po::value<string>(&sopt.bmFileName)->default_value(salmon::defaults::binaryMappingFile),
+       "[Quasi-mapping mode only] : If a file name is given, the quasi-mappings "
+       "of the reads (read name, transcript, position, orientation, fragment "
+       "length and score of each hit) are written to it in a compact, "
+       "block-compressed binary format.  This is much cheaper than the SAM "
+       "output of --writeMappings; scripts/ConvertBinaryMappingsToSAM.py "
+       "converts the file to SAM.")
+      ("mappingSpillDir",
+       po::value<string>(&sopt.mappingSpillDir)->default_value(salmon::defaults::mappingSpillDir),
+       "[Quasi-mapping mode only] : If a directory is given, the mappings "
+       "found during the first pass over the reads are spilled, in a compact "
+       "binary form, to a temporary file in this directory.  If fewer than "
+       "--numRequiredObs fragments were observed in that pass, the additional "
+       "online rounds then replay the spilled mappings rather than re-reading "
+       "the reads, which also works when the reads come from a pipe or process "
+       "substitution.  The file is removed once quantification is done.")
+      ("readMemoSize",
+       po::value<uint32_t>(&(sopt.readMemoSize))->default_value(salmon::defaults::readMemoSize),
+       "[Quasi-mapping mode only] : If > 0, each mapping thread remembers the final mappings "
+       "of (up to) this many of the reads (pairs) it has most recently seen, keyed by a hash "
+       "of their sequence, and reuses them for identical reads rather than mapping them again. "
+       "This can save a lot of time on libraries with many duplicate reads.  Only reads with "
+       "few mappings are remembered, and the reused mappings are not sampled for sequence-bias "
+       "correction.  This has no effect when --writeOrphanLinks is given for paired-end reads.")
       ("consistentHits,c",
        po::bool_switch(&(sopt.consistentHits))->default_value(salmon::defaults::consistentHits),
        "Force hits gathered during "
@@ -177,7 +202,38 @@ namespace salmon {
       ("mates1,1", po::value<vector<string>>(&(sopt.mate1ReadFiles))->multitoken(),
        "File containing the #1 mates")
       ("mates2,2", po::value<vector<string>>(&(sopt.mate2ReadFiles))->multitoken(),
-       "File containing the #2 mates");
+       "File containing the #2 mates")
+      ("interleaved", po::value<vector<string>>(&(sopt.interleavedReadFiles))->multitoken(),
+       "List of files containing paired-end reads in which the #2 mate of each fragment "
+       "directly follows its #1 mate; either interleaved FASTA/Q (possibly gzipped) or, for "
+       "files ending in .bam, unaligned BAM")
+      ("numDecompressionThreads",
+       po::value<uint32_t>(&(sopt.numDecompressionThreads))->default_value(salmon::defaults::numDecompressionThreads),
+       "The number of threads used to decompress each gzipped read file.  Block-gzipped (BGZF) "
+       "files, such as those written by bgzip, split into independent blocks; regular gzip "
+       "files are cut into chunks that are inflated speculatively and then stitched together, "
+       "which costs somewhat more CPU time overall.  With 1, a regular gzip file is inflated "
+       "by a single (background) thread, as zlib would.  These threads are not counted in --threads: they, the thread that reads each open file and "
+       "those of --readAheadDepth run in addition to the mapping threads (and the up to "
+       "--threads / 4 parsing threads).  They spend most of their time waiting on the parser "
+       "or the disk.")
+      ("readAheadDepth",
+       po::value<uint32_t>(&(sopt.readAheadDepth))->default_value(salmon::defaults::readAheadDepth),
+       "The number of (2MB) buffers of each read file that are read ahead of the decompressor "
+       "by a dedicated I/O thread.  Increasing this can help when reads are stored on slow or "
+       "high-latency (e.g. network) storage; 0 disables the I/O thread.  Like the decompression "
+       "threads, the I/O threads are not counted in --threads (see --numDecompressionThreads).")
+      ("subsample",
+       po::value<double>(&(sopt.subsample))->default_value(salmon::defaults::subsample),
+       "Quantify only a deterministic subset of the input fragments.  A value in (0, 1) keeps "
+       "that fraction of the fragments, chosen by a (seeded) hash of the read names, so that "
+       "both mates of a fragment, and repeated runs, make the same choice.  A whole number >= 2 "
+       "keeps the FIRST that many fragments of the input, in file order (read by a single "
+       "parsing thread); this is not a random sample.  0 uses all of the fragments, and 1 is "
+       "rejected as ambiguous.")
+      ("subsampleSeed",
+       po::value<uint32_t>(&(sopt.subsampleSeed))->default_value(salmon::defaults::subsampleSeed),
+       "The seed of the hash used to choose the fragments kept by --subsample.");
     return mapin;
   }
 
@@ -516,6 +572,13 @@ namespace salmon {
       ("useVBOpt", po::bool_switch(&(sopt.useVBOpt))->default_value(salmon::defaults::useVBOpt),
        "Use the Variational Bayesian EM rather than the "
        "traditional EM algorithm for optimization in the batch passes.")
+      ("squarem", po::bool_switch(&(sopt.useSquarem))->default_value(salmon::defaults::useSquarem),
+       "Accelerate the (VB)EM of the batch passes with SQUAREM (squared "
+       "iterative extrapolation), falling back to plain updates whenever "
+       "an extrapolated step would decrease the likelihood.  Every connected "
+       "component of the equivalence classes is accelerated, whether it is "
+       "optimized serially or in parallel.  This usually converges in far "
+       "fewer passes over the equivalence classes.")
       ("rangeFactorizationBins",
        po::value<uint32_t>(&(sopt.rangeFactorizationBins))->default_value(salmon::defaults::rangeFactorizationBins),
        "Factorizes the likelihood used in quantification by adopting a new "
@@ -633,9 +696,23 @@ namespace salmon {
        "context")
       ("numRequiredObs,n",
        po::value(&(sopt.numRequiredFragments))->default_value(salmon::defaults::numRequiredFrags),
-       "[Deprecated]: The minimum number of observations (mapped reads) "
+       "The minimum number of observations (mapped reads) "
        "that must be observed before "
-       "the inference procedure will terminate.");
+       "the inference procedure will terminate.  Additional rounds over the "
+       "reads are only performed when --mappingSpillDir is given.")
+      ("mappingPrefetchDistance",
+       po::value<uint32_t>(&(sopt.mappingPrefetchDistance))->default_value(salmon::defaults::mappingPrefetchDistance),
+       "[Developer]: While a read is quasi-mapped, the index lookups for the read this many "
+       "positions further on in the chunk are started (and the relevant parts of the index "
+       "prefetched), so that they overlap with the mapping work.  As these lookups are "
+       "repeated when the read itself is mapped, this is off (0) by default; try e.g. 8 to "
+       "see whether it helps with a large index on your machine.")
+      ("alnScoreCacheSize",
+       po::value<uint32_t>(&(sopt.alnScoreCacheSize))->default_value(salmon::defaults::alnScoreCacheSize),
+       "[Developer]: The number of --validateMappings alignment scores each mapping thread "
+       "keeps (keyed by the read and the reference window it was aligned to), so that reads "
+       "aligning to the same window as an earlier read are not aligned again.  When the cache "
+       "is full, the least recently used score is evicted.  0 disables the cache.");
     return hidden;
   }
 
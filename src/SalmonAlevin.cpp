@@ -93,6 +93,7 @@
 #include "Dedup.hpp"
 
 // salmon includes
+#include "AsyncBufferWriter.hpp"
 #include "ClusterForest.hpp"
 #include "FastxParser.hpp"
 #include "IOUtils.hpp"
@@ -251,6 +252,13 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
   // EQClass
   auto& eqBuilder = readExp.equivalenceClassBuilder();
+  // (the fragment lengths of the mini-batch are collected locally, and added
+  // to the shared fld all at once)
+  LocalFragmentLengthDistribution fragLengths(fragLengthDist);
+  // (as are the masses assigned to the transcripts)
+  LocalTranscriptMasses txpMasses(transcripts);
+  // (and the cluster merges and updates)
+  LocalClusterUpdates clusterUpdates(clusterForest);
 
   // Build reverse map from transcriptID => hit id
   using HitID = uint32_t;
@@ -296,7 +304,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
       std::vector<uint32_t> txpIDs;
       std::vector<double> auxProbs;
-      double auxDenom = salmon::math::LOG_0;
+      std::vector<double> alnLogProbs;
 
       uint32_t numInGroup{0};
       uint32_t prevTxpID{0};
@@ -317,7 +325,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         double refLength =
           transcript.RefLength > 0 ? transcript.RefLength : 1.0;
         double coverage = aln.score();
-        double logFragCov = (coverage > 0) ? std::log(coverage) : LOG_1;
+        double logFragCov = (coverage > 0) ? salmon::math::fastLog(coverage) : LOG_1;
 
         // The alignment probability is the product of a
         // transcript-level term (based on abundance and) an
@@ -327,7 +335,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         if (noLengthCorrection) {
           logRefLength = 1.0;
         } else if (salmonOpts.noEffectiveLengthCorrection or !burnedIn) {
-          logRefLength = std::log(static_cast<double>(transcript.RefLength));
+          logRefLength = salmon::math::fastLog(static_cast<double>(transcript.RefLength));
         } else {
           logRefLength = transcript.getCachedLogEffectiveLength();
         }
@@ -355,24 +363,12 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
           if (flen > 0.0 and useFragLengthDist and considerCondProb) {
             size_t fl = flen;
-            double lenProb = fragLengthDist.pmf(fl);
             if (burnedIn) {
               /* condition fragment length prob on txp length */
-              double refLengthCM = fragLengthDist.cmf(static_cast<size_t>(refLength));
-              bool computeMass = fl < refLength and !salmon::math::isLog0(refLengthCM);
-              logFragProb = (computeMass) ?
-                                      (lenProb - refLengthCM) :
-                salmon::math::LOG_EPSILON;
-              if (computeMass and refLengthCM < lenProb) {
-                // Threading is hard!  It's possible that an update to the PMF
-                //snuck in between when we asked to cache the CMF and when the
-                // "burnedIn" variable was last seen as false.
-                log->info("reference length = {}, CMF[refLen] = {}, fragLen = {},"
-                          "PMF[fragLen] = {}", refLength, std::exp(refLengthCM),
-                          aln.fragLength(), std::exp(lenProb));
-              }
+              logFragProb = fragLengthDist.conditionalPMF(
+                  fl, static_cast<size_t>(refLength));
             } else if (useAuxParams) {
-              logFragProb = lenProb;
+              logFragProb = fragLengthDist.pmf(fl);
             }
             //logFragProb = lenProb;
             //logFragProb = fragLengthDist.pmf(static_cast<size_t>(aln.fragLength()));
@@ -421,7 +417,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           double startPosProb{-logRefLength};
           // DEC 9
           if (aln.mateStatus == rapmap::utils::MateStatus::PAIRED_END_PAIRED and !noLengthCorrection) {
-            startPosProb = (flen <= refLength) ? -std::log(refLength - flen + 1) : salmon::math::LOG_EPSILON;
+            startPosProb = (flen <= refLength) ? -salmon::math::fastLog(refLength - flen + 1) : salmon::math::LOG_EPSILON;
           }
 
           double fragStartLogNumerator{salmon::math::LOG_1};
@@ -449,7 +445,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
             continue;
           }
 
-          sumOfAlignProbs = logAdd(sumOfAlignProbs, aln.logProb);
+          alnLogProbs.push_back(aln.logProb);
 
           if (updateCounts and
               observedTranscripts.find(transcriptID) ==
@@ -465,11 +461,12 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           prevTxpID = transcriptID;
           txpIDs.push_back(transcriptID);
           auxProbs.push_back(auxProb);
-          auxDenom = salmon::math::logAdd(auxDenom, auxProb);
         } else {
           aln.logProb = LOG_0;
         }
       }
+      // (summed over the whole group at once)
+      sumOfAlignProbs = salmon::math::logSumExp(alnLogProbs.data(), alnLogProbs.size());
 
       // If this fragment has a zero probability,
       // go to the next one
@@ -520,7 +517,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
         // Add the new mass to this transcript
         double newMass = logForgettingMass + aln.logProb;
-        transcript.addMass(newMass);
+        txpMasses.addMass(transcriptID, newMass);
 
         // Paired-end
         if (aln.libFormat().type == ReadType::PAIRED_END) {
@@ -549,7 +546,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           //Old fragment length calc: double fragLength = aln.fragLength();
           auto fragLength = aln.fragLengthPedantic(transcript.RefLength);
           if (fragLength > 0) {
-            fragLengthDist.addVal(fragLength, logForgettingMass);
+            fragLengths.addVal(fragLength, logForgettingMass);
           }
 
           if (useFSPD) {
@@ -568,7 +565,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         if (updateCounts) {
           transcripts[firstTranscriptID].addUniqueCount(1);
         }
-        clusterForest.updateCluster(firstTranscriptID, 1.0, logForgettingMass,
+        clusterUpdates.updateCluster(firstTranscriptID, 1.0, logForgettingMass,
                                     updateCounts);
         /*
         auto& aln = alnGroup.alignments().front();
@@ -582,9 +579,9 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         ++uniqueFLD[dist];
         */
       } else { // or the appropriate clusters
-        clusterForest.mergeClusters<AlnT>(alnGroup.alignments().begin(),
+        clusterUpdates.mergeClusters<AlnT>(alnGroup.alignments().begin(),
                                           alnGroup.alignments().end());
-        clusterForest.updateCluster(
+        clusterUpdates.updateCluster(
                                     alnGroup.alignments().front().transcriptID(), 1.0,
                                     logForgettingMass, updateCounts);
       }
@@ -596,6 +593,10 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
     maxZeroFrac = std::max(maxZeroFrac, static_cast<double>(100.0 * zeroProbFrags) / batchReads);
   }
 
+  // (before the fld can be frozen below)
+  fragLengths.flush();
+  txpMasses.flush();
+  clusterUpdates.flush();
   numAssignedFragments += localNumAssignedFragments;
   if (numAssignedFragments >= numBurninFrags and !burnedIn) {
     if (useFSPD) {
@@ -606,9 +607,8 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
       }
     }
     // NOTE: only one thread should succeed here, and that
-    // thread will set burnedIn to true.
+    // thread will set burnedIn to true (after caching the fld).
     readExp.updateTranscriptLengthsAtomic(burnedIn);
-    fragLengthDist.cacheCMF();
   }
   if (initialRound) {
     readLib.updateLibTypeCounts(libTypeCounts);
@@ -675,12 +675,14 @@ void processReadsQuasi(
   // Write unmapped reads
   fmt::MemoryWriter unmappedNames;
   bool writeUnmapped = salmonOpts.writeUnmappedNames;
-  spdlog::logger* unmappedLogger = (writeUnmapped) ? salmonOpts.unmappedLog.get() : nullptr;
+  AsyncBufferWriter* unmappedWriter =
+      (writeUnmapped) ? salmonOpts.unmappedWriter.get() : nullptr;
 
   // Write unmapped reads
   fmt::MemoryWriter orphanLinks;
   bool writeOrphanLinks = salmonOpts.writeOrphanLinks;
-  spdlog::logger* orphanLinkLogger = (writeOrphanLinks) ? salmonOpts.orphanLinkLog.get() : nullptr;
+  AsyncBufferWriter* orphanLinkWriter =
+      (writeOrphanLinks) ? salmonOpts.orphanLinkWriter.get() : nullptr;
 
   auto& readBiasFW =
     observedBiasParams
@@ -1130,12 +1132,7 @@ void processReadsQuasi(
     } // end for i < j->nb_filled
 
     if (writeUnmapped) {
-      std::string outStr(unmappedNames.str());
-      // Get rid of last newline
-      if (!outStr.empty()) {
-        outStr.pop_back();
-        unmappedLogger->info(std::move(outStr));
-      }
+      unmappedWriter->write(unmappedNames.data(), unmappedNames.size());
       unmappedNames.clear();
     }
 
@@ -1150,12 +1147,7 @@ void processReadsQuasi(
     }
 
     if (writeOrphanLinks) {
-      std::string outStr(orphanLinks.str());
-      // Get rid of last newline
-      if (!outStr.empty()) {
-        outStr.pop_back();
-        orphanLinkLogger->info(std::move(outStr));
-      }
+      orphanLinkWriter->write(orphanLinks.data(), orphanLinks.size());
       orphanLinks.clear();
     }
 
@@ -1221,6 +1213,7 @@ void processReadLibrary(
     }
 
     size_t numFiles = rl.mates1().size() + rl.mates2().size();
+    // (interleaved input is rejected up front, in salmonBarcoding())
     uint32_t numParsingThreads{1};
     // HACK!
     if(numThreads > 1){
@@ -1228,6 +1221,9 @@ void processReadLibrary(
     }
     if (rl.mates1().size() > 1 and numThreads > 8) { numParsingThreads = 2; numThreads -= 1;}
     pairedParserPtr.reset(new paired_parser(rl.mates1(), rl.mates2(), numThreads, numParsingThreads, miniBatchSize));
+    pairedParserPtr->setNumDecompressionThreads(salmonOpts.numDecompressionThreads);
+    pairedParserPtr->setReadAheadDepth(salmonOpts.readAheadDepth);
+    pairedParserPtr->setSubsample(salmonOpts.subsample, salmonOpts.subsampleSeed);
     pairedParserPtr->start();
 
     /*
@@ -1765,24 +1761,16 @@ int alevinQuant(AlevinOpts<ProtocolT>& aopt,
       }
     }
 
-    if (sopt.writeUnmappedNames) {
-      auto l = sopt.unmappedLog.get();
-      // If the logger was created, then flush it and
-      // close the associated file.
-      if (l) {
-        l->flush();
-        if (sopt.unmappedFile) { sopt.unmappedFile->close(); }
-      }
+    // If the writers were created, then finish writing
+    // and close the associated files.
+    if (sopt.unmappedWriter and !sopt.unmappedWriter->close()) {
+      jointLog->error("Failed to write the unmapped read names to {}",
+                      sopt.unmappedWriter->path());
     }
 
-    if (sopt.writeOrphanLinks) {
-      auto l = sopt.orphanLinkLog.get();
-      // If the logger was created, then flush it and
-      // close the associated file.
-      if (l) {
-        l->flush();
-        if (sopt.orphanLinkFile) { sopt.orphanLinkFile->close(); }
-      }
+    if (sopt.orphanLinkWriter and !sopt.orphanLinkWriter->close()) {
+      jointLog->error("Failed to write the orphan links to {}",
+                      sopt.orphanLinkWriter->path());
     }
 
     // if we wrote quasimappings, flush that buffer
@@ -104,16 +104,22 @@ extern "C" {
 #include "Transcript.hpp"
 
 #include "AlignmentGroup.hpp"
+#include "AsyncBufferWriter.hpp"
 #include "BWAUtils.hpp"
+#include "BatchExtensionScorer.hpp"
 #include "BiasParams.hpp"
+#include "BinaryMappingWriter.hpp"
 #include "CollapsedEMOptimizer.hpp"
 #include "CollapsedGibbsSampler.hpp"
 #include "EquivalenceClassBuilder.hpp"
 #include "ForgettingMassCalculator.hpp"
 #include "FragmentLengthDistribution.hpp"
 #include "GZipWriter.hpp"
+#include "HashLRUCache.hpp"
 #include "HitManager.hpp"
 #include "KmerIntervalMap.hpp"
+#include "KmerLookupPrefetcher.hpp"
+#include "MappingSpill.hpp"
 
 #include "EffectiveLengthStats.hpp"
 #include "PairAlignmentFormatter.hpp"
@@ -161,13 +167,46 @@ using AlnGroupQueue = tbb::concurrent_queue<AlignmentGroup<AlnT>*>;
 
 using ReadExperimentT = ReadExperiment<EquivalenceClassBuilder<TGValue>>;
 
+/**
+ * What processMiniBatch() keeps between the mini-batches of the thread
+ * calling it: the local accumulators of the shared estimates (flushed at the
+ * end of each mini-batch) and the scratch space for the equivalence class of
+ * each fragment.  A thread holds one for its lifetime, so that none of these
+ * are rebuilt for every mini-batch.
+ */
+struct LocalMiniBatchState {
+  LocalMiniBatchState(ReadExperimentT& readExp,
+                      std::vector<Transcript>& transcripts,
+                      ClusterForest& clusterForest,
+                      FragmentLengthDistribution& fragLengthDist)
+      : eqBuilder(readExp.equivalenceClassBuilder()),
+        fragLengths(fragLengthDist), txpMasses(transcripts),
+        clusterUpdates(clusterForest),
+        libTypeCounts(LibraryFormat::maxLibTypeID() + 1, 0),
+        libTypeCountsPerFrag(LibraryFormat::maxLibTypeID() + 1, 0) {}
+
+  LocalEquivalenceClassBuilder<TGValue> eqBuilder;
+  LocalFragmentLengthDistribution fragLengths;
+  LocalTranscriptMasses txpMasses;
+  LocalClusterUpdates clusterUpdates;
+
+  std::vector<uint64_t> libTypeCounts;
+  std::vector<uint64_t> libTypeCountsPerFrag;
+  std::vector<uint32_t> txpIDs;
+  std::vector<double> auxProbs;
+  std::vector<double> alnLogProbs;
+  std::vector<int> inds;
+  std::vector<uint32_t> txpIDsNew;
+  std::vector<double> auxProbsNew;
+};
+
 template <typename AlnT>
 void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc,
                       uint64_t firstTimestepOfRound, ReadLibrary& readLib,
                       const SalmonOpts& salmonOpts,
                       AlnGroupVecRange<AlnT> batchHits,
                       std::vector<Transcript>& transcripts,
-                      ClusterForest& clusterForest,
+                      LocalMiniBatchState& local,
                       FragmentLengthDistribution& fragLengthDist,
                       BiasParams& observedBiasParams,
                       /**
@@ -187,15 +226,14 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
   const uint64_t numBurninFrags = salmonOpts.numBurninFrags;
 
-  auto& log = salmonOpts.jointLog;
   // auto log = spdlog::get("jointLog");
   size_t numTranscripts{transcripts.size()};
   size_t localNumAssignedFragments{0};
   size_t priorNumAssignedFragments{numAssignedFragments};
   std::uniform_real_distribution<> uni(
       0.0, 1.0 + std::numeric_limits<double>::min());
-  std::vector<uint64_t> libTypeCounts(LibraryFormat::maxLibTypeID() + 1);
-  std::vector<uint64_t> libTypeCountsPerFrag(LibraryFormat::maxLibTypeID() + 1);
+  auto& libTypeCounts = local.libTypeCounts;
+  auto& libTypeCountsPerFrag = local.libTypeCountsPerFrag;
   bool hasCompatibleMapping{false};
   uint64_t numCompatibleFragments{0};
 
@@ -234,7 +272,15 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
   uint64_t zeroProbFrags{0};
 
   // EQClass
-  auto& eqBuilder = readExp.equivalenceClassBuilder();
+  // (the classes of the mini-batch are collected locally, and added to the
+  // shared map all at once)
+  auto& eqBuilder = local.eqBuilder;
+  // (as are the fragment lengths)
+  auto& fragLengths = local.fragLengths;
+  // (and the masses assigned to the transcripts)
+  auto& txpMasses = local.txpMasses;
+  // (and the cluster merges and updates)
+  auto& clusterUpdates = local.clusterUpdates;
 
   // Build reverse map from transcriptID => hit id
   using HitID = uint32_t;
@@ -253,6 +299,15 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
             aln.mateStatus != rapmap::utils::MateStatus::PAIRED_END_PAIRED);
   };
 
+  // Scratch space for the equivalence class of each fragment, reused across
+  // the fragments (and mini-batches) of the thread
+  auto& txpIDs = local.txpIDs;
+  auto& auxProbs = local.auxProbs;
+  auto& alnLogProbs = local.alnLogProbs;
+  auto& inds = local.inds;
+  auto& txpIDsNew = local.txpIDsNew;
+  auto& auxProbsNew = local.auxProbsNew;
+
   int i{0};
   {
     // Iterate over each group of alignments (a group consists of all alignments
@@ -273,7 +328,6 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
       bool transcriptUnique{true};
 
       auto firstTranscriptID = alnGroup.alignments().front().transcriptID();
-      std::unordered_set<size_t> observedTranscripts;
 
       // New incompat. handling.
       /**
@@ -297,8 +351,9 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
       double auxDenomFinal = salmon::math::LOG_0;
       **/
 
-      std::vector<uint32_t> txpIDs;
-      std::vector<double> auxProbs;
+      txpIDs.clear();
+      auxProbs.clear();
+      alnLogProbs.clear();
       double auxDenom = salmon::math::LOG_0;
 
       uint32_t numInGroup{0};
@@ -320,7 +375,8 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         double refLength =
             transcript.RefLength > 0 ? transcript.RefLength : 1.0;
         double coverage = aln.score();
-        double logFragCov = (coverage > 0) ? std::log(coverage) : LOG_1;
+        double logFragCov =
+            (coverage > 0) ? salmon::math::fastLog(coverage) : LOG_1;
 
         // The alignment probability is the product of a
         // transcript-level term (based on abundance and) an
@@ -330,7 +386,8 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         if (noLengthCorrection) {
           logRefLength = 1.0;
         } else if (salmonOpts.noEffectiveLengthCorrection or !burnedIn) {
-          logRefLength = std::log(static_cast<double>(transcript.RefLength));
+          logRefLength = salmon::math::fastLog(
+              static_cast<double>(transcript.RefLength));
         } else {
           logRefLength = transcript.getCachedLogEffectiveLength();
         }
@@ -357,26 +414,12 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
           if (flen > 0.0 and useFragLengthDist and considerCondProb) {
             size_t fl = flen;
-            double lenProb = fragLengthDist.pmf(fl);
             if (burnedIn) {
               /* condition fragment length prob on txp length */
-              double refLengthCM =
-                  fragLengthDist.cmf(static_cast<size_t>(refLength));
-              bool computeMass =
-                  fl < refLength and !salmon::math::isLog0(refLengthCM);
-              logFragProb = (computeMass) ? (lenProb - refLengthCM)
-                                          : salmon::math::LOG_EPSILON;
-              if (computeMass and refLengthCM < lenProb) {
-                // Threading is hard!  It's possible that an update to the PMF
-                // snuck in between when we asked to cache the CMF and when the
-                // "burnedIn" variable was last seen as false.
-                log->info("reference length = {}, CMF[refLen] = {}, fragLen = "
-                          "{}, PMF[fragLen] = {}",
-                          refLength, std::exp(refLengthCM), aln.fragLength(),
-                          std::exp(lenProb));
-              }
+              logFragProb = fragLengthDist.conditionalPMF(
+                  fl, static_cast<size_t>(refLength));
             } else if (useAuxParams) {
-              logFragProb = lenProb;
+              logFragProb = fragLengthDist.pmf(fl);
             }
             // logFragProb = lenProb;
             // logFragProb =
@@ -448,8 +491,9 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           double startPosProb{-logRefLength};
           if (aln.mateStatus == rapmap::utils::MateStatus::PAIRED_END_PAIRED and
               !noLengthCorrection) {
-            startPosProb = (flen <= refLength) ? -std::log(refLength - flen + 1)
-                                               : salmon::math::LOG_EPSILON;
+            startPosProb = (flen <= refLength)
+                               ? -salmon::math::fastLog(refLength - flen + 1)
+                               : salmon::math::LOG_EPSILON;
             // NOTE : test new el model in future
             // if (flen <= refLength) { obsEffLens.addFragment(transcriptID,
             // (refLength - flen + 1), logForgettingMass); }
@@ -497,12 +541,13 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
             continue;
           }
 
-          sumOfAlignProbs = logAdd(sumOfAlignProbs, aln.logProb);
+          alnLogProbs.push_back(aln.logProb);
 
-          if (updateCounts and observedTranscripts.find(transcriptID) ==
-                                   observedTranscripts.end()) {
+          // (the alignments are sorted by transcript, so this is the first
+          // one to this transcript unless the last one was to it too)
+          if (updateCounts and
+              (txpIDs.empty() or txpIDs.back() != transcriptID)) {
             transcripts[transcriptID].addTotalCount(1);
-            observedTranscripts.insert(transcriptID);
           }
           // EQCLASS
           if (transcriptID < prevTxpID) {
@@ -512,11 +557,14 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           prevTxpID = transcriptID;
           txpIDs.push_back(transcriptID);
           auxProbs.push_back(auxProb);
-          auxDenom = salmon::math::logAdd(auxDenom, auxProb);
         } else {
           aln.logProb = LOG_0;
         }
       }
+      // (summed over the whole group at once)
+      sumOfAlignProbs =
+          salmon::math::logSumExp(alnLogProbs.data(), alnLogProbs.size());
+      auxDenom = salmon::math::logSumExp(auxProbs.data(), auxProbs.size());
 
       // If this fragment has a zero probability,
       // go to the next one
@@ -531,16 +579,13 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
       }
 
       // EQCLASS
-      double auxProbSum{0.0};
-      for (auto& p : auxProbs) {
-        p = std::exp(p - auxDenom);
-        auxProbSum += p;
-      }
+      double auxProbSum =
+          salmon::math::expNormalize(auxProbs.data(), auxProbs.size(), auxDenom);
 
       auto eqSize = txpIDs.size();
       if (eqSize > 0) {
         if (useRankEqClasses and eqSize > 1) {
-          std::vector<int> inds(eqSize);
+          inds.resize(eqSize);
           std::iota(inds.begin(), inds.end(), 0);
           // Get the indices in order by conditional probability
           std::sort(inds.begin(), inds.end(),
@@ -548,8 +593,8 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
                       return auxProbs[i] < auxProbs[j];
                     });
           {
-            decltype(txpIDs) txpIDsNew(txpIDs.size());
-            decltype(auxProbs) auxProbsNew(auxProbs.size());
+            txpIDsNew.resize(txpIDs.size());
+            auxProbsNew.resize(auxProbs.size());
             for (size_t r = 0; r < eqSize; ++r) {
               auto ind = inds[r];
               txpIDsNew[r] = txpIDs[ind];
@@ -570,8 +615,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           }
         }
 
-        TranscriptGroup tg(txpIDs);
-        eqBuilder.addGroup(std::move(tg), auxProbs);
+        eqBuilder.addGroup(txpIDs, auxProbs);
       }
 
       // normalize the hits
@@ -587,7 +631,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 
         // Add the new mass to this transcript
         double newMass = logForgettingMass + aln.logProb;
-        transcript.addMass(newMass);
+        txpMasses.addMass(transcriptID, newMass);
 
         // Paired-end
         if (aln.libFormat().type == ReadType::PAIRED_END) {
@@ -669,7 +713,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
             // For single-end reads, simply assume that every fragment
             // has a length equal to the conditional mean (given the
             // current transcript's length).
-            auto cmeans = readExp.condMeans();
+            auto& cmeans = readExp.condMeans();
             auto cmean =
                 static_cast<int32_t>((transcript.RefLength >= cmeans.size())
                                          ? cmeans.back()
@@ -692,7 +736,7 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
           // Old fragment length calc: double fragLength = aln.fragLength();
           auto fragLength = aln.fragLengthPedantic(transcript.RefLength);
           if (fragLength > 0) {
-            fragLengthDist.addVal(fragLength, logForgettingMass);
+            fragLengths.addVal(fragLength, logForgettingMass);
           }
 
           if (useFSPD) {
@@ -709,12 +753,12 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         if (updateCounts) {
           transcripts[firstTranscriptID].addUniqueCount(1);
         }
-        clusterForest.updateCluster(firstTranscriptID, 1.0, logForgettingMass,
+        clusterUpdates.updateCluster(firstTranscriptID, 1.0, logForgettingMass,
                                     updateCounts);
       } else { // or the appropriate clusters
-        clusterForest.mergeClusters<AlnT>(alnGroup.alignments().begin(),
+        clusterUpdates.mergeClusters<AlnT>(alnGroup.alignments().begin(),
                                           alnGroup.alignments().end());
-        clusterForest.updateCluster(
+        clusterUpdates.updateCluster(
             alnGroup.alignments().front().transcriptID(), 1.0,
             logForgettingMass, updateCounts);
       }
@@ -731,6 +775,11 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         maxZeroFrac, static_cast<double>(100.0 * zeroProbFrags) / batchReads);
   }
 
+  // (before the fld can be frozen below)
+  eqBuilder.flush();
+  fragLengths.flush();
+  txpMasses.flush();
+  clusterUpdates.flush();
   numAssignedFragments += localNumAssignedFragments;
   if (numAssignedFragments >= numBurninFrags and !burnedIn) {
     if (useFSPD) {
@@ -741,67 +790,133 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
       }
     }
     // NOTE: only one thread should succeed here, and that
-    // thread will set burnedIn to true.
+    // thread will set burnedIn to true (after caching the fld).
     readExp.updateTranscriptLengthsAtomic(burnedIn);
-    fragLengthDist.cacheCMF();
   }
   if (initialRound) {
     readLib.updateLibTypeCounts(libTypeCounts);
     readLib.updateCompatCounts(numCompatibleFragments);
   }
+  std::fill(libTypeCounts.begin(), libTypeCounts.end(), 0);
 }
 
 
-/// Get alignment score
+/// Alignment scores
 namespace salmon {
   namespace mapping {
-    struct CacheEntry {
-      uint64_t hashKey;
-      int32_t alnScore;
-      CacheEntry(uint64_t hashKeyIn, int32_t alnScoreIn) :
-        hashKey(hashKeyIn), alnScore(alnScoreIn) {}
+    // Where to find the score of an alignment queued with ChunkAlnScorer::queue()
+    struct AlnScoreRef {
+      int32_t job{-1};   // the scorer job that computes the score, or
+      int32_t score{-1}; // the score itself (if job < 0)
     };
-  }
-}
 
-inline int32_t getAlnScore(ksw2pp::KSW2Aligner& aligner, ksw_extz_t& ez, int32_t pos, const char* rptr,
-                           int32_t rlen, char* tseq, int32_t tlen, uint32_t buf,
-                           std::vector<salmon::mapping::CacheEntry>& alnCache) {
-  int32_t s{-1};
-  if (pos < 0) { rptr += -pos; pos = 0; rlen += pos; }
-  if (pos < tlen) {
-    uint32_t tlen1 = std::min(static_cast<uint32_t>(rlen+buf), static_cast<uint32_t>(tlen - pos));
-    char* tseq1 = tseq + pos;
-    ez.max_q = ez.max_t = ez.mqe_t = ez.mte_q = -1;
-    ez.max = 0, ez.mqe = ez.mte = KSW_NEG_INF;
-    ez.n_cigar = 0;
-
-    uint64_t hashKey{0};
-    bool didHash{false};
-    if (!alnCache.empty()) {
-      // hash the reference string
-      hashKey = XXH64(reinterpret_cast<void*>(tseq1), tlen1, 0);
-      didHash = true;
-      // see if we have this hash
-      auto hit = std::find_if(alnCache.begin(), alnCache.end(), [hashKey](const salmon::mapping::CacheEntry& e) -> bool {
-          return e.hashKey == hashKey;
-        });
-      // if so, we know the alignment score
-      if (hit != alnCache.end()) {
-        s = hit->alnScore;
+    /**
+     * Scores the --validateMappings alignments of a chunk of reads.  The
+     * alignments are queued while the reads are mapped, and then scored
+     * together by a BatchExtensionScorer.  An alignment whose score is in the
+     * (per-thread) AlignmentScoreCache, or that was already queued for this
+     * chunk, is not aligned again.
+     */
+    class ChunkAlnScorer {
+    public:
+      ChunkAlnScorer(int8_t a, int8_t b, int8_t gapo, int8_t gape,
+                     int bandwidth, uint32_t cacheSize) :
+        scorer_(a, b, gapo, gape, bandwidth), cache_(cacheSize) {}
+
+      // Start a new chunk
+      void clear() {
+        scorer_.clear();
+        queued_.clear();
+        jobKeys_.clear();
       }
-    }
-    // If we got here with s == -1, we don't have the score cached
-    if (s == -1) {
-      aligner(rptr, rlen, tseq1, tlen1, &ez, ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::EXTENSION>());
-      s = std::max(ez.mqe, ez.mte);
-      if (!didHash) {
-        hashKey = XXH64(reinterpret_cast<void*>(tseq1), tlen1, 0);
+
+      /**
+       * Queue the alignment of the read (rptr, whose XXH64 hash is readHash)
+       * against its window of the transcript starting at pos.  If the read
+       * falls off of the end of the transcript, its score is -1.
+       */
+      AlnScoreRef queue(int32_t pos, const char* rptr, uint64_t readHash,
+                        int32_t rlen, const char* tseq, int32_t tlen, uint32_t buf) {
+        AlnScoreRef ref;
+        if (pos < 0) {
+          rptr += -pos; pos = 0; rlen += pos;
+          readHash = XXH64(reinterpret_cast<const void*>(rptr), rlen, 0);
+        }
+        if (pos < tlen) {
+          uint32_t tlen1 = std::min(static_cast<uint32_t>(rlen+buf), static_cast<uint32_t>(tlen - pos));
+          const char* tseq1 = tseq + pos;
+
+          // hash the reference string
+          AlignmentScoreCache::Key key(readHash, XXH64(reinterpret_cast<const void*>(tseq1), tlen1, 0));
+          if (auto* cached = cache_.find(key)) {
+            ++numHits_;
+            ref.score = *cached;
+            return ref;
+          }
+          auto it = queued_.find(key);
+          if (it != queued_.end()) {
+            ++numHits_;
+            ref.job = it->second;
+            return ref;
+          }
+          ++numMisses_;
+          ref.job = static_cast<int32_t>(scorer_.add(rptr, rlen, tseq1, static_cast<int32_t>(tlen1)));
+          queued_.emplace(key, ref.job);
+          jobKeys_.push_back(key);
+        }
+        return ref;
       }
-      alnCache.emplace_back(hashKey, s);
-    }
+
+      // Score the queued alignments (and cache their scores)
+      void run() {
+        scorer_.run();
+        for (size_t i = 0; i < jobKeys_.size(); ++i) {
+          if (auto* slot = cache_.insert(jobKeys_[i])) {
+            *slot = scorer_.score(i);
+          }
+        }
+      }
+
+      int32_t score(const AlnScoreRef& ref) const {
+        return (ref.job < 0) ? ref.score : scorer_.score(static_cast<size_t>(ref.job));
+      }
+
+      uint64_t numHits() const { return numHits_; }
+      uint64_t numMisses() const { return numMisses_; }
+
+    private:
+      BatchExtensionScorer scorer_;
+      AlignmentScoreCache cache_;
+      std::unordered_map<AlignmentScoreCache::Key, int32_t, AlignmentScoreCache::KeyHasher> queued_;
+      std::vector<AlignmentScoreCache::Key> jobKeys_;
+      uint64_t numHits_{0};
+      uint64_t numMisses_{0};
+    };
+
+    // The per-read state that the second pass over a chunk needs
+    struct ReadState {
+      salmon::utils::MappingType mapType{salmon::utils::MappingType::UNMAPPED};
+      bool hadHits{false};   // (before the alignment filter)
+      bool isPaired{false};
+      bool counted{false};   // toward upperBoundHits
+      bool memoized{false};  // the mappings came from the ReadMappingMemo
+    };
+
+    // The final mappings of a read, reused for identical reads
+    struct MemoizedMappings {
+      std::vector<QuasiAlignment> hits;
+      ReadState state;
+    };
+
+    /**
+     * The mappings of recently seen reads (pairs), keyed by the XXH64 hash of
+     * the sequence of each end (or by the hash and length of a single-end
+     * read).  Only reads with at most maxMemoizedHits mappings are memoized,
+     * so that the memory used is bounded.
+     */
+    using ReadMappingMemo = HashLRUCache<MemoizedMappings>;
+    constexpr const size_t maxMemoizedHits{32};
   }
-  return s;
 }
 
 /// START QUASI
@@ -889,14 +1004,14 @@ void processReadsQuasi(
   // Write unmapped reads
   fmt::MemoryWriter unmappedNames;
   bool writeUnmapped = salmonOpts.writeUnmappedNames;
-  spdlog::logger* unmappedLogger =
-      (writeUnmapped) ? salmonOpts.unmappedLog.get() : nullptr;
+  AsyncBufferWriter* unmappedWriter =
+      (writeUnmapped) ? salmonOpts.unmappedWriter.get() : nullptr;
 
   // Write unmapped reads
   fmt::MemoryWriter orphanLinks;
   bool writeOrphanLinks = salmonOpts.writeOrphanLinks;
-  spdlog::logger* orphanLinkLogger =
-      (writeOrphanLinks) ? salmonOpts.orphanLinkLog.get() : nullptr;
+  AsyncBufferWriter* orphanLinkWriter =
+      (writeOrphanLinks) ? salmonOpts.orphanLinkWriter.get() : nullptr;
 
   auto& readBiasFW =
       observedBiasParams
@@ -913,6 +1028,14 @@ void processReadsQuasi(
   uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
   size_t minK = rapmap::utils::my_mer::k();
 
+  // Record the mappings for any later rounds if we're spilling them
+  MappingSpill* spill = initialRound ? rl.mappingSpill() : nullptr;
+  std::vector<char> spillBuf;
+
+  // (kept across all of this thread's mini-batches)
+  LocalMiniBatchState miniBatchState(readExp, transcripts, clusterForest,
+                                     fragLengthDist);
+
   size_t locRead{0};
   //uint64_t localUpperBoundHits{0};
   size_t rangeSize{0};
@@ -948,6 +1071,9 @@ void processReadsQuasi(
   }
 
   SASearcher<RapMapIndexT> saSearcher(qidx);
+  // look up the k-mers of the reads a little ahead of the one being mapped
+  KmerLookupPrefetcher<RapMapIndexT> prefetcher(
+      qidx, salmonOpts.mappingPrefetchDistance);
   std::vector<QuasiAlignment> leftHits;
   std::vector<QuasiAlignment> rightHits;
   rapmap::utils::HitCounters hctr;
@@ -957,32 +1083,36 @@ void processReadsQuasi(
   fmt::MemoryWriter sstream;
   auto* qmLog = salmonOpts.qmLog.get();
   bool writeQuasimappings = (qmLog != nullptr);
+  // Only the mappings of the first pass over the reads are written in binary
+  BinaryMappingWriter* bmWriter =
+      initialRound ? salmonOpts.bmWriter.get() : nullptr;
+  std::vector<char> bmBuf;
 
   std::string rc1; rc1.reserve(300);
   std::string rc2; rc2.reserve(300);
 
   // TODO : further investigation of bandwidth and dropoff
-  using ksw2pp::KSW2Aligner;
-  using ksw2pp::KSW2Config;
-  using ksw2pp::EnumToType;
-  using ksw2pp::KSW2AlignmentType;
-  KSW2Config config;
-  config.dropoff = -1;
-  config.gapo = salmonOpts.gapOpenPenalty;
-  config.gape = salmonOpts.gapExtendPenalty;
-  config.bandwidth = 10;
-  config.flag = 0;
-  config.flag |= KSW_EZ_SCORE_ONLY;
   int8_t a = salmonOpts.matchScore;
   int8_t b = salmonOpts.mismatchPenalty;
-  KSW2Aligner aligner(static_cast<int8_t>(a), static_cast<int8_t>(b));
-  aligner.config() = config;
-  ksw_extz_t ez;
-  memset(&ez, 0, sizeof(ksw_extz_t));
+  // The alignments of all of the reads of a chunk are scored together
+  salmon::mapping::ChunkAlnScorer scorer(
+      a, b, salmonOpts.gapOpenPenalty, salmonOpts.gapExtendPenalty, 10,
+      salmonOpts.alnScoreCacheSize);
   size_t numDropped{0};
+  bool tryAlign{salmonOpts.validateMappings};
 
-  std::vector<salmon::mapping::CacheEntry> alnCacheLeft; alnCacheLeft.reserve(15);
-  std::vector<salmon::mapping::CacheEntry> alnCacheRight; alnCacheRight.reserve(15);
+  // the scores (left, right) of each hit, and where those of each read start
+  std::vector<std::pair<salmon::mapping::AlnScoreRef, salmon::mapping::AlnScoreRef>> hitJobs;
+  std::vector<size_t> hitJobStart;
+  std::vector<salmon::mapping::ReadState> readStates;
+
+  // Identical reads (pairs) reuse the mappings of the last one seen.  The
+  // orphan links are only found while mapping, so they turn this off.
+  bool useMemo = (salmonOpts.readMemoSize > 0) and !writeOrphanLinks;
+  salmon::mapping::ReadMappingMemo readMemo(useMemo ? salmonOpts.readMemoSize : 0);
+  std::vector<salmon::mapping::ReadMappingMemo::Key> readKeys;
+  uint64_t numMemoHits{0};
+  uint64_t numMemoMisses{0};
 
   auto rg = parser->getReadGroup();
   while (parser->refill(rg)) {
@@ -996,7 +1126,17 @@ void processReadsQuasi(
       std::exit(1);
     }
 
+    // First, map all of the reads of the chunk (queueing the alignments
+    // --validateMappings has to score); then, score the alignments; and
+    // finally, filter and record the mappings of each read.
+    scorer.clear();
+    hitJobs.clear();
+    hitJobStart.resize(rangeSize);
+    readStates.assign(rangeSize, salmon::mapping::ReadState());
+    readKeys.resize(rangeSize);
+
     for (size_t i = 0; i < rangeSize; ++i) { // For all the read in this batch
+      prefetcher.step(rg, i, rangeSize);
       auto& rp = rg[i];
       readLenLeft = rp.first.seq.length();
       readLenRight = rp.second.seq.length();
@@ -1014,6 +1154,28 @@ void processReadsQuasi(
       rightHCInfo.clear();
 
       mapType = salmon::utils::MappingType::UNMAPPED;
+      hitJobStart[i] = hitJobs.size();
+
+      if (useMemo) {
+        readKeys[i] = salmon::mapping::ReadMappingMemo::Key(
+            XXH64(reinterpret_cast<const void*>(rp.first.seq.data()), readLenLeft, 0),
+            XXH64(reinterpret_cast<const void*>(rp.second.seq.data()), readLenRight, 0));
+        if (auto* memo = readMemo.find(readKeys[i])) {
+          ++numMemoHits;
+          jointHits = memo->hits;
+          readStates[i] = memo->state;
+          readStates[i].memoized = true;
+          if (tooShortLeft and tooShortRight) {
+            ++shortFragStats.numTooShort;
+            shortFragStats.shortest = std::min(shortFragStats.shortest,
+                                               std::max(readLenLeft, readLenRight));
+          } else if (initialRound) {
+            upperBoundHits += memo->state.counted;
+          }
+          continue;
+        }
+        ++numMemoMisses;
+      }
 
       bool lh = tooShortLeft
         ? false : hitCollector(rp.first.seq, saSearcher, leftHCInfo);
@@ -1047,6 +1209,7 @@ void processReadsQuasi(
                                                  maxNumHits, tooManyHits, hctr);
         }
 
+        readStates[i].counted = (jointHits.size() > 0);
         if (initialRound) {
           upperBoundHits += (jointHits.size() > 0);
         }
@@ -1079,11 +1242,11 @@ void processReadsQuasi(
         }
       }
 
-      // If we have mappings, then process them.
       bool isPaired{false};
-      if (jointHits.size() > 0) {
-        bool isPaired = jointHits.front().mateStatus ==
-                        rapmap::utils::MateStatus::PAIRED_END_PAIRED;
+      bool hadHits = (jointHits.size() > 0);
+      if (hadHits) {
+        isPaired = jointHits.front().mateStatus ==
+                   rapmap::utils::MateStatus::PAIRED_END_PAIRED;
         if (isPaired) {
           mapType = salmon::utils::MappingType::PAIRED_MAPPED;
         }
@@ -1130,53 +1293,100 @@ void processReadsQuasi(
           }
         }
 
-        bool tryAlign{salmonOpts.validateMappings};
         if (tryAlign) {
-          alnCacheLeft.clear();
-          alnCacheRight.clear();
           auto* r1 = rp.first.seq.data();
           auto* r2 = rp.second.seq.data();
           auto l1 = static_cast<int32_t>(rp.first.seq.length());
           auto l2 = static_cast<int32_t>(rp.second.seq.length());
           rapmap::utils::reverseRead(rp.first.seq, rc1);
           rapmap::utils::reverseRead(rp.second.seq, rc2);
-          // we will not break the const promise
-          char* r1rc = const_cast<char*>(rc1.data());
-          char* r2rc = const_cast<char*>(rc2.data());
+          const char* r1rc = rc1.data();
+          const char* r2rc = rc2.data();
+          uint64_t h1 = XXH64(reinterpret_cast<const void*>(r1), l1, 0);
+          uint64_t h2 = XXH64(reinterpret_cast<const void*>(r2), l2, 0);
+          uint64_t h1rc = XXH64(reinterpret_cast<const void*>(r1rc), l1, 0);
+          uint64_t h2rc = XXH64(reinterpret_cast<const void*>(r2rc), l2, 0);
+
+          for (auto& h : jointHits) {
+            auto& t = transcripts[h.tid];
+            const char* tseq = t.Sequence();
+            const int32_t tlen = static_cast<int32_t>(t.RefLength);
+            const uint32_t buf{8};
+            salmon::mapping::AlnScoreRef leftScore;
+            salmon::mapping::AlnScoreRef rightScore;
+
+            if (h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_PAIRED) {
+              leftScore = h.fwd ? scorer.queue(h.pos, r1, h1, l1, tseq, tlen, buf)
+                                : scorer.queue(h.pos, r1rc, h1rc, l1, tseq, tlen, buf);
+              rightScore = h.mateIsFwd ? scorer.queue(h.matePos, r2, h2, l2, tseq, tlen, buf)
+                                       : scorer.queue(h.matePos, r2rc, h2rc, l2, tseq, tlen, buf);
+            } else if (h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_LEFT) {
+              leftScore = h.fwd ? scorer.queue(h.pos, r1, h1, l1, tseq, tlen, buf)
+                                : scorer.queue(h.pos, r1rc, h1rc, l1, tseq, tlen, buf);
+            } else if (h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_RIGHT) {
+              rightScore = h.fwd ? scorer.queue(h.pos, r2, h2, l2, tseq, tlen, buf)
+                                 : scorer.queue(h.pos, r2rc, h2rc, l2, tseq, tlen, buf);
+            }
+            hitJobs.emplace_back(leftScore, rightScore);
+          }
+        }
+      }
+      readStates[i].mapType = mapType;
+      readStates[i].hadHits = hadHits;
+      readStates[i].isPaired = isPaired;
+    }
+
+    if (tryAlign) {
+      scorer.run();
+    }
+
+    for (size_t i = 0; i < rangeSize; ++i) {
+      auto& rp = rg[i];
+      auto& jointHitGroup = structureVec[i];
+      auto& jointHits = jointHitGroup.alignments();
+      auto& readState = readStates[i];
+      mapType = readState.mapType;
+
+      if (readState.memoized) {
+        // These are the (final) mappings of an identical read
+        if (writeQuasimappings and readState.hadHits) {
+          rapmap::utils::writeAlignmentsToStream(rp, formatter, hctr, jointHits,
+                                                 sstream);
+        }
+        if (bmWriter and !jointHits.empty()) {
+          BinaryMappingWriter::addFragment(bmBuf, rp.first.name, jointHits);
+        }
+      } else if (readState.hadHits) {
+        // If we have mappings, then process them.
+        bool isPaired = readState.isPaired;
+
+        if (tryAlign) {
           int32_t bestScore{-1};
           std::vector<decltype(bestScore)> scores(jointHits.size(), bestScore);
           size_t idx{0};
           double optFrac{salmonOpts.minScoreFraction};
+          auto* jobs = hitJobs.data() + hitJobStart[i];
 
           for (auto& h : jointHits) {
             int32_t score{std::numeric_limits<int32_t>::min()};
-            auto& t = transcripts[h.tid];
-            char* tseq = const_cast<char*>(t.Sequence());
-            const int32_t tlen = static_cast<int32_t>(t.RefLength);
-            const uint32_t buf{8};
 
             if (h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_PAIRED) {
-              auto* r1ptr = h.fwd ? r1 : r1rc;
-              auto* r2ptr = h.mateIsFwd ? r2 : r2rc;
-
-              auto s1 = getAlnScore(aligner, ez, h.pos, r1ptr, l1, tseq, tlen, buf, alnCacheLeft);
-              auto s2 = getAlnScore(aligner, ez, h.matePos, r2ptr, l2, tseq, tlen, buf, alnCacheRight);
+              auto s1 = scorer.score(jobs[idx].first);
+              auto s2 = scorer.score(jobs[idx].second);
               if ((s1 + s2) < (optFrac * a * rp.first.seq.length() + optFrac * a * rp.second.seq.length())) {
                 score = std::numeric_limits<decltype(score)>::min();
               } else {
                 score = s1 + s2;
               }
             } else if (h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_LEFT) {
-              auto* rptr = h.fwd ? r1 : r1rc;
-              auto s = getAlnScore(aligner, ez, h.pos, rptr, l1, tseq, tlen, buf, alnCacheLeft);
+              auto s = scorer.score(jobs[idx].first);
               if (s < (optFrac * a * rp.first.seq.length())) {
                 score = std::numeric_limits<decltype(score)>::min();
               } else {
                 score = s;
               }
             } else if (h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_RIGHT) {
-              auto* rptr = h.fwd ? r2 : r2rc;
-              auto s = getAlnScore(aligner, ez, h.pos, rptr, l2, tseq, tlen, buf, alnCacheRight);
+              auto s = scorer.score(jobs[idx].second);
               if (s < (optFrac * a * rp.second.seq.length())) {
                 score = std::numeric_limits<decltype(score)>::min();
               } else {
@@ -1338,6 +1548,9 @@ void processReadsQuasi(
           rapmap::utils::writeAlignmentsToStream(rp, formatter, hctr, jointHits,
                                                  sstream);
         }
+        if (bmWriter and !jointHits.empty()) {
+          BinaryMappingWriter::addFragment(bmBuf, rp.first.name, jointHits);
+        }
 
       } else {
         // This read was completely unmapped.
@@ -1352,6 +1565,15 @@ void processReadsQuasi(
                       << '\n';
       }
 
+      if (useMemo and !readState.memoized and
+          jointHits.size() <= salmon::mapping::maxMemoizedHits) {
+        if (auto* memo = readMemo.insert(readKeys[i])) {
+          memo->hits = jointHits;
+          memo->state = readState;
+          memo->state.mapType = mapType;
+        }
+      }
+
       validHits += jointHits.size();
       localNumAssignedFragments += (jointHits.size() > 0);
       locRead++;
@@ -1378,12 +1600,7 @@ void processReadsQuasi(
     } // end for i < j->nb_filled
 
     if (writeUnmapped) {
-      std::string outStr(unmappedNames.str());
-      // Get rid of last newline
-      if (!outStr.empty()) {
-        outStr.pop_back();
-        unmappedLogger->info(std::move(outStr));
-      }
+      unmappedWriter->write(unmappedNames.data(), unmappedNames.size());
       unmappedNames.clear();
     }
 
@@ -1397,22 +1614,25 @@ void processReadsQuasi(
       sstream.clear();
     }
 
+    if (bmWriter) {
+      bmWriter->push(bmBuf);
+    }
+
     if (writeOrphanLinks) {
-      std::string outStr(orphanLinks.str());
-      // Get rid of last newline
-      if (!outStr.empty()) {
-        outStr.pop_back();
-        orphanLinkLogger->info(std::move(outStr));
-      }
+      orphanLinkWriter->write(orphanLinks.data(), orphanLinks.size());
       orphanLinks.clear();
     }
 
     prevObservedFrags = numObservedFragments;
+    if (spill != nullptr) {
+      spill->writeBatch(structureVec.begin(), structureVec.begin() + rangeSize,
+                        rangeSize, spillBuf);
+    }
     AlnGroupVecRange<QuasiAlignment> hitLists = boost::make_iterator_range(
         structureVec.begin(), structureVec.begin() + rangeSize);
     processMiniBatch<QuasiAlignment>(
         readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
-        transcripts, clusterForest, fragLengthDist, observedBiasParams,
+        transcripts, miniBatchState, fragLengthDist, observedBiasParams,
         /**
          * NOTE : test new el model in future
          * obsEffLengths,
@@ -1427,6 +1647,10 @@ void processReadsQuasi(
   }
 
   //salmonOpts.jointLog->info("Score filtering dropped {} total mappings", numDropped);
+  salmonOpts.numAlnScoreCacheHits += scorer.numHits();
+  salmonOpts.numAlnScoreCacheMisses += scorer.numMisses();
+  salmonOpts.numReadMemoHits += numMemoHits;
+  salmonOpts.numReadMemoMisses += numMemoMisses;
   readExp.updateShortFrags(shortFragStats);
 }
 
@@ -1469,8 +1693,8 @@ void processReadsQuasi(
   // Write unmapped reads
   fmt::MemoryWriter unmappedNames;
   bool writeUnmapped = salmonOpts.writeUnmappedNames;
-  spdlog::logger* unmappedLogger =
-      (writeUnmapped) ? salmonOpts.unmappedLog.get() : nullptr;
+  AsyncBufferWriter* unmappedWriter =
+      (writeUnmapped) ? salmonOpts.unmappedWriter.get() : nullptr;
 
   auto& readBiasFW = observedBiasParams.seqBiasModelFW;
   auto& readBiasRC = observedBiasParams.seqBiasModelRC;
@@ -1483,6 +1707,14 @@ void processReadsQuasi(
   uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
   size_t minK = rapmap::utils::my_mer::k();
 
+  // Record the mappings for any later rounds if we're spilling them
+  MappingSpill* spill = initialRound ? rl.mappingSpill() : nullptr;
+  std::vector<char> spillBuf;
+
+  // (kept across all of this thread's mini-batches)
+  LocalMiniBatchState miniBatchState(readExp, transcripts, clusterForest,
+                                     fragLengthDist);
+
   size_t locRead{0};
   //uint64_t localUpperBoundHits{0};
   size_t rangeSize{0};
@@ -1519,37 +1751,43 @@ void processReadsQuasi(
    * Setup related to mapping parameters
    **/
   SASearcher<RapMapIndexT> saSearcher(qidx);
+  // look up the k-mers of the reads a little ahead of the one being mapped
+  KmerLookupPrefetcher<RapMapIndexT> prefetcher(
+      qidx, salmonOpts.mappingPrefetchDistance);
   rapmap::utils::HitCounters hctr;
 
   SingleAlignmentFormatter<RapMapIndexT*> formatter(qidx);
   fmt::MemoryWriter sstream;
   auto* qmLog = salmonOpts.qmLog.get();
   bool writeQuasimappings = (qmLog != nullptr);
+  // Only the mappings of the first pass over the reads are written in binary
+  BinaryMappingWriter* bmWriter =
+      initialRound ? salmonOpts.bmWriter.get() : nullptr;
+  std::vector<char> bmBuf;
 
   std::string rc1; rc1.reserve(300);
 
   // TODO : further investigation of bandwidth and dropoff
-  using ksw2pp::KSW2Aligner;
-  using ksw2pp::KSW2Config;
-  using ksw2pp::EnumToType;
-  using ksw2pp::KSW2AlignmentType;
-  KSW2Config config;
-  config.dropoff = -1;
-  config.gapo = salmonOpts.gapOpenPenalty;
-  config.gape = salmonOpts.gapExtendPenalty;
-  config.bandwidth = 10;
-  config.flag = 0;
-  config.flag |= KSW_EZ_SCORE_ONLY;
-  //config.flag |= KSW_EZ_APPROX_MAX | KSW_EZ_APPROX_DROP;
   int8_t a = salmonOpts.matchScore;
   int8_t b = salmonOpts.mismatchPenalty;
-  KSW2Aligner aligner(static_cast<int8_t>(a), static_cast<int8_t>(b));
-  aligner.config() = config;
-  ksw_extz_t ez;
-  memset(&ez, 0, sizeof(ksw_extz_t));
+  // The alignments of all of the reads of a chunk are scored together
+  salmon::mapping::ChunkAlnScorer scorer(
+      a, b, salmonOpts.gapOpenPenalty, salmonOpts.gapExtendPenalty, 10,
+      salmonOpts.alnScoreCacheSize);
   size_t numDropped{0};
+  bool tryAlign{salmonOpts.validateMappings};
+
+  // the score of each hit, and where those of each read start
+  std::vector<salmon::mapping::AlnScoreRef> hitJobs;
+  std::vector<size_t> hitJobStart;
+  std::vector<salmon::mapping::ReadState> readStates;
 
-  std::vector<salmon::mapping::CacheEntry> alnCache; alnCache.reserve(15);
+  // Identical reads reuse the mappings of the last one seen
+  bool useMemo = (salmonOpts.readMemoSize > 0);
+  salmon::mapping::ReadMappingMemo readMemo(salmonOpts.readMemoSize);
+  std::vector<salmon::mapping::ReadMappingMemo::Key> readKeys;
+  uint64_t numMemoHits{0};
+  uint64_t numMemoMisses{0};
 
   auto rg = parser->getReadGroup();
   while (parser->refill(rg)) {
@@ -1562,7 +1800,17 @@ void processReadsQuasi(
       std::exit(1);
     }
 
+    // First, map all of the reads of the chunk (queueing the alignments
+    // --validateMappings has to score); then, score the alignments; and
+    // finally, filter and record the mappings of each read.
+    scorer.clear();
+    hitJobs.clear();
+    hitJobStart.resize(rangeSize);
+    readStates.assign(rangeSize, salmon::mapping::ReadState());
+    readKeys.resize(rangeSize);
+
     for (size_t i = 0; i < rangeSize; ++i) { // For all the read in this batch
+      prefetcher.step(rg, i, rangeSize);
       auto& rp = rg[i];
       readLen = rp.seq.length();
       tooShort = (readLen < minK);
@@ -1572,6 +1820,27 @@ void processReadsQuasi(
       auto& jointHits = jointHitGroup.alignments();
       jointHitGroup.clearAlignments();
       hcInfo.clear();
+      hitJobStart[i] = hitJobs.size();
+
+      if (useMemo) {
+        readKeys[i] = salmon::mapping::ReadMappingMemo::Key(
+            XXH64(reinterpret_cast<const void*>(rp.seq.data()), readLen, 0), readLen);
+        if (auto* memo = readMemo.find(readKeys[i])) {
+          ++numMemoHits;
+          jointHits = memo->hits;
+          readStates[i] = memo->state;
+          readStates[i].memoized = true;
+          if (tooShort) {
+            ++shortFragStats.numTooShort;
+            shortFragStats.shortest = std::min(shortFragStats.shortest, readLen);
+          }
+          if (initialRound) {
+            upperBoundHits += memo->state.counted;
+          }
+          continue;
+        }
+        ++numMemoMisses;
+      }
 
       bool lh = tooShort ? false
         : hitCollector(rp.seq, saSearcher, hcInfo);
@@ -1587,6 +1856,7 @@ void processReadsQuasi(
         shortFragStats.shortest = std::min(shortFragStats.shortest, readLen);
       }
 
+      readStates[i].counted = (jointHits.size() > 0);
       if (initialRound) {
         upperBoundHits += (jointHits.size() > 0);
       }
@@ -1596,70 +1866,88 @@ void processReadsQuasi(
         jointHitGroup.clearAlignments();
       }
 
-        bool tryAlign{salmonOpts.validateMappings};
-        if (tryAlign) {
-          alnCache.clear();
-          auto* r1 = rp.seq.data();
-          auto l1 = static_cast<int32_t>(rp.seq.length());
-          rapmap::utils::reverseRead(rp.seq, rc1);
-          // we will not break the const promise
-          char* r1rc = const_cast<char*>(rc1.data());
-          int32_t bestScore{std::numeric_limits<int32_t>::min()};
-          std::vector<decltype(bestScore)> scores(jointHits.size(), bestScore);
-          size_t idx{0};
-          double optFrac{salmonOpts.minScoreFraction};
+      if (tryAlign and !jointHits.empty()) {
+        auto* r1 = rp.seq.data();
+        auto l1 = static_cast<int32_t>(rp.seq.length());
+        rapmap::utils::reverseRead(rp.seq, rc1);
+        const char* r1rc = rc1.data();
+        uint64_t h1 = XXH64(reinterpret_cast<const void*>(r1), l1, 0);
+        uint64_t h1rc = XXH64(reinterpret_cast<const void*>(r1rc), l1, 0);
 
-          for (auto& h : jointHits) {
-            int32_t score{std::numeric_limits<int32_t>::min()};
-            auto& t = transcripts[h.tid];
-            char* tseq = const_cast<char*>(t.Sequence());
-            const int32_t tlen = static_cast<int32_t>(t.RefLength);
-            const uint32_t buf{8};
+        for (auto& h : jointHits) {
+          auto& t = transcripts[h.tid];
+          const char* tseq = t.Sequence();
+          const int32_t tlen = static_cast<int32_t>(t.RefLength);
+          const uint32_t buf{8};
 
-            auto* rptr = h.fwd ? r1 : r1rc;
-            auto s = getAlnScore(aligner, ez, h.pos, rptr, l1, tseq, tlen, buf, alnCache);
-            if (s < (optFrac * a * rp.seq.length())) {
-              score = std::numeric_limits<decltype(score)>::min();
-            } else {
-              score = s;
-            }
-            bestScore = (score > bestScore) ? score : bestScore;
-            scores[idx] = score;
-            h.score(score);
-            ++idx;
-          }
+          hitJobs.push_back(h.fwd ? scorer.queue(h.pos, r1, h1, l1, tseq, tlen, buf)
+                                  : scorer.queue(h.pos, r1rc, h1rc, l1, tseq, tlen, buf));
+        }
+      }
+    }
 
-          uint32_t ctr{0};
-          if (bestScore > std::numeric_limits<int32_t>::min()) {
-            // Note --- with soft filtering, only those hits that are given the minimum possible
-            // score are filtered out.
-            jointHits.erase(
-                            std::remove_if(jointHits.begin(), jointHits.end(),
-                                           [&ctr, &scores, &numDropped, bestScore] (const QuasiAlignment& qa) -> bool {
-                                             // soft filter
-                                             bool rem = (scores[ctr] == std::numeric_limits<int32_t>::min());
-                                             // strict filter
-                                             //bool rem = (scores[ctr] < bestScore);
-                                             ++ctr;
-                                             numDropped += rem ? 1 : 0;
-                                             return rem;
-                                           }),
-                            jointHits.end()
-                            );
-            // for soft filter
-            double bestScoreD = static_cast<double>(bestScore);
-            std::for_each(jointHits.begin(), jointHits.end(),
-                          [bestScoreD](QuasiAlignment& qa) -> void {
-                            double v = bestScoreD - qa.score();
-                            qa.score(std::exp(-v));
-                          });
+    if (tryAlign) {
+      scorer.run();
+    }
+
+    for (size_t i = 0; i < rangeSize; ++i) {
+      auto& rp = rg[i];
+      auto& jointHitGroup = structureVec[i];
+      auto& jointHits = jointHitGroup.alignments();
+      auto& readState = readStates[i];
+
+      // (the mappings of an identical read have already been filtered)
+      if (tryAlign and !readState.memoized) {
+        int32_t bestScore{std::numeric_limits<int32_t>::min()};
+        std::vector<decltype(bestScore)> scores(jointHits.size(), bestScore);
+        size_t idx{0};
+        double optFrac{salmonOpts.minScoreFraction};
+        auto* jobs = hitJobs.data() + hitJobStart[i];
+
+        for (auto& h : jointHits) {
+          int32_t score{std::numeric_limits<int32_t>::min()};
+          auto s = scorer.score(jobs[idx]);
+          if (s < (optFrac * a * rp.seq.length())) {
+            score = std::numeric_limits<decltype(score)>::min();
           } else {
-            jointHitGroup.clearAlignments();
+            score = s;
           }
+          bestScore = (score > bestScore) ? score : bestScore;
+          scores[idx] = score;
+          h.score(score);
+          ++idx;
         }
 
+        uint32_t ctr{0};
+        if (bestScore > std::numeric_limits<int32_t>::min()) {
+          // Note --- with soft filtering, only those hits that are given the minimum possible
+          // score are filtered out.
+          jointHits.erase(
+                          std::remove_if(jointHits.begin(), jointHits.end(),
+                                         [&ctr, &scores, &numDropped, bestScore] (const QuasiAlignment& qa) -> bool {
+                                           // soft filter
+                                           bool rem = (scores[ctr] == std::numeric_limits<int32_t>::min());
+                                           // strict filter
+                                           //bool rem = (scores[ctr] < bestScore);
+                                           ++ctr;
+                                           numDropped += rem ? 1 : 0;
+                                           return rem;
+                                         }),
+                          jointHits.end()
+                          );
+          // for soft filter
+          double bestScoreD = static_cast<double>(bestScore);
+          std::for_each(jointHits.begin(), jointHits.end(),
+                        [bestScoreD](QuasiAlignment& qa) -> void {
+                          double v = bestScoreD - qa.score();
+                          qa.score(std::exp(-v));
+                        });
+        } else {
+          jointHitGroup.clearAlignments();
+        }
+      }
 
-      bool needBiasSample = salmonOpts.biasCorrect;
+      bool needBiasSample = salmonOpts.biasCorrect and !readState.memoized;
 
       for (auto& h : jointHits) {
 
@@ -1717,6 +2005,9 @@ void processReadsQuasi(
         rapmap::utils::writeAlignmentsToStream(rp, formatter, hctr, jointHits,
                                                sstream);
       }
+      if (bmWriter and !jointHits.empty()) {
+        BinaryMappingWriter::addFragment(bmBuf, rp.name, jointHits);
+      }
 
       if (writeUnmapped and jointHits.empty()) {
         // If we have no mappings --- then there's nothing to do
@@ -1724,6 +2015,14 @@ void processReadsQuasi(
         unmappedNames << rp.name << " u\n";
       }
 
+      if (useMemo and !readState.memoized and
+          jointHits.size() <= salmon::mapping::maxMemoizedHits) {
+        if (auto* memo = readMemo.insert(readKeys[i])) {
+          memo->hits = jointHits;
+          memo->state = readState;
+        }
+      }
+
       validHits += jointHits.size();
       locRead++;
       ++numObservedFragments;
@@ -1749,12 +2048,7 @@ void processReadsQuasi(
     } // end for i < j->nb_filled
 
     if (writeUnmapped) {
-      std::string outStr(unmappedNames.str());
-      // Get rid of last newline
-      if (!outStr.empty()) {
-        outStr.pop_back();
-        unmappedLogger->info(std::move(outStr));
-      }
+      unmappedWriter->write(unmappedNames.data(), unmappedNames.size());
       unmappedNames.clear();
     }
 
@@ -1768,18 +2062,30 @@ void processReadsQuasi(
       sstream.clear();
     }
 
+    if (bmWriter) {
+      bmWriter->push(bmBuf);
+    }
+
     prevObservedFrags = numObservedFragments;
+    if (spill != nullptr) {
+      spill->writeBatch(structureVec.begin(), structureVec.begin() + rangeSize,
+                        rangeSize, spillBuf);
+    }
     AlnGroupVecRange<QuasiAlignment> hitLists = boost::make_iterator_range(
         structureVec.begin(), structureVec.begin() + rangeSize);
     processMiniBatch<QuasiAlignment>(
         readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
-        transcripts, clusterForest, fragLengthDist, observedBiasParams,
+        transcripts, miniBatchState, fragLengthDist, observedBiasParams,
         /**
          * NOTE : test new el model in future
          * obsEffLengths,
          **/
         numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac);
   }
+  salmonOpts.numAlnScoreCacheHits += scorer.numHits();
+  salmonOpts.numAlnScoreCacheMisses += scorer.numMisses();
+  salmonOpts.numReadMemoHits += numMemoHits;
+  salmonOpts.numReadMemoMisses += numMemoMisses;
   readExp.updateShortFrags(shortFragStats);
 
   if (maxZeroFrac > 0.0) {
@@ -1883,6 +2189,11 @@ void processReadLibrary(
    *EffectiveLengthStats(numTxp));
    **/
 
+  // The most parsing threads the parser may start if it can't keep up
+  // with the mapping threads (it never uses more than one per file).
+  uint32_t maxParsingThreads =
+      std::max(uint32_t{1}, static_cast<uint32_t>(numThreads / 4));
+
   // If the read library is paired-end
   // ------ Paired-end --------
   if (rl.format().type == ReadType::PAIRED_END) {
@@ -1894,14 +2205,24 @@ void processReadLibrary(
     }
 
     size_t numFiles = rl.mates1().size() + rl.mates2().size();
+    // Start with a single parsing thread; the parser will start more (up to
+    // one per file pair) if the mapping threads end up waiting on it.
     uint32_t numParsingThreads{1};
-    // HACK!
-    if (rl.mates1().size() > 1 and numThreads > 8) {
-      numParsingThreads = 2;
+    if (rl.isInterleaved()) {
+      // both mates come from the same file
+      pairedParserPtr.reset(new paired_parser(rl.interleaved(), numThreads,
+                                              numParsingThreads,
+                                              miniBatchSize));
+    } else {
+      pairedParserPtr.reset(new paired_parser(rl.mates1(), rl.mates2(),
+                                              numThreads, numParsingThreads,
+                                              miniBatchSize));
     }
-    pairedParserPtr.reset(new paired_parser(rl.mates1(), rl.mates2(),
-                                            numThreads, numParsingThreads,
-                                            miniBatchSize));
+    pairedParserPtr->setNumDecompressionThreads(
+        salmonOpts.numDecompressionThreads);
+    pairedParserPtr->setReadAheadDepth(salmonOpts.readAheadDepth);
+    pairedParserPtr->setSubsample(salmonOpts.subsample, salmonOpts.subsampleSeed);
+    pairedParserPtr->setMaxParsers(maxParsingThreads);
     pairedParserPtr->start();
 
     switch (indexType) {
@@ -1926,6 +2247,9 @@ void processReadLibrary(
       }
     } break;
     case SalmonIndexType::QUASI: {
+      if (salmonOpts.bmWriter and !salmonOpts.bmWriter->started()) {
+        salmonOpts.bmWriter->start(transcripts);
+      }
       // True if we have a 64-bit SA index, false otherwise
       bool largeIndex = sidx->is64BitQuasi();
       bool perfectHashIndex = sidx->isPerfectHashQuasi();
@@ -2118,13 +2442,16 @@ void processReadLibrary(
   } // ------ Single-end --------
   else if (rl.format().type == ReadType::SINGLE_END) {
 
+    // Start with a single parsing thread; the parser will start more (up to
+    // one per file) if the mapping threads end up waiting on it.
     uint32_t numParsingThreads{1};
-    // HACK!
-    if (rl.unmated().size() > 1 and numThreads > 8) {
-      numParsingThreads = 2;
-    }
     singleParserPtr.reset(new single_parser(rl.unmated(), numThreads,
                                             numParsingThreads, miniBatchSize));
+    singleParserPtr->setNumDecompressionThreads(
+        salmonOpts.numDecompressionThreads);
+    singleParserPtr->setReadAheadDepth(salmonOpts.readAheadDepth);
+    singleParserPtr->setSubsample(salmonOpts.subsample, salmonOpts.subsampleSeed);
+    singleParserPtr->setMaxParsers(maxParsingThreads);
     singleParserPtr->start();
     switch (indexType) {
     case SalmonIndexType::FMD: {
@@ -2149,6 +2476,9 @@ void processReadLibrary(
     } break;
 
     case SalmonIndexType::QUASI: {
+      if (salmonOpts.bmWriter and !salmonOpts.bmWriter->started()) {
+        salmonOpts.bmWriter->start(transcripts);
+      }
       // True if we have a 64-bit SA index, false otherwise
       bool largeIndex = sidx->is64BitQuasi();
       bool perfectHashIndex = sidx->isPerfectHashQuasi();
@@ -2370,6 +2700,63 @@ void processReadLibrary(
   } // ------ END Single-end --------
 }
 
+/**
+ * Perform another online round over the read library `rl` by replaying the
+ * mappings recorded in its spill during the first round, rather than
+ * re-reading and re-mapping the reads.  The sequence-specific, positional
+ * and GC biases were already observed during the first round, so what is
+ * seen of them here is not recorded again.  Returns false if the spill could
+ * not be read back.
+ */
+bool replayReadLibrary(
+    ReadExperimentT& readExp, ReadLibrary& rl,
+    std::vector<Transcript>& transcripts, ClusterForest& clusterForest,
+    std::atomic<uint64_t>&
+        numObservedFragments, // total number of reads we've looked at
+    std::atomic<uint64_t>&
+        numAssignedFragments, // total number of assigned reads
+    std::atomic<bool>& burnedIn, ForgettingMassCalculator& fmCalc,
+    FragmentLengthDistribution& fragLengthDist, SalmonOpts& salmonOpts,
+    size_t numThreads) {
+  MappingSpill* spill = rl.mappingSpill();
+  if (spill == nullptr or !spill->rewind()) {
+    return false;
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numThreads; ++i) {
+    auto threadFun = [&]() -> void {
+      std::random_device rd;
+      std::default_random_engine eng(rd());
+      BiasParams observedBiasParams(salmonOpts.numConditionalGCBins,
+                                    salmonOpts.numFragGCBins, false);
+      AlnGroupVec<QuasiAlignment> structureVec(miniBatchSize);
+      std::vector<char> spillBuf;
+      uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
+      double maxZeroFrac{0.0};
+      LocalMiniBatchState miniBatchState(readExp, transcripts, clusterForest,
+                                         fragLengthDist);
+
+      size_t rangeSize{0};
+      uint32_t numFrags{0};
+      while (spill->readBatch(structureVec, rangeSize, numFrags, spillBuf)) {
+        numObservedFragments += numFrags;
+        AlnGroupVecRange<QuasiAlignment> hitLists = boost::make_iterator_range(
+            structureVec.begin(), structureVec.begin() + rangeSize);
+        processMiniBatch<QuasiAlignment>(
+            readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
+            transcripts, miniBatchState, fragLengthDist, observedBiasParams,
+            numAssignedFragments, eng, false, burnedIn, maxZeroFrac);
+      }
+    };
+    threads.emplace_back(threadFun);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  return spill->good();
+}
+
 /**
  *  Quantify the targets given in the file `transcriptFile` using the
  *  reads in the given set of `readLibraries`, and write the results
@@ -2413,37 +2800,44 @@ void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
   size_t maxReadGroup{miniBatchSize};
   uint32_t structCacheSize = numQuantThreads * maxReadGroup * 10;
 
+  // If requested, the mappings of the first round are spilled to disk so that
+  // any additional rounds can replay them (rather than re-read the reads,
+  // which might not be possible).
+  std::vector<std::shared_ptr<MappingSpill>> spills;
+  if (!salmonOpts.mappingSpillDir.empty() and salmonOpts.useQuasi) {
+    namespace bfs = boost::filesystem;
+    for (auto& rl : experiment.readLibraries()) {
+      bfs::path spillPath = bfs::unique_path(
+          bfs::path(salmonOpts.mappingSpillDir) /
+          "salmon_mapping_spill_%%%%-%%%%-%%%%.bin");
+      std::shared_ptr<MappingSpill> spill(
+          new MappingSpill(spillPath.string()));
+      if (!spill->good()) {
+        jointLog->warn("Could not create the mapping spill file [{}]; "
+                       "only a single round over the reads will be made.",
+                       spillPath.string());
+        spills.clear();
+        break;
+      }
+      rl.setMappingSpill(spill);
+      spills.push_back(spill);
+    }
+    if (spills.empty()) {
+      for (auto& rl : experiment.readLibraries()) {
+        rl.setMappingSpill(nullptr);
+      }
+    }
+  }
+  bool replaySpills = !spills.empty();
+
   // EQCLASS
   bool terminate{false};
 
   while (numObservedFragments < numRequiredFragments and !terminate) {
     prevNumObservedFragments = numObservedFragments;
     if (!initialRound) {
-      bool didReset = (salmonOpts.disableMappingCache)
-                          ? (experiment.reset())
-                          : (experiment.softReset());
-
-      if (!didReset) {
-        std::string errmsg = fmt::format(
-            "\n\n======== WARNING ========\n"
-            "One of the provided read files: [{}] "
-            "is not a regular file and therefore can't be read from "
-            "more than once.\n\n"
-            "We observed only {} mapping fragments when we wanted at least "
-            "{}.\n\n"
-            "Please consider re-running Salmon with these reads "
-            "as a regular file!\n"
-            "NOTE: If you received this warning from salmon but did not "
-            "disable the mapping cache (--disableMappingCache), then there \n"
-            "was some other problem. Please make sure, e.g., that you have not "
-            "run out of disk space.\n"
-            "==========================\n\n",
-            experiment.readFilesAsString(), numObservedFragments,
-            numRequiredFragments);
-        jointLog->warn(errmsg);
-        break;
-      }
-
+      // Later rounds only ever replay the spilled mappings
+      experiment.softReset();
       numPrevObservedFragments = numObservedFragments;
     }
 
@@ -2475,18 +2869,69 @@ void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
       prevNumAssignedFragments = totalAssignedFragments;
     };
 
+    bool replayFailed{false};
+    auto replayReadLibraryCallback =
+        [&](ReadLibrary& rl, SalmonIndex* sidx,
+            std::vector<Transcript>& transcripts, ClusterForest& clusterForest,
+            FragmentLengthDistribution& fragLengthDist,
+            std::atomic<uint64_t>& numAssignedFragments, size_t numQuantThreads,
+            std::atomic<bool>& burnedIn) -> void {
+
+      if (!replayReadLibrary(experiment, rl, transcripts, clusterForest,
+                             numObservedFragments, totalAssignedFragments,
+                             burnedIn, fmCalc, fragLengthDist, salmonOpts,
+                             numQuantThreads)) {
+        replayFailed = true;
+      }
+
+      numAssignedFragments = totalAssignedFragments - prevNumAssignedFragments;
+      prevNumAssignedFragments = totalAssignedFragments;
+    };
+
     // Process all of the reads
     if (!salmonOpts.quiet) {
       fmt::print(stderr, "\n\n\n\n");
     }
-    experiment.processReads(numQuantThreads, salmonOpts,
-                            processReadLibraryCallback);
+    if (initialRound) {
+      experiment.processReads(numQuantThreads, salmonOpts,
+                              processReadLibraryCallback);
+    } else {
+      // The equivalence classes are re-built from the replayed mappings, so
+      // that each fragment is counted once, with the most recent model.
+      experiment.equivalenceClassBuilder().clear();
+      experiment.processReads(numQuantThreads, salmonOpts,
+                              replayReadLibraryCallback);
+    }
     experiment.setNumObservedFragments(numObservedFragments);
 
-    // EQCLASS
-    bool done = experiment.equivalenceClassBuilder().finish();
-    // skip the extra online rounds
-    terminate = true;
+    if (replaySpills) {
+      bool spillsOK{!replayFailed};
+      for (auto& spill : spills) {
+        spillsOK = spillsOK and spill->good();
+      }
+      if (!spillsOK and !initialRound) {
+        // The equivalence classes of a partial replay would be incomplete
+        jointLog->error("The mapping spill could not be read back in full.  "
+                        "I won't proceed.");
+        std::exit(1);
+      } else if (!spillsOK) {
+        jointLog->warn("Writing the mapping spill failed (is the disk full?); "
+                       "no further rounds over the reads will be made.");
+        replaySpills = false;
+      } else if (initialRound) {
+        uint64_t spillBytes{0};
+        for (auto& spill : spills) {
+          spillBytes += spill->numBytes();
+        }
+        salmonOpts.fileLog->info("Spilled the mappings of {} fragments ({} "
+                                 "bytes) for replay in later rounds",
+                                 numObservedFragments.load(), spillBytes);
+      }
+    }
+    // Without a spill to replay, skip the extra online rounds; also stop
+    // if the last round saw nothing (so that another won't either).
+    terminate = !replaySpills or
+                (numObservedFragments == prevNumObservedFragments);
 
     initialRound = false;
     ++roundNum;
@@ -2514,6 +2959,15 @@ void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
     fmt::print(stderr, "\n\n\n\n");
   }
 
+  // EQCLASS
+  bool done = experiment.equivalenceClassBuilder().finish();
+
+  // Remove the spill files
+  for (auto& rl : experiment.readLibraries()) {
+    rl.setMappingSpill(nullptr);
+  }
+  spills.clear();
+
   // Report statistics about short fragments
   salmon::utils::ShortFragStats shortFragStats = experiment.getShortFragStats();
   if (shortFragStats.numTooShort > 0) {
@@ -2875,28 +3329,16 @@ transcript abundance from RNA-seq reads
       }
     }
 
-    if (sopt.writeUnmappedNames) {
-      auto l = sopt.unmappedLog.get();
-      // If the logger was created, then flush it and
-      // close the associated file.
-      if (l) {
-        l->flush();
-        if (sopt.unmappedFile) {
-          sopt.unmappedFile->close();
-        }
-      }
+    // If the writers were created, then finish writing
+    // and close the associated files.
+    if (sopt.unmappedWriter and !sopt.unmappedWriter->close()) {
+      jointLog->error("Failed to write the unmapped read names to {}",
+                      sopt.unmappedWriter->path());
     }
 
-    if (sopt.writeOrphanLinks) {
-      auto l = sopt.orphanLinkLog.get();
-      // If the logger was created, then flush it and
-      // close the associated file.
-      if (l) {
-        l->flush();
-        if (sopt.orphanLinkFile) {
-          sopt.orphanLinkFile->close();
-        }
-      }
+    if (sopt.orphanLinkWriter and !sopt.orphanLinkWriter->close()) {
+      jointLog->error("Failed to write the orphan links to {}",
+                      sopt.orphanLinkWriter->path());
     }
 
     // if we wrote quasimappings, flush that buffer
@@ -2909,6 +3351,19 @@ transcript abundance from RNA-seq reads
       }
     }
 
+    // finish writing the binary quasi-mappings
+    if (sopt.bmWriter) {
+      auto& bmWriter = *(sopt.bmWriter.get());
+      if (bmWriter.close()) {
+        jointLog->info("Wrote {} bytes of binary mappings ({} compressed) to {}",
+                       bmWriter.numBytes(), bmWriter.numCompressedBytes(),
+                       bmWriter.path());
+      } else {
+        jointLog->error("Failed to write the binary mappings to {}; the file "
+                        "is incomplete", bmWriter.path());
+      }
+    }
+
     sopt.runStopTime = salmon::utils::getCurrentTimeAsString();
 
     // Write meta-information about the run
@@ -153,7 +153,10 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
   }
 
   // EQClass
-  auto& eqBuilder = alnLib.equivalenceClassBuilder();
+  // (the classes of each mini-batch are collected locally, and added to the
+  // shared map all at once)
+  LocalEquivalenceClassBuilder<TGValue> eqBuilder(
+      alnLib.equivalenceClassBuilder());
   auto& readBiasFW = observedBiasParams.seqBiasModelFW;
   auto& readBiasRC = observedBiasParams.seqBiasModelRC;
   auto& observedGCMass = observedBiasParams.observedGCMass;
@@ -182,6 +185,13 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
       alnLib.fragmentStartPositionDistributions();
 
   auto& fragLengthDist = *(alnLib.fragmentLengthDistribution());
+  // (the fragment lengths of each mini-batch are collected locally, and added
+  // to the shared fld all at once)
+  LocalFragmentLengthDistribution fragLengths(fragLengthDist);
+  // (as are the masses assigned to the transcripts)
+  LocalTranscriptMasses txpMasses(refs);
+  // (and the cluster merges and updates)
+  LocalClusterUpdates clusterUpdates(clusterForest);
   auto& alnMod = alnLib.alignmentModel();
 
   bool useFSPD{salmonOpts.useFSPD};
@@ -261,6 +271,7 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
           // EQCLASS
           std::vector<uint32_t> txpIDs;
           std::vector<double> auxProbs;
+          std::vector<double> alnLogProbs;
           double auxDenom = salmon::math::LOG_0;
 
           // The alignments must be sorted by transcript id
@@ -300,26 +311,12 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             if (flen > 0.0 and aln->isPaired() and useFragLengthDist and
                 considerCondProb) {
               size_t fl = flen;
-              double lenProb = fragLengthDist.pmf(fl);
               if (burnedIn) {
                 /* condition fragment length prob on txp length */
-                double refLengthCM =
-                    fragLengthDist.cmf(static_cast<size_t>(refLength));
-                bool computeMass =
-                    fl < refLength and !salmon::math::isLog0(refLengthCM);
-                logFragProb = (computeMass) ? (lenProb - refLengthCM)
-                                            : salmon::math::LOG_EPSILON;
-                if (computeMass and refLengthCM < lenProb) {
-                  // Threading is hard!  It's possible that an update to the PMF
-                  // snuck in between when we asked to cache the CMF and when
-                  // the "burnedIn" variable was last seen as false.
-                  log->info("reference length = {}, CMF[refLen] = {}, fragLen "
-                            "= {}, PMF[fragLen] = {}",
-                            refLength, std::exp(refLengthCM), aln->fragLen(),
-                            std::exp(lenProb));
-                }
+                logFragProb = fragLengthDist.conditionalPMF(
+                    fl, static_cast<size_t>(refLength));
               } else if (useAuxParams) {
-                logFragProb = lenProb;
+                logFragProb = fragLengthDist.pmf(fl);
               }
             }
 
@@ -362,7 +359,7 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             if (noLengthCorrection) {
               logRefLength = 1.0;
             } else if (salmonOpts.noEffectiveLengthCorrection or !burnedIn) {
-              logRefLength = std::log(transcript.RefLength);
+              logRefLength = salmon::math::fastLog(transcript.RefLength);
             } else {
               logRefLength = transcript.getCachedLogEffectiveLength();
             }
@@ -406,7 +403,7 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             double startPosProb{-logRefLength};
             if (aln->isPaired() and !noLengthCorrection) {
               startPosProb = (flen <= refLength)
-                                 ? -std::log(refLength - flen + 1)
+                                 ? -salmon::math::fastLog(refLength - flen + 1)
                                  : salmon::math::LOG_EPSILON;
             }
 
@@ -444,7 +441,7 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
                 startPosProb != LOG_0) {
               aln->logProb = transcriptLogCount + auxProb + startPosProb;
 
-              sumOfAlignProbs = logAdd(sumOfAlignProbs, aln->logProb);
+              alnLogProbs.push_back(aln->logProb);
               if (updateCounts and observedTranscripts.find(transcriptID) ==
                                        observedTranscripts.end()) {
                 refs[transcriptID].addTotalCount(1);
@@ -453,12 +450,15 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
               // EQCLASS
               txpIDs.push_back(transcriptID);
               auxProbs.push_back(auxProb);
-              auxDenom = salmon::math::logAdd(auxDenom, auxProb);
 
             } else {
               aln->logProb = LOG_0;
             }
           }
+          // (summed over the whole group at once)
+          sumOfAlignProbs =
+              salmon::math::logSumExp(alnLogProbs.data(), alnLogProbs.size());
+          auxDenom = salmon::math::logSumExp(auxProbs.data(), auxProbs.size());
 
           // If we have a 0-probability fragment
           if (sumOfAlignProbs == LOG_0) {
@@ -468,11 +468,8 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
           }
 
           // EQCLASS
-          double auxProbSum{0.0};
-          for (auto& p : auxProbs) {
-            p = std::exp(p - auxDenom);
-            auxProbSum += p;
-          }
+          double auxProbSum = salmon::math::expNormalize(
+              auxProbs.data(), auxProbs.size(), auxDenom);
 
           if (txpIDs.size() > 0) {
 
@@ -504,7 +501,7 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             auto& transcript = refs[transcriptID];
 
             double newMass = logForgettingMass + aln->logProb;
-            transcript.addMass(newMass);
+            txpMasses.addMass(transcriptID, newMass);
             transcript.setLastTimestepUpdated(currentMinibatchTimestep);
 
             // ---- Collect seq-specific bias samples ------ //
@@ -737,7 +734,7 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
                 double fragLength =
                     aln->fragLengthPedantic(transcript.RefLength);
                 if (fragLength > 0) {
-                  fragLengthDist.addVal(fragLength, logForgettingMass);
+                  fragLengths.addVal(fragLength, logForgettingMass);
                 }
               }
               // Update the fragment start position distribution
@@ -756,13 +753,13 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             if (updateCounts) {
               refs[firstTranscriptID].addUniqueCount(1);
             }
-            clusterForest.updateCluster(firstTranscriptID, 1, logForgettingMass,
+            clusterUpdates.updateCluster(firstTranscriptID, 1, logForgettingMass,
                                         updateCounts);
           } else { // or the appropriate clusters
             // ughh . . . C++ still has some very rough edges
-            clusterForest.template mergeClusters<FragT>(
+            clusterUpdates.template mergeClusters<FragT>(
                 alnGroup->alignments().begin(), alnGroup->alignments().end());
-            clusterForest.updateCluster(
+            clusterUpdates.updateCluster(
                 alnGroup->alignments().front()->transcriptID(), 1,
                 logForgettingMass, updateCounts);
           }
@@ -815,6 +812,10 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
         } // end for
         */
       } // end timer
+      eqBuilder.flush();
+      fragLengths.flush();
+      txpMasses.flush();
+      clusterUpdates.flush();
 
       // If we're not keeping around a cache, then
       // reclaim the memory for these fragments and alignments
@@ -838,9 +839,8 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
           }
         }
         // NOTE: only one thread should succeed here, and that
-        // thread will set burnedIn to true
+        // thread will set burnedIn to true (after caching the fld)
         alnLib.updateTranscriptLengthsAtomic(burnedIn);
-        fragLengthDist.cacheCMF();
       }
 
       if (zeroProbFrags > 0) {
@@ -14,6 +14,8 @@
 #include "tbb/parallel_for.h"
 
 #include "AlignmentLibrary.hpp"
+#include "AsyncBufferWriter.hpp"
+#include "BinaryMappingWriter.hpp"
 #include "DistributionUtils.hpp"
 #include "GCFragModel.hpp"
 #include "KmerContext.hpp"
@@ -752,6 +754,12 @@ extractReadLibraries(boost::program_options::parsed_options& orderedOptions) {
         peLibs.back().enableAutodetect();
       }
     }
+    if (opt.string_key == "interleaved") {
+      peLibs.back().addInterleaved(opt.value);
+      if (autoLibType) {
+        peLibs.back().enableAutodetect();
+      }
+    }
     if (opt.string_key == "unmatedReads") {
       seLibs.back().addUnmated(opt.value);
       if (autoLibType) {
@@ -769,7 +777,8 @@ extractReadLibraries(boost::program_options::parsed_options& orderedOptions) {
         continue;
       }
     } else if (lib.format().type == ReadType::PAIRED_END) {
-      if (lib.mates1().size() == 0 or lib.mates2().size() == 0) {
+      if (!lib.isInterleaved() and
+          (lib.mates1().size() == 0 or lib.mates2().size() == 0)) {
         // Didn't use default paired-end library type
         continue;
       }
@@ -1326,10 +1335,11 @@ bool validateOptionsMapping_(SalmonOpts& sopt) {
   auto numUnpaired = sopt.unmatedReadFiles.size();
   auto numLeft = sopt.mate1ReadFiles.size();
   auto numRight = sopt.mate2ReadFiles.size();
+  auto numInterleaved = sopt.interleavedReadFiles.size();
 
   // currently there is some strange use for this in alevin, I think ...
   // check with avi.
-  if (numLeft + numRight > 0 and numUnpaired > 0) {
+  if (numLeft + numRight + numInterleaved > 0 and numUnpaired > 0) {
       sopt.jointLog->warn("You seem to have passed in both un-paired reads and paired-end reads. "
                           "It is not currently possible to quantify hybrid library types in salmon.");
   }
@@ -1344,6 +1354,20 @@ bool validateOptionsMapping_(SalmonOpts& sopt) {
     }
    }
 
+  if (sopt.subsample < 0.0 or
+      (sopt.subsample >= 1.0 and sopt.subsample != std::floor(sopt.subsample))) {
+    sopt.jointLog->error("The argument to --subsample ({}) should either be a fraction in (0, 1) "
+                         "or a whole number of fragments.", sopt.subsample);
+    return false;
+  }
+  // (1 could mean either all of the fragments or only the first one)
+  if (sopt.subsample == 1.0) {
+    sopt.jointLog->error("--subsample 1 is ambiguous; to use all of the fragments, leave out "
+                         "--subsample (or pass 0), and to keep a number of fragments, pass a "
+                         "count of at least 2.");
+    return false;
+  }
+
   if (sopt.mismatchPenalty > 0) {
     sopt.jointLog->warn(
                         "You set the mismatch penalty as {}, but it should be negative.  It is being negated to {}.",
@@ -1378,8 +1402,8 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
 
   auto jointLog = sopt.jointLog;
 
-  // Create the file (and logger) for outputting unmapped reads, if the user has
-  // asked for it.
+  // Create the file (and writer) for outputting unmapped reads, if the user
+  // has asked for it.
   if (sopt.writeUnmappedNames) {
     boost::filesystem::path auxDir = sopt.outputDirectory / sopt.auxDir;
     bool auxSuccess = bfs::exists(auxDir) and bfs::is_directory(auxDir);
@@ -1387,27 +1411,17 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
       return false;
     }
     bfs::path unmappedNameFile = auxDir / "unmapped_names.txt";
-    std::ofstream* outFile = new std::ofstream(unmappedNameFile.string());
+    sopt.unmappedWriter.reset(new AsyncBufferWriter(unmappedNameFile.string()));
     // Make sure file opened successfully.
-    if (!outFile->is_open()) {
+    if (!sopt.unmappedWriter->good()) {
       jointLog->error("Could not create file for unmapped read names [{}]",
                       unmappedNameFile.string());
-      delete outFile;
       return false;
     }
-    auto outputSink =
-        std::make_shared<spdlog::sinks::ostream_sink_mt>(*outFile);
-
-    std::shared_ptr<spdlog::logger> outLog =
-        std::make_shared<spdlog::logger>("unmappedLog", outputSink);
-    spdlog::register_logger(outLog);
-    outLog->set_pattern("%v");
-    sopt.unmappedFile.reset(outFile);
-    sopt.unmappedLog = outLog;
   }
 
-  // Create the file (and logger) for outputting unmapped reads, if the user has
-  // asked for it.
+  // Create the file (and writer) for outputting orphan links, if the user
+  // has asked for it.
   if (sopt.writeOrphanLinks) {
     boost::filesystem::path auxDir = sopt.outputDirectory / sopt.auxDir;
     bool auxSuccess = bfs::exists(auxDir) and bfs::is_directory(auxDir);
@@ -1415,24 +1429,13 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
       return false;
     }
     bfs::path orphanLinkFile = auxDir / "orphan_links.txt";
-    std::ofstream* outFile = new std::ofstream(orphanLinkFile.string());
+    sopt.orphanLinkWriter.reset(new AsyncBufferWriter(orphanLinkFile.string()));
     // Make sure file opened successfully.
-    if (!outFile->is_open()) {
+    if (!sopt.orphanLinkWriter->good()) {
       jointLog->error("Could not create file for orphan links [{}]",
                       orphanLinkFile.string());
-      delete outFile;
       return false;
     }
-
-    auto outputSink =
-        std::make_shared<spdlog::sinks::ostream_sink_mt>(*outFile);
-
-    std::shared_ptr<spdlog::logger> outLog =
-        std::make_shared<spdlog::logger>("orphanLinkLog", outputSink);
-    spdlog::register_logger(outLog);
-    outLog->set_pattern("%v");
-    sopt.orphanLinkFile.reset(outFile);
-    sopt.orphanLinkLog = outLog;
   }
 
   // Determine what we'll do with quasi-mapping results
@@ -1485,6 +1488,29 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
     sopt.qmLog = std::make_shared<spdlog::logger>("qmStream", outputSink);
     sopt.qmLog->set_pattern("%v");
   }
+
+  // and with the binary quasi-mapping results
+  if (sopt.bmFileName != "") {
+    sopt.bmFileName = boost::filesystem::absolute(sopt.bmFileName).string();
+    bfs::path bmDir = boost::filesystem::path(sopt.bmFileName).parent_path();
+    bool bmDirSuccess = boost::filesystem::is_directory(bmDir);
+    if (!bmDirSuccess) {
+      bmDirSuccess = boost::filesystem::create_directories(bmDir);
+    }
+    if (!bmDirSuccess) {
+      jointLog->error("Couldn't create requested directory {} in which "
+                      "to place the binary mapping output",
+                      bmDir.string());
+      return false;
+    }
+    sopt.bmWriter.reset(new BinaryMappingWriter(sopt.bmFileName));
+    if (!sopt.bmWriter->good()) {
+      jointLog->error(
+          "Could not create file for writing binary quasi-mappings [{}]",
+          sopt.bmFileName);
+      return false;
+    }
+  }
   return true;
 }
 
@@ -1612,10 +1638,8 @@ bool processQuantOptions(SalmonOpts& sopt,
     // Determine what we'll do with quasi-mapping results
     bool writeQuasimappings = (sopt.qmFileName != "");
 
-    // make it larger if we're writing mappings or
-    // unmapped names.
-    if (writeQuasimappings or sopt.writeUnmappedNames or
-        sopt.writeOrphanLinks) {
+    // make it larger if we're writing mappings
+    if (writeQuasimappings) {
       max_q_size = 2097152; // 4194304;//16777216;
     }
   }
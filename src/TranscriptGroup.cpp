@@ -9,6 +9,10 @@ TranscriptGroup::TranscriptGroup() : hash(0) {}
 
 TranscriptGroup::TranscriptGroup(std::vector<uint32_t> txpsIn)
     : txps(txpsIn), valid(true) {
+  updateHash();
+}
+
+void TranscriptGroup::updateHash() {
   size_t seed{0};
   hash = XXH64(static_cast<void*>(txps.data()), txps.size() * sizeof(uint32_t),
                seed);
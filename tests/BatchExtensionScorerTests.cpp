@@ -0,0 +1,80 @@
+#include <random>
+#include "BatchExtensionScorer.hpp"
+
+SCENARIO("Batched extension scores match those of ksw2") {
+
+    GIVEN("Random reads and (mutated) reference windows") {
+        int8_t a = 2, b = 4, gapo = 5, gape = 3;
+        int w = 10;
+        ksw2pp::KSW2Aligner aligner(a, b);
+        ksw2pp::KSW2Config config;
+        config.dropoff = -1;
+        config.gapo = gapo;
+        config.gape = gape;
+        config.bandwidth = w;
+        config.flag = KSW_EZ_SCORE_ONLY;
+        aligner.config() = config;
+        ksw_extz_t ez;
+        memset(&ez, 0, sizeof(ksw_extz_t));
+
+        salmon::mapping::BatchExtensionScorer scorer(a, b, gapo, gape, w);
+
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> base(0, 3);
+        std::uniform_int_distribution<int> coin(0, 99);
+        const char* alphabet = "ACGT";
+        std::vector<std::string> reads, windows;
+        for (size_t i = 0; i < 300; ++i) {
+            // lengths up to the point where the scorer hands off to ksw2
+            int32_t rlen = 1 + (gen() % 500);
+            std::string r;
+            for (int32_t k = 0; k < rlen; ++k) {
+                r += (coin(gen) < 2) ? 'N' : alphabet[base(gen)];
+            }
+            std::string t;
+            for (auto c : r) {
+                int x = coin(gen);
+                if (x < 3) { t += alphabet[base(gen)]; }
+                else if (x < 5) { continue; }
+                else if (x < 7) { t += c; t += alphabet[base(gen)]; }
+                else { t += c; }
+            }
+            // the reference window is (up to) 8 bases longer than the read
+            t += std::string(gen() % 9, 'G');
+            if (i % 7 == 0) { t = t.substr(0, gen() % (t.size() + 1)); }
+            reads.push_back(r);
+            windows.push_back(t);
+            scorer.add(r.data(), r.size(), t.data(), t.size());
+        }
+
+        std::vector<int32_t> expected(reads.size(), KSW_NEG_INF);
+        for (size_t i = 0; i < reads.size(); ++i) {
+            if (!windows[i].empty()) {
+                ez.max_q = ez.max_t = ez.mqe_t = ez.mte_q = -1;
+                ez.max = 0, ez.mqe = ez.mte = KSW_NEG_INF;
+                ez.n_cigar = 0;
+                aligner(reads[i].data(), reads[i].size(), windows[i].data(), windows[i].size(), &ez,
+                        ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::EXTENSION>());
+                expected[i] = std::max(ez.mqe, ez.mte);
+            }
+        }
+
+        THEN("every kernel the CPU supports gives the scores ksw_extz2_sse() computes") {
+            using Kernel = salmon::mapping::BatchExtensionScorer::Kernel;
+            std::vector<std::pair<Kernel, std::string>> kernels{
+                {Kernel::KSW2, "ksw2"}, {Kernel::SSE41, "SSE4.1"}, {Kernel::AVX2, "AVX2"}};
+            for (auto& k : kernels) {
+                if (!scorer.setKernel(k.first)) {
+                    WARN("the CPU doesn't support the " << k.second << " kernel; not testing it");
+                    continue;
+                }
+                REQUIRE(scorer.kernel() == k.first);
+                scorer.run();
+                INFO("kernel: " << k.second);
+                for (size_t i = 0; i < reads.size(); ++i) {
+                    REQUIRE(scorer.score(i) == expected[i]);
+                }
+            }
+        }
+    }
+}
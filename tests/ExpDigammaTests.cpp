@@ -0,0 +1,54 @@
+#include <random>
+#include <vector>
+#include <boost/math/special_functions/digamma.hpp>
+#include "ExpDigamma.hpp"
+#include "ExpDigammaKernel.hpp"
+
+SCENARIO("The expected-theta kernel agrees with boost's digamma") {
+
+    GIVEN("Random abundances over the range the VBEM sees") {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<double> logArg(std::log(1e-6),
+                                                      std::log(1e9));
+        // (an odd size, so that the vector kernel leaves a tail)
+        size_t n = 100003;
+        std::vector<double> x(n);
+        for (auto& v : x) {
+            v = std::exp(logArg(gen));
+        }
+        x[0] = 0.0;
+        x[1] = 1e-10;
+        x[2] = -1.0;
+        std::vector<double> out(n), scalarOut(n);
+
+        for (double logNorm : {-5.0, 0.0, 12.0, 25.0}) {
+            salmon::math::expDigamma(x.data(), n, logNorm, 1e-10, out.data());
+            salmon::math::digamma_kernel::expDigammaBatch<
+                salmon::math::digamma_kernel::ScalarOps>(
+                    x.data(), n, logNorm, 1e-10, scalarOut.data());
+            double maxErr{0.0};
+            double maxTinyErr{0.0};
+            bool sameAsScalar{true};
+            for (size_t i = 3; i < n; ++i) {
+                long double ref =
+                    std::exp(boost::math::digamma(static_cast<long double>(x[i])) -
+                             static_cast<long double>(logNorm));
+                if (ref > 1e-290L) {
+                    maxErr = std::max(maxErr, static_cast<double>(
+                                                  std::abs(out[i] - ref) / ref));
+                } else {
+                    maxTinyErr = std::max(maxTinyErr, out[i]);
+                }
+                sameAsScalar = sameAsScalar and (out[i] == scalarOut[i]);
+            }
+            THEN("the values are within the documented error") {
+                REQUIRE(maxErr < 1e-12);
+                REQUIRE(maxTinyErr < 1e-290);
+                REQUIRE(sameAsScalar);
+                REQUIRE(out[0] == 0.0);
+                REQUIRE(out[1] == 0.0);
+                REQUIRE(out[2] == 0.0);
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#include <random>
+#include <vector>
+#include "SalmonMath.hpp"
+
+SCENARIO("The log-space kernels agree with the scalar functions") {
+
+    GIVEN("Random values over the whole range of the approximations") {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<double> expArg(-708.0, 709.0);
+        std::uniform_real_distribution<double> logArg(-300.0, 300.0);
+        double maxExpErr{0.0}, maxLogErr{0.0};
+        for (size_t i = 0; i < 100000; ++i) {
+            double x = expArg(gen);
+            double e = std::exp(x);
+            maxExpErr = std::max(maxExpErr,
+                                 std::abs(salmon::math::approx::exp(x) - e) / e);
+            double y = std::exp(logArg(gen));
+            double l = std::log(y);
+            maxLogErr = std::max(maxLogErr,
+                                 std::abs(salmon::math::approx::log(y) - l) /
+                                 std::max(1.0, std::abs(l)));
+        }
+        THEN("exp and log are within the documented error") {
+            REQUIRE(maxExpErr < 1e-14);
+            REQUIRE(maxLogErr < 1e-14);
+            REQUIRE(salmon::math::approx::exp(0.0) == 1.0);
+            REQUIRE(salmon::math::approx::log(1.0) == 0.0);
+            REQUIRE(salmon::math::approx::exp(-800.0) == 0.0);
+            REQUIRE(std::isinf(salmon::math::approx::exp(800.0)));
+            REQUIRE(std::isinf(salmon::math::approx::log(0.0)));
+        }
+    }
+
+    GIVEN("A group of (logged) alignment probabilities, some of them zero") {
+        using salmon::math::LOG_0;
+        std::vector<double> v{-1.0, LOG_0, -2.5, -LOG_0, -30.0, -0.25};
+        double chain{LOG_0};
+        for (auto x : v) {
+            chain = salmon::math::logAdd(chain, x);
+        }
+        THEN("logSumExp matches a chain of logAdds") {
+            double lse = salmon::math::logSumExp(v.data(), v.size());
+            REQUIRE(std::abs(lse - chain) < 1e-12);
+            REQUIRE(salmon::math::logSumExp(v.data(), 0) == LOG_0);
+            REQUIRE(salmon::math::logSumExp(&v[1], 1) == LOG_0);
+        }
+        THEN("expNormalize gives probabilities that sum to one") {
+            std::vector<double> w{-1.0, -2.5, -30.0, -0.25};
+            double lse = salmon::math::logSumExp(w.data(), w.size());
+            double sum = salmon::math::expNormalize(w.data(), w.size(), lse);
+            REQUIRE(std::abs(sum - 1.0) < 1e-12);
+            REQUIRE(std::abs(w[0] - std::exp(-1.0 - lse)) < 1e-12);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <zlib.h>
+#include "ParallelGzipReader.hpp"
+
+namespace {
+std::string gzipMember(const std::string& data, int level, int strategy) {
+  z_stream strm;
+  std::memset(&strm, 0, sizeof(strm));
+  // 15 + 16 : write a gzip header and trailer
+  deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, strategy);
+  std::string out(deflateBound(&strm, data.size()), '\0');
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  strm.avail_in = static_cast<uInt>(data.size());
+  strm.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  strm.avail_out = static_cast<uInt>(out.size());
+  deflate(&strm, Z_FINISH);
+  out.resize(strm.total_out);
+  deflateEnd(&strm);
+  return out;
+}
+
+// Reads path with numInflaters threads; returns false on an error.
+bool readAll(const std::string& path, uint32_t numInflaters,
+             std::string& out) {
+  fastx_parser::ParallelGzipReader reader(numInflaters);
+  out.clear();
+  if (!reader.open(path)) {
+    return false;
+  }
+  const unsigned char* buf{nullptr};
+  int n{0};
+  while ((n = reader.next(buf)) > 0) {
+    out.append(reinterpret_cast<const char*>(buf), n);
+  }
+  reader.close();
+  return n == 0;
+}
+}
+
+SCENARIO("Regular gzip files are inflated correctly by several threads") {
+
+    GIVEN("Several megabytes of FASTQ records, compressed in several ways") {
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<int> base(0, 3);
+        std::string reads;
+        for (size_t i = 0; i < 60000; ++i) {
+            std::string seq(100, 'A');
+            for (auto& c : seq) {
+                c = "ACGT"[base(gen)];
+            }
+            reads += "@read" + std::to_string(i) + "\n" + seq + "\n+\n" +
+                     std::string(100, (i % 7 == 0) ? '#' : 'F') + "\n";
+        }
+        std::string runs(3 << 20, 'A');
+
+        char path[] = "/tmp/salmon_gzip_test_XXXXXX";
+        int fd = mkstemp(path);
+        REQUIRE(fd >= 0);
+        ::close(fd);
+        auto write = [&path](const std::string& data) -> void {
+            std::FILE* f = std::fopen(path, "wb");
+            std::fwrite(data.data(), 1, data.size(), f);
+            std::fclose(f);
+        };
+
+        struct Case {
+            std::string name;
+            std::string file;
+            std::string expected;
+        };
+        std::vector<Case> cases{
+            {"level 1", gzipMember(reads, 1, Z_DEFAULT_STRATEGY), reads},
+            {"level 6", gzipMember(reads, 6, Z_DEFAULT_STRATEGY), reads},
+            {"fixed codes", gzipMember(reads, 6, Z_FIXED), reads},
+            {"stored blocks", gzipMember(reads, 0, Z_DEFAULT_STRATEGY), reads},
+            {"long runs", gzipMember(runs, 9, Z_DEFAULT_STRATEGY), runs}};
+        std::string multi = gzipMember(reads, 6, Z_DEFAULT_STRATEGY) +
+                            gzipMember(runs, 1, Z_DEFAULT_STRATEGY);
+        cases.push_back({"several members and trailing garbage",
+                         multi + "garbage", reads + runs});
+
+        THEN("the output matches the input, whatever the number of inflaters") {
+            for (auto& c : cases) {
+                write(c.file);
+                for (uint32_t numInflaters : {1u, 2u, 4u}) {
+                    INFO(c.name << " with " << numInflaters << " inflaters");
+                    std::string out;
+                    REQUIRE(readAll(path, numInflaters, out));
+                    REQUIRE(out == c.expected);
+                }
+            }
+        }
+
+        THEN("truncated or corrupted files are reported as errors") {
+            std::string file = cases[1].file;
+            std::vector<std::string> bad{file.substr(0, file.size() / 2),
+                                         file.substr(0, file.size() - 4),
+                                         file};
+            bad[2][file.size() - 6] ^= 1;
+            for (auto& b : bad) {
+                write(b);
+                for (uint32_t numInflaters : {1u, 3u}) {
+                    std::string out;
+                    REQUIRE_FALSE(readAll(path, numInflaters, out));
+                }
+            }
+        }
+        std::remove(path);
+    }
+}
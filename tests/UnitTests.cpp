@@ -1,5 +1,6 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include <unordered_map>
+#include <cstring>
 #include <iostream>
 #include "catch.hpp"
 #include "LibraryFormat.hpp"
@@ -10,5 +11,9 @@ bool verbose=false; // Apparently, we *need* this (OSX)
 
 #include "GCSampleTests.cpp"
 #include "LibraryTypeTests.cpp"
+#include "BatchExtensionScorerTests.cpp"
+#include "LogMathTests.cpp"
+#include "ExpDigammaTests.cpp"
+#include "ParallelGzipReaderTests.cpp"
 //#include "KmerHistTests.cpp"
 